@@ -0,0 +1,582 @@
+#include "AsyncAnalyzer.h"
+#include "MelSpectrogram.h"
+#include "InferenceProcessor.h"
+#include "Postprocessor.h"
+#include "Resampler.h"
+#include "Spectrogram.h"
+#include "PipelineOptions.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace BeatThis {
+
+namespace {
+    // Pipeline stages owned by one worker thread (none of them is thread-safe)
+    struct WorkerContext {
+        MelSpectrogram mel_spectrogram;
+        std::unique_ptr<InferenceProcessor> inference_processor;
+        Postprocessor postprocessor;
+        Resampler::Quality resample_quality;
+
+        // Resamplers by (input rate, channel count), kept so filter tables are built once
+        std::map<std::pair<int, int>, std::unique_ptr<Resampler>> resamplers;
+        std::vector<float> resampled_buffer;
+
+        WorkerContext(std::unique_ptr<InferenceProcessor> processor, Resampler::Quality quality,
+                      const PostprocessOptions& postprocess, const MelSpectrogram::Options& mel_options)
+            : mel_spectrogram(mel_options),
+              inference_processor(std::move(processor)),
+              postprocessor(model_fps, postprocess.kernel_size, postprocess.threshold, postprocess.dedup_width),
+              resample_quality(quality) {}
+
+        Resampler& get_resampler(int samplerate, int channels) {
+            auto& resampler = resamplers[{samplerate, channels}];
+            if (!resampler) {
+                resampler = std::make_unique<Resampler>(samplerate, target_samplerate, channels, resample_quality);
+            } else {
+                resampler->reset();
+            }
+            return *resampler;
+        }
+    };
+
+    using Task = std::function<void(WorkerContext&)>;
+
+    /**
+     * Work-stealing thread pool. Tasks injected from outside go to a shared FIFO
+     * queue; tasks spawned by a running task go to the back of that worker's own
+     * deque. A worker takes shared tasks first, then its own newest task, and
+     * otherwise steals the oldest task of another worker.
+     */
+    class TaskPool {
+    public:
+        explicit TaskPool(std::vector<std::unique_ptr<WorkerContext>> contexts) {
+            for (auto& context : contexts) {
+                workers.push_back(std::make_unique<Worker>());
+                workers.back()->context = std::move(context);
+            }
+            for (size_t i = 0; i < workers.size(); ++i) {
+                threads.emplace_back([this, i] { run(i); });
+            }
+        }
+
+        // Runs every queued task, then joins the workers
+        ~TaskPool() {
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        }
+
+        TaskPool(const TaskPool&) = delete;
+        TaskPool& operator=(const TaskPool&) = delete;
+
+        void inject(Task task) {
+            queued.fetch_add(1);
+            {
+                std::lock_guard<std::mutex> lock(shared_mutex);
+                shared_tasks.push_back(std::move(task));
+            }
+            signal();
+        }
+
+        // From a worker thread, queues on that worker's deque; otherwise like inject()
+        void spawn(Task task) {
+            if (current_pool != this) {
+                inject(std::move(task));
+                return;
+            }
+            queued.fetch_add(1);
+            {
+                Worker& self = *workers[current_worker];
+                std::lock_guard<std::mutex> lock(self.mutex);
+                self.tasks.push_back(std::move(task));
+            }
+            signal();
+        }
+
+    private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+            std::unique_ptr<WorkerContext> context;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::vector<std::thread> threads;
+        std::mutex shared_mutex;
+        std::deque<Task> shared_tasks;
+
+        // Tasks queued anywhere; counted before they are pushed, so it never underflows
+        std::atomic<long> queued{0};
+        std::mutex sleep_mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+
+        static thread_local const TaskPool* current_pool;
+        static thread_local size_t current_worker;
+
+        void signal() {
+            { std::lock_guard<std::mutex> lock(sleep_mutex); }
+            wake.notify_one();
+        }
+
+        bool take(size_t index, Task& task) {
+            {
+                std::lock_guard<std::mutex> lock(shared_mutex);
+                if (!shared_tasks.empty()) {
+                    task = std::move(shared_tasks.front());
+                    shared_tasks.pop_front();
+                    return true;
+                }
+            }
+            {
+                Worker& self = *workers[index];
+                std::lock_guard<std::mutex> lock(self.mutex);
+                if (!self.tasks.empty()) {
+                    task = std::move(self.tasks.back());
+                    self.tasks.pop_back();
+                    return true;
+                }
+            }
+            for (size_t offset = 1; offset < workers.size(); ++offset) {
+                Worker& victim = *workers[(index + offset) % workers.size()];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.tasks.empty()) {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void run(size_t index) {
+            current_pool = this;
+            current_worker = index;
+            WorkerContext& context = *workers[index]->context;
+            for (;;) {
+                Task task;
+                if (take(index, task)) {
+                    queued.fetch_sub(1);
+                    task(context);
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+                if (stopping && queued.load() <= 0) {
+                    return;
+                }
+            }
+        }
+    };
+
+    thread_local const TaskPool* TaskPool::current_pool = nullptr;
+    thread_local size_t TaskPool::current_worker = 0;
+
+    // One submitted request, shared by its tasks
+    struct Request {
+        std::vector<float> audio;
+        int samplerate = 0;
+        int channels = 1;
+        AsyncAnalyzer::Callback on_done;
+
+        Spectrogram spectrogram;
+        std::vector<InferenceProcessor::Chunk> chunks;
+        std::vector<InferenceProcessor::ChunkLogits> chunk_logits;
+        std::atomic<size_t> chunks_remaining{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;  // Written by the task that set failed
+    };
+
+    // Chunk `index` of a request, waiting to be batched
+    struct PendingChunk {
+        std::shared_ptr<Request> request;
+        size_t index;
+    };
+
+    /**
+     * Collects chunks of many requests into batches. Chunks are grouped by
+     * length (only equally long chunks can share a tensor); a group is handed
+     * to `dispatch` as soon as it holds max_batch chunks, or by the timer
+     * thread once its oldest chunk has waited max_wait.
+     */
+    class ChunkBatcher {
+    public:
+        using Clock = std::chrono::steady_clock;
+        using Dispatch = std::function<void(std::vector<PendingChunk>)>;
+
+        ChunkBatcher(size_t max_batch_, Clock::duration max_wait_, Dispatch dispatch_)
+            : max_batch(max_batch_), max_wait(max_wait_), dispatch(std::move(dispatch_)) {
+            timer = std::thread([this] { run_timer(); });
+        }
+
+        // Dispatches the chunks still pending, then stops the timer
+        ~ChunkBatcher() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            deadline_changed.notify_one();
+            timer.join();
+        }
+
+        ChunkBatcher(const ChunkBatcher&) = delete;
+        ChunkBatcher& operator=(const ChunkBatcher&) = delete;
+
+        void add(PendingChunk chunk) {
+            int length = chunk.request->chunks[chunk.index].length;
+            std::vector<PendingChunk> full;
+            bool new_group = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                Group& group = groups[length];
+                if (group.chunks.empty()) {
+                    group.deadline = Clock::now() + max_wait;
+                    new_group = true;
+                }
+                group.chunks.push_back(std::move(chunk));
+                if (group.chunks.size() >= max_batch) {
+                    full = std::move(group.chunks);
+                    group.chunks.clear();
+                }
+            }
+            if (!full.empty()) {
+                dispatch(std::move(full));
+            } else if (new_group) {
+                deadline_changed.notify_one();
+            }
+        }
+
+    private:
+        struct Group {
+            std::vector<PendingChunk> chunks;
+            Clock::time_point deadline;
+        };
+
+        size_t max_batch;
+        Clock::duration max_wait;
+        Dispatch dispatch;
+        std::mutex mutex;
+        std::condition_variable deadline_changed;
+        std::map<int, Group> groups;  // By chunk length
+        bool stopping = false;
+        std::thread timer;
+
+        void run_timer() {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                auto now = Clock::now();
+                auto next_deadline = Clock::time_point::max();
+                std::vector<std::vector<PendingChunk>> expired;
+                for (auto& entry : groups) {
+                    Group& group = entry.second;
+                    if (group.chunks.empty()) {
+                        continue;
+                    }
+                    if (stopping || group.deadline <= now) {
+                        expired.push_back(std::move(group.chunks));
+                        group.chunks.clear();
+                    } else {
+                        next_deadline = std::min(next_deadline, group.deadline);
+                    }
+                }
+                if (!expired.empty()) {
+                    lock.unlock();
+                    for (auto& batch : expired) {
+                        dispatch(std::move(batch));
+                    }
+                    lock.lock();
+                    continue;
+                }
+                if (stopping) {
+                    return;
+                }
+                if (next_deadline == Clock::time_point::max()) {
+                    deadline_changed.wait(lock);
+                } else {
+                    deadline_changed.wait_until(lock, next_deadline);
+                }
+            }
+        }
+    };
+
+    // Converts ONNX Runtime errors like the synchronous API does
+    std::exception_ptr current_error() {
+        try {
+            throw;
+        } catch (const Ort::Exception& e) {
+            return std::make_exception_ptr(std::runtime_error("ONNX Runtime error: " + std::string(e.what())));
+        } catch (...) {
+            return std::current_exception();
+        }
+    }
+}
+
+class AsyncAnalyzer::Impl {
+public:
+    int max_active;
+    bool return_logits;       // From the analyzer's BeatThisConfig
+    bool return_spectrogram;
+
+    // Admission control: at most max_active requests have tasks in the pool
+    mutable std::mutex admission_mutex;
+    std::condition_variable all_done;
+    std::deque<std::shared_ptr<Request>> waiting;
+    size_t active = 0;
+
+    std::unique_ptr<TaskPool> pool;
+    std::unique_ptr<ChunkBatcher> batcher;  // Only with cross-request batching
+
+    Impl(BeatThis& analyzer, const AsyncConfig& config)
+        : return_logits(analyzer.get_config().return_logits),
+          return_spectrogram(analyzer.get_config().return_spectrogram) {
+        int num_threads = config.num_threads > 0 ? config.num_threads
+                                                 : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        max_active = config.max_concurrent_requests > 0 ? config.max_concurrent_requests : 2 * num_threads;
+
+        Resampler::Quality quality = to_resampler_quality(analyzer.get_config().resample_quality);
+        MelSpectrogram::Options mel_options = make_mel_options(analyzer.get_config());
+        std::vector<std::unique_ptr<WorkerContext>> contexts;
+        for (int i = 0; i < num_threads; ++i) {
+            contexts.push_back(std::make_unique<WorkerContext>(
+                analyzer.create_inference_processor(std::max(1, config.max_batch_size)), quality,
+                analyzer.get_config().postprocess, mel_options));
+        }
+
+        // Clamped to 1 if the model has a fixed batch axis
+        size_t max_batch = static_cast<size_t>(contexts.front()->inference_processor->get_max_batch_size());
+        pool = std::make_unique<TaskPool>(std::move(contexts));
+        if (max_batch > 1) {
+            auto max_wait = std::chrono::duration_cast<ChunkBatcher::Clock::duration>(
+                std::chrono::duration<double, std::milli>(std::max(0.0, config.max_batch_wait_ms)));
+            batcher = std::make_unique<ChunkBatcher>(max_batch, max_wait, [this](std::vector<PendingChunk> batch) {
+                pool->inject([this, batch = std::move(batch)](WorkerContext& context) { run_batch(context, batch); });
+            });
+        }
+    }
+
+    ~Impl() {
+        std::unique_lock<std::mutex> lock(admission_mutex);
+        all_done.wait(lock, [this] { return active == 0 && waiting.empty(); });
+        lock.unlock();
+        batcher.reset();
+        pool.reset();
+    }
+
+    void submit(std::shared_ptr<Request> request) {
+        std::lock_guard<std::mutex> lock(admission_mutex);
+        if (active < static_cast<size_t>(max_active)) {
+            ++active;
+            start(std::move(request));
+        } else {
+            waiting.push_back(std::move(request));
+        }
+    }
+
+    void start(std::shared_ptr<Request> request) {
+        pool->inject([this, request](WorkerContext& context) { run_frontend(context, request); });
+    }
+
+    // Delivers the outcome and admits the next waiting request
+    void complete(const std::shared_ptr<Request>& request, BeatResult result, std::exception_ptr error) {
+        try {
+            request->on_done(std::move(result), error);
+        } catch (const std::exception& e) {
+            std::cerr << "AsyncAnalyzer callback error: " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "AsyncAnalyzer callback error" << std::endl;
+        }
+
+        std::lock_guard<std::mutex> lock(admission_mutex);
+        if (!waiting.empty()) {
+            start(std::move(waiting.front()));
+            waiting.pop_front();
+        } else {
+            --active;
+        }
+        if (active == 0 && waiting.empty()) {
+            all_done.notify_all();
+        }
+    }
+
+    void run_frontend(WorkerContext& context, const std::shared_ptr<Request>& request) {
+        try {
+            size_t num_frames = request->audio.size() / request->channels;
+            if (request->samplerate != target_samplerate) {
+                // Downmix and resample in one pass
+                Resampler& resampler = context.get_resampler(request->samplerate, request->channels);
+                context.resampled_buffer.clear();
+                resampler.process(request->audio.data(), num_frames, context.resampled_buffer);
+                resampler.flush(context.resampled_buffer);
+                context.mel_spectrogram.compute(context.resampled_buffer.data(), context.resampled_buffer.size(),
+                                                request->spectrogram);
+            } else {
+                // 22050 Hz input is downmixed while the Mel frame buffer is filled
+                context.mel_spectrogram.compute(request->audio.data(), num_frames, request->channels,
+                                                request->spectrogram);
+            }
+            std::vector<float>().swap(request->audio);
+
+            request->chunks = context.inference_processor->plan_chunks(request->spectrogram);
+            request->chunk_logits.resize(request->chunks.size());
+            if (request->chunks.empty()) {
+                finish(context, request);
+                return;
+            }
+
+            request->chunks_remaining = request->chunks.size();
+            if (batcher) {
+                for (size_t i = 0; i < request->chunks.size(); ++i) {
+                    batcher->add({request, i});
+                }
+                return;
+            }
+
+            // Spawned last is run first by this worker; others steal from the end of the piece
+            for (size_t i = request->chunks.size(); i-- > 0;) {
+                pool->spawn([this, request, i](WorkerContext& chunk_context) { run_chunk(chunk_context, request, i); });
+            }
+        } catch (...) {
+            complete(request, BeatResult(), current_error());
+        }
+    }
+
+    void run_chunk(WorkerContext& context, const std::shared_ptr<Request>& request, size_t index) {
+        if (!request->failed.load()) {
+            try {
+                request->chunk_logits[index] = context.inference_processor->run_planned_chunk(
+                    request->spectrogram, request->chunks[index]);
+            } catch (...) {
+                fail_chunk(request, current_error());
+            }
+        }
+        chunk_done(context, request);
+    }
+
+    // Runs one batch of chunks from any number of requests and routes the logits back
+    void run_batch(WorkerContext& context, const std::vector<PendingChunk>& batch) {
+        std::vector<InferenceProcessor::ChunkRef> refs;
+        std::vector<const PendingChunk*> live;
+        for (const auto& pending : batch) {
+            if (!pending.request->failed.load()) {
+                refs.push_back({&pending.request->spectrogram, pending.request->chunks[pending.index]});
+                live.push_back(&pending);
+            }
+        }
+
+        try {
+            auto logits = context.inference_processor->run_chunk_batch(refs);
+            for (size_t b = 0; b < live.size(); ++b) {
+                live[b]->request->chunk_logits[live[b]->index] = std::move(logits[b]);
+            }
+        } catch (...) {
+            std::exception_ptr error = current_error();
+            for (const auto* pending : live) {
+                fail_chunk(pending->request, error);
+            }
+        }
+
+        for (const auto& pending : batch) {
+            chunk_done(context, pending.request);
+        }
+    }
+
+    void fail_chunk(const std::shared_ptr<Request>& request, std::exception_ptr error) {
+        if (!request->failed.exchange(true)) {
+            request->error = error;
+        }
+    }
+
+    // The last chunk to finish completes the request
+    void chunk_done(WorkerContext& context, const std::shared_ptr<Request>& request) {
+        if (request->chunks_remaining.fetch_sub(1) == 1) {
+            if (request->failed.load()) {
+                complete(request, BeatResult(), request->error);
+            } else {
+                finish(context, request);
+            }
+        }
+    }
+
+    // Aggregates the chunk logits and picks the beats
+    void finish(WorkerContext& context, const std::shared_ptr<Request>& request) {
+        BeatResult result;
+        try {
+            auto logits = context.inference_processor->aggregate_chunks(
+                request->chunk_logits, request->chunks, static_cast<int>(request->spectrogram.num_frames()));
+            auto beats = context.postprocessor.process(logits.first, logits.second);
+            result.beats = std::move(beats.beats);
+            result.downbeats = std::move(beats.downbeats);
+            result.beat_counts = std::move(beats.beat_counts);
+            if (return_logits) {
+                BeatLogits& out = result.logits.emplace();
+                out.fps = model_fps;
+                out.beat = std::move(logits.first);
+                out.downbeat = std::move(logits.second);
+                if (return_spectrogram) {
+                    const Spectrogram& spectrogram = request->spectrogram;
+                    out.num_bins = static_cast<int>(spectrogram.num_bins());
+                    out.spectrogram.assign(spectrogram.data(), spectrogram.data() + spectrogram.size());
+                }
+            }
+        } catch (...) {
+            complete(request, BeatResult(), current_error());
+            return;
+        }
+        complete(request, std::move(result), nullptr);
+    }
+};
+
+AsyncAnalyzer::AsyncAnalyzer(BeatThis& analyzer, const AsyncConfig& config)
+    : pImpl(std::make_unique<Impl>(analyzer, config)) {
+}
+
+AsyncAnalyzer::~AsyncAnalyzer() = default;
+
+void AsyncAnalyzer::submit(std::vector<float> audio, int samplerate, int channels, Callback on_done) {
+    if (samplerate <= 0 || channels < 1) {
+        throw std::runtime_error("Invalid audio format: " + std::to_string(samplerate) + " Hz, " +
+                                 std::to_string(channels) + " channels");
+    }
+    auto request = std::make_shared<Request>();
+    request->audio = std::move(audio);
+    request->samplerate = samplerate;
+    request->channels = channels;
+    request->on_done = std::move(on_done);
+    pImpl->submit(std::move(request));
+}
+
+std::future<BeatResult> AsyncAnalyzer::submit(std::vector<float> audio, int samplerate, int channels) {
+    auto promise = std::make_shared<std::promise<BeatResult>>();
+    std::future<BeatResult> future = promise->get_future();
+    submit(std::move(audio), samplerate, channels, [promise](BeatResult result, std::exception_ptr error) {
+        if (error) {
+            promise->set_exception(error);
+        } else {
+            promise->set_value(std::move(result));
+        }
+    });
+    return future;
+}
+
+size_t AsyncAnalyzer::pending_requests() const {
+    std::lock_guard<std::mutex> lock(pImpl->admission_mutex);
+    return pImpl->active + pImpl->waiting.size();
+}
+
+} // namespace BeatThis
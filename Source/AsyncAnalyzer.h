@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <future>
+#include <functional>
+#include <exception>
+
+#include "beat_this_api.h"
+
+namespace BeatThis {
+
+struct AsyncConfig {
+    int num_threads = 0;                // Worker threads (0 = hardware concurrency)
+    int max_concurrent_requests = 0;    // Requests being analyzed at once (0 = 2 * num_threads); the rest wait in FIFO order
+    // Cross-request batching: equally long chunks from any requests in flight are
+    // stacked into one session run of up to max_batch_size chunks (models with a
+    // dynamic batch axis only; 1 = off). A partial batch is dispatched once its
+    // oldest chunk has waited max_batch_wait_ms.
+    int max_batch_size = 1;
+    double max_batch_wait_ms = 2.0;
+};
+
+/**
+ * Thread-safe asynchronous analysis for servers with many concurrent requests.
+ *
+ * Each request is split into a frontend task (downmix, resample and Mel
+ * spectrogram) and one inference task per 1500-frame chunk; the last chunk
+ * to finish aggregates the logits and picks the beats. The tasks run on a
+ * work-stealing pool: a worker keeps running the tasks it spawned, newest
+ * first, and idle workers steal the oldest tasks of busy ones. New requests
+ * are started before pending chunks, so a long file is spread over idle
+ * workers instead of delaying the short requests behind it.
+ *
+ * With max_batch_size > 1, chunks are not run one per task but collected
+ * across requests and dispatched as batches, which keeps a GPU busy when many
+ * short clips are in flight.
+ *
+ * At most max_concurrent_requests requests are admitted at a time, which
+ * bounds the memory held by spectrograms in flight. All workers share the
+ * analyzer's ONNX session; consider setting BeatThisConfig::intra_op_threads
+ * to 1 or 2 so concurrent session runs do not oversubscribe the CPU.
+ *
+ * The destructor waits for every submitted request to complete.
+ */
+class AsyncAnalyzer {
+public:
+    // Called on a worker thread with the result, or with error set if the request failed
+    using Callback = std::function<void(BeatResult result, std::exception_ptr error)>;
+
+    // The analyzer provides the ONNX session and must outlive this object
+    explicit AsyncAnalyzer(BeatThis& analyzer, const AsyncConfig& config = AsyncConfig());
+    ~AsyncAnalyzer();
+
+    AsyncAnalyzer(const AsyncAnalyzer&) = delete;
+    AsyncAnalyzer& operator=(const AsyncAnalyzer&) = delete;
+
+    // Queue interleaved audio for analysis. Throws std::runtime_error for an invalid format.
+    std::future<BeatResult> submit(std::vector<float> audio, int samplerate, int channels = 1);
+    void submit(std::vector<float> audio, int samplerate, int channels, Callback on_done);
+
+    // Requests submitted but not yet completed
+    size_t pending_requests() const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> pImpl;
+};
+
+} // namespace BeatThis
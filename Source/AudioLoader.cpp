@@ -0,0 +1,222 @@
+#include "AudioLoader.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <set>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include "miniaudio.h"
+
+namespace BeatThis {
+
+namespace {
+    // Frames decoded per read; the queue budget is checked between blocks
+    constexpr ma_uint64 decode_block_frames = 1 << 16;
+
+    struct DecoderGuard {
+        ma_decoder* decoder;
+        ~DecoderGuard() { ma_decoder_uninit(decoder); }
+    };
+}
+
+class AudioLoader::Impl {
+public:
+    std::vector<std::string> paths;
+    LoaderConfig config;
+
+    mutable std::mutex mutex;
+    std::condition_variable space_available;  // Decoders wait here for the consumers
+    std::condition_variable file_ready;       // Consumers wait here for the decoders
+    std::deque<LoadedAudio> ready;
+    std::set<size_t> in_progress;             // Indices being decoded
+    size_t next_index = 0;                    // Next file to start
+    size_t delivered = 0;                     // Files handed to consumers
+    size_t held_bytes = 0;                    // Samples of queued and in-progress files
+    bool cancelled = false;
+    std::vector<std::thread> threads;
+
+    Impl(std::vector<std::string> paths_, const LoaderConfig& config_)
+        : paths(std::move(paths_)), config(config_) {
+        if (config.max_queued_files < 1 || config.num_threads < 1 || config.samplerate < 0 || config.channels < 0) {
+            throw std::runtime_error("Invalid loader config: need at least one thread and one queued file");
+        }
+        size_t num_threads = std::min(static_cast<size_t>(config.num_threads), paths.size());
+        for (size_t i = 0; i < num_threads; ++i) {
+            threads.emplace_back([this] { run(); });
+        }
+    }
+
+    ~Impl() {
+        cancel();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void cancel() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancelled = true;
+        }
+        space_available.notify_all();
+        file_ready.notify_all();
+    }
+
+    bool next(LoadedAudio& audio) {
+        bool last = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            file_ready.wait(lock, [&] { return cancelled || !ready.empty() || delivered == paths.size(); });
+            if (cancelled || ready.empty()) {
+                return false;
+            }
+            audio = std::move(ready.front());
+            ready.pop_front();
+            held_bytes -= audio.samples.size() * sizeof(float);
+            last = ++delivered == paths.size();
+        }
+        space_available.notify_all();
+        if (last) {
+            // Other consumers are waiting for files that will not come
+            file_ready.notify_all();
+        }
+        return true;
+    }
+
+private:
+    // Decode thread: takes files in list order while the queue has room
+    void run() {
+        for (;;) {
+            size_t index = 0;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                space_available.wait(lock, [&] {
+                    return cancelled || next_index == paths.size() ||
+                           ready.size() + in_progress.size() < config.max_queued_files;
+                });
+                if (cancelled || next_index == paths.size()) {
+                    return;
+                }
+                index = next_index++;
+                in_progress.insert(index);
+            }
+
+            LoadedAudio audio;
+            audio.index = index;
+            audio.path = paths[index];
+            size_t reserved = 0;  // Bytes of audio.samples counted in held_bytes
+            bool stopped = false;
+            try {
+                stopped = !decode(audio, reserved);
+            } catch (const std::exception& e) {
+                audio.error = e.what();
+            }
+            if (!audio.ok()) {
+                std::vector<float>().swap(audio.samples);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                in_progress.erase(index);
+                held_bytes -= reserved;
+                if (stopped) {
+                    return;
+                }
+                held_bytes += audio.samples.size() * sizeof(float);
+                ready.push_back(std::move(audio));
+            }
+            file_ready.notify_one();
+            // A finished file may let the oldest waiting decoder continue
+            space_available.notify_all();
+        }
+    }
+
+    // Decodes audio.path block by block, waiting for queue space between blocks.
+    // Returns false if the loader was cancelled; errors are reported in audio.error.
+    bool decode(LoadedAudio& audio, size_t& reserved) {
+        ma_decoder decoder;
+        ma_decoder_config decoder_config = ma_decoder_config_init(
+            ma_format_f32, static_cast<ma_uint32>(config.channels), static_cast<ma_uint32>(config.samplerate));
+        ma_result result = ma_decoder_init_file(audio.path.c_str(), &decoder_config, &decoder);
+        if (result != MA_SUCCESS) {
+            audio.error = "Could not open audio file '" + audio.path + "': " + ma_result_description(result);
+            return true;
+        }
+        DecoderGuard decoder_guard{&decoder};
+        audio.samplerate = static_cast<int>(decoder.outputSampleRate);
+        audio.channels = static_cast<int>(decoder.outputChannels);
+
+        size_t block_bytes = static_cast<size_t>(decode_block_frames) * audio.channels * sizeof(float);
+        for (;;) {
+            {
+                // Admit the next block if it fits the budget. The oldest file in
+                // progress may always continue while nothing is queued, so the
+                // loader makes progress even when single files exceed the budget.
+                std::unique_lock<std::mutex> lock(mutex);
+                space_available.wait(lock, [&] {
+                    return cancelled || held_bytes + block_bytes <= config.max_queued_bytes ||
+                           (ready.empty() && *in_progress.begin() == audio.index);
+                });
+                if (cancelled) {
+                    return false;
+                }
+                held_bytes += block_bytes;
+                reserved += block_bytes;
+            }
+
+            size_t offset = audio.samples.size();
+            audio.samples.resize(offset + static_cast<size_t>(decode_block_frames) * audio.channels);
+            ma_uint64 frames_read = 0;
+            result = ma_decoder_read_pcm_frames(&decoder, audio.samples.data() + offset, decode_block_frames, &frames_read);
+            audio.samples.resize(offset + static_cast<size_t>(frames_read) * audio.channels);
+
+            // Return the unused part of the block reservation
+            size_t unused = block_bytes - static_cast<size_t>(frames_read) * audio.channels * sizeof(float);
+            if (unused > 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                held_bytes -= unused;
+                reserved -= unused;
+            }
+            if (result == MA_AT_END || frames_read == 0) {
+                break;
+            }
+            if (result != MA_SUCCESS) {
+                audio.error = "Could not decode audio file '" + audio.path + "': " + ma_result_description(result);
+                break;
+            }
+        }
+        if (audio.ok() && audio.samples.empty()) {
+            audio.error = "No audio decoded from '" + audio.path + "'";
+        }
+        return true;
+    }
+};
+
+AudioLoader::AudioLoader(std::vector<std::string> paths, const LoaderConfig& config)
+    : pImpl(std::make_unique<Impl>(std::move(paths), config)) {
+}
+
+AudioLoader::~AudioLoader() = default;
+
+bool AudioLoader::next(LoadedAudio& audio) {
+    return pImpl->next(audio);
+}
+
+void AudioLoader::cancel() {
+    pImpl->cancel();
+}
+
+size_t AudioLoader::size() const {
+    return pImpl->paths.size();
+}
+
+size_t AudioLoader::queued_bytes() const {
+    std::lock_guard<std::mutex> lock(pImpl->mutex);
+    return pImpl->held_bytes;
+}
+
+} // namespace BeatThis
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstddef>
+
+namespace BeatThis {
+
+struct LoaderConfig {
+    int num_threads = 2;                      // Decode threads
+    size_t max_queued_files = 4;              // Files decoded ahead of the consumers (including ones in progress)
+    size_t max_queued_bytes = size_t(512) << 20; // Decoded samples held ahead of the consumers
+    // Output format miniaudio converts to while decoding (0 = the file's own).
+    // Keep the native format to get the same results as BeatThis::process_file().
+    int samplerate = 0;
+    int channels = 0;
+};
+
+// One decoded input of an AudioLoader
+struct LoadedAudio {
+    size_t index = 0;            // Position in the loader's path list
+    std::string path;
+    std::vector<float> samples;  // Interleaved [frames][channels]
+    int samplerate = 0;
+    int channels = 0;
+    std::string error;           // Set instead of samples if decoding failed
+
+    bool ok() const { return error.empty(); }
+};
+
+/**
+ * Decodes a list of audio files (WAV, MP3, FLAC) on background threads ahead
+ * of the analysis, so analyzers never wait for storage or the decoder.
+ *
+ * Decode threads take the files in list order and keep the decoded ones in a
+ * bounded queue. A thread starts a file only while fewer than
+ * max_queued_files files are queued or in progress. Memory is admitted per
+ * decoded block of 64k frames rather than per file, since the length of an
+ * MP3 is unknown until it has been scanned: before each block the thread
+ * waits until the block fits into max_queued_bytes next to the queued and
+ * in-progress samples. While no decoded file is queued, the oldest file in
+ * progress may always continue, so files larger than the budget still load.
+ *
+ * next() is thread-safe, so several analysis workers can pull from one
+ * loader. Files are delivered in the order their decoding finishes, which
+ * can differ from the list order; LoadedAudio::index identifies them.
+ * The destructor stops decoding and joins the threads.
+ */
+class AudioLoader {
+public:
+    explicit AudioLoader(std::vector<std::string> paths, const LoaderConfig& config = LoaderConfig());
+    ~AudioLoader();
+
+    AudioLoader(const AudioLoader&) = delete;
+    AudioLoader& operator=(const AudioLoader&) = delete;
+
+    // Waits for the next decoded file; returns false once every file has been
+    // delivered or after cancel(). Failed files are delivered with error set.
+    bool next(LoadedAudio& audio);
+
+    // Stops decoding; next() returns false from now on, also in waiting threads
+    void cancel();
+
+    // Number of files in the list
+    size_t size() const;
+
+    // Bytes of decoded samples currently queued or being decoded
+    size_t queued_bytes() const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> pImpl;
+};
+
+} // namespace BeatThis
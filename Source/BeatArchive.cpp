@@ -0,0 +1,685 @@
+#include "BeatArchive.h"
+#include "MappedFile.h"
+#include "ResultCache.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <stdexcept>
+#include <mutex>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+namespace BeatThis {
+
+namespace {
+    // Frame rate of beats without logits, the rate of the model output
+    constexpr float default_fps = 50.0f;
+
+    constexpr char beats_magic[4] = {'B', 'T', 'B', 'T'};
+    constexpr uint32_t beats_version = 1;
+    constexpr uint32_t flag_logits = 1;       // Logits (and maybe a spectrogram) follow the header
+    constexpr uint32_t flag_float_times = 2;  // Times are float32 instead of varint frame deltas
+
+    // Beats layout: header, then beat, downbeat and spectrogram floats if
+    // flag_logits, then the times, then one varint count per beat
+    struct BeatsHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t flags;
+        float fps;             // Frame rate of the frame indices and the logits
+        float bpm;
+        uint32_t num_beats;
+        uint32_t num_downbeats;
+        uint32_t num_bins;     // Spectrogram bins per frame (0 = no spectrogram)
+        uint64_t num_frames;   // Logits frames (0 without logits)
+    };
+    static_assert(sizeof(BeatsHeader) == 40, "BeatsHeader must not be padded");
+
+    // Archive layout: header, records, index, trailer. Records and the index
+    // start at multiples of 8, so the floats in a mapped archive are aligned.
+    constexpr char archive_magic[4] = {'B', 'T', 'B', 'A'};
+    constexpr char record_magic[4] = {'B', 'T', 'R', 'K'};
+    constexpr char index_magic[4] = {'B', 'T', 'I', 'X'};
+    constexpr uint32_t archive_version = 1;
+    constexpr uint32_t max_id_size = 1 << 16;
+
+    struct ArchiveHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t reserved;
+    };
+
+    // Followed by the ID and the encode_beats() payload, each padded to 8 bytes
+    struct RecordHeader {
+        char magic[4];
+        uint32_t id_size;
+        uint64_t payload_size;
+    };
+
+    // Sorted by hash, then by offset
+    struct IndexEntry {
+        uint64_t id_hash;
+        uint64_t offset;   // Of the RecordHeader
+    };
+
+    struct IndexTrailer {
+        uint64_t index_offset;
+        uint64_t num_entries;
+        char magic[4];
+        uint32_t version;
+    };
+    static_assert(sizeof(ArchiveHeader) == 16 && sizeof(RecordHeader) == 16 &&
+                  sizeof(IndexEntry) == 16 && sizeof(IndexTrailer) == 24, "Archive structs must not be padded");
+
+    uint64_t padded(uint64_t size) {
+        return (size + 7) & ~uint64_t(7);
+    }
+
+    uint64_t hash_id(std::string_view id) {
+        return ResultCache::hash_bytes(id.data(), id.size());
+    }
+
+    void put_varint(std::vector<char>& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    // Zigzag mapping so small negative deltas stay short as well
+    uint64_t zigzag(int64_t value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    int64_t unzigzag(uint64_t value) {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    template <typename T>
+    void put_array(std::vector<char>& out, const std::vector<T>& values) {
+        const char* bytes = reinterpret_cast<const char*>(values.data());
+        out.insert(out.end(), bytes, bytes + values.size() * sizeof(T));
+    }
+
+    // Frame index of every time, or false if a time does not map back exactly
+    bool to_frames(const std::vector<float>& times, float fps, std::vector<int64_t>& frames) {
+        frames.resize(times.size());
+        for (size_t i = 0; i < times.size(); ++i) {
+            double frame = std::nearbyint(static_cast<double>(times[i]) * fps);
+            if (!(std::abs(frame) < 9.0e15)) {
+                return false;
+            }
+            frames[i] = static_cast<int64_t>(frame);
+            if (static_cast<float>(frames[i]) / fps != times[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Bounds-checked reads from an encoded record
+    class ByteReader {
+    public:
+        ByteReader(const char* data, size_t size) : pos_(data), end_(data + size) {}
+
+        size_t remaining() const { return static_cast<size_t>(end_ - pos_); }
+
+        void read(void* out, size_t size) {
+            if (size > remaining()) {
+                throw std::runtime_error("Truncated or corrupt beats data");
+            }
+            if (size == 0) {
+                return;
+            }
+            std::memcpy(out, pos_, size);
+            pos_ += size;
+        }
+
+        template <typename T>
+        void read_array(std::vector<T>& values, uint64_t count) {
+            if (count > remaining() / sizeof(T)) {
+                throw std::runtime_error("Truncated or corrupt beats data");
+            }
+            values.resize(static_cast<size_t>(count));
+            read(values.data(), values.size() * sizeof(T));
+        }
+
+        uint64_t varint() {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                if (pos_ == end_) {
+                    break;
+                }
+                uint8_t byte = static_cast<uint8_t>(*pos_++);
+                value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) {
+                    return value;
+                }
+            }
+            throw std::runtime_error("Truncated or corrupt beats data");
+        }
+
+    private:
+        const char* pos_;
+        const char* end_;
+    };
+}
+
+std::vector<char> encode_beats(const BeatResult& result) {
+    if (result.beat_counts.size() != result.beats.size()) {
+        throw std::runtime_error("Inconsistent beat result: " + std::to_string(result.beats.size()) + " beats but " +
+                                 std::to_string(result.beat_counts.size()) + " beat counts");
+    }
+    const BeatLogits* logits = result.logits ? &*result.logits : nullptr;
+    if (logits && (logits->beat.size() != logits->downbeat.size() || logits->num_bins < 0 ||
+                   logits->spectrogram.size() != logits->beat.size() * static_cast<size_t>(logits->num_bins))) {
+        throw std::runtime_error("Inconsistent logits, not encoding beats");
+    }
+    float fps = logits ? logits->fps : default_fps;
+    if (!(fps > 0.0f)) {
+        throw std::runtime_error("Invalid logits frame rate: " + std::to_string(fps));
+    }
+
+    std::vector<int64_t> beat_frames;
+    std::vector<int64_t> downbeat_frames;
+    bool on_grid = to_frames(result.beats, fps, beat_frames) && to_frames(result.downbeats, fps, downbeat_frames);
+
+    BeatsHeader header;
+    std::memcpy(header.magic, beats_magic, sizeof(header.magic));
+    header.version = beats_version;
+    header.flags = (logits ? flag_logits : 0) | (on_grid ? 0 : flag_float_times);
+    header.fps = fps;
+    header.bpm = static_cast<float>(calculate_bpm(result));
+    header.num_beats = static_cast<uint32_t>(result.beats.size());
+    header.num_downbeats = static_cast<uint32_t>(result.downbeats.size());
+    header.num_bins = logits ? static_cast<uint32_t>(logits->num_bins) : 0;
+    header.num_frames = logits ? logits->beat.size() : 0;
+
+    std::vector<char> out(sizeof(header));
+    std::memcpy(out.data(), &header, sizeof(header));
+    if (logits) {
+        out.reserve(sizeof(header) + (logits->beat.size() * 2 + logits->spectrogram.size()) * sizeof(float) +
+                    result.beats.size() * 3);
+        put_array(out, logits->beat);
+        put_array(out, logits->downbeat);
+        put_array(out, logits->spectrogram);
+    }
+    if (on_grid) {
+        for (const auto* frames : {&beat_frames, &downbeat_frames}) {
+            int64_t previous = 0;
+            for (int64_t frame : *frames) {
+                put_varint(out, zigzag(frame - previous));
+                previous = frame;
+            }
+        }
+    } else {
+        put_array(out, result.beats);
+        put_array(out, result.downbeats);
+    }
+    for (int count : result.beat_counts) {
+        if (count < 0) {
+            throw std::runtime_error("Invalid beat count: " + std::to_string(count));
+        }
+        put_varint(out, static_cast<uint64_t>(count));
+    }
+    return out;
+}
+
+BeatRecord decode_beats(const void* data, size_t size) {
+    ByteReader in(static_cast<const char*>(data), size);
+    BeatsHeader header;
+    if (size < sizeof(header)) {
+        throw std::runtime_error("Not a beats file");
+    }
+    in.read(&header, sizeof(header));
+    if (std::memcmp(header.magic, beats_magic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Not a beats file");
+    }
+    if (header.version != beats_version) {
+        throw std::runtime_error("Unsupported beats file version " + std::to_string(header.version));
+    }
+    if (!(header.fps > 0.0f) || header.num_bins > 4096) {
+        throw std::runtime_error("Truncated or corrupt beats data");
+    }
+
+    BeatRecord record;
+    record.bpm = header.bpm;
+    BeatResult& result = record.result;
+    if (header.flags & flag_logits) {
+        BeatLogits& logits = result.logits.emplace();
+        logits.fps = header.fps;
+        logits.num_bins = static_cast<int>(header.num_bins);
+        in.read_array(logits.beat, header.num_frames);
+        in.read_array(logits.downbeat, header.num_frames);
+        if (header.num_bins > 0 && header.num_frames > in.remaining() / sizeof(float) / header.num_bins) {
+            throw std::runtime_error("Truncated or corrupt beats data");
+        }
+        in.read_array(logits.spectrogram, header.num_frames * header.num_bins);
+    }
+
+    if (header.flags & flag_float_times) {
+        in.read_array(result.beats, header.num_beats);
+        in.read_array(result.downbeats, header.num_downbeats);
+    } else {
+        // Every frame delta takes at least one byte, which bounds the allocations
+        if (static_cast<uint64_t>(header.num_beats) + header.num_downbeats > in.remaining()) {
+            throw std::runtime_error("Truncated or corrupt beats data");
+        }
+        for (auto [times, count] : {std::pair{&result.beats, header.num_beats},
+                                    std::pair{&result.downbeats, header.num_downbeats}}) {
+            times->resize(count);
+            int64_t frame = 0;
+            for (float& time : *times) {
+                frame += unzigzag(in.varint());
+                time = static_cast<float>(frame) / header.fps;
+            }
+        }
+    }
+
+    if (header.num_beats > in.remaining()) {
+        throw std::runtime_error("Truncated or corrupt beats data");
+    }
+    result.beat_counts.resize(header.num_beats);
+    for (int& count : result.beat_counts) {
+        uint64_t value = in.varint();
+        if (value > static_cast<uint64_t>(INT32_MAX)) {
+            throw std::runtime_error("Truncated or corrupt beats data");
+        }
+        count = static_cast<int>(value);
+    }
+    return record;
+}
+
+void save_beats(const BeatResult& result, const std::string& path) {
+    std::vector<char> data = encode_beats(result);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open beats file for writing: " + path);
+    }
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!file) {
+        throw std::runtime_error("Could not write beats file: " + path);
+    }
+}
+
+BeatRecord load_beats(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open beats file: " + path);
+    }
+    std::vector<char> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!file) {
+        throw std::runtime_error("Could not read beats file: " + path);
+    }
+    try {
+        return decode_beats(data.data(), data.size());
+    } catch (const std::exception& e) {
+        throw std::runtime_error(std::string(e.what()) + ": " + path);
+    }
+}
+
+class BeatArchiveWriter::Impl {
+public:
+    std::string path;
+    std::fstream file;
+    std::mutex mutex;
+    std::vector<IndexEntry> entries;
+    uint64_t end = 0;  // Where the next record goes
+    bool closed = false;
+
+    explicit Impl(const std::string& path_) : path(path_) {
+        std::error_code ec;
+        if (!std::filesystem::exists(path, ec) || std::filesystem::file_size(path, ec) == 0) {
+            std::ofstream create(path, std::ios::binary | std::ios::trunc);
+            ArchiveHeader header{};
+            std::memcpy(header.magic, archive_magic, sizeof(header.magic));
+            header.version = archive_version;
+            create.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            if (!create) {
+                throw std::runtime_error("Could not create beat archive: " + path);
+            }
+            end = sizeof(header);
+        } else {
+            open_existing();
+        }
+
+        file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+        if (!file.is_open()) {
+            throw std::runtime_error("Could not open beat archive for writing: " + path);
+        }
+    }
+
+    void add(std::string_view id, const BeatResult& result) {
+        if (id.size() > max_id_size) {
+            throw std::runtime_error("Track ID longer than " + std::to_string(max_id_size) + " bytes");
+        }
+
+        // Encode outside the lock, so workers only serialize on the write
+        std::vector<char> payload = encode_beats(result);
+        RecordHeader header;
+        std::memcpy(header.magic, record_magic, sizeof(header.magic));
+        header.id_size = static_cast<uint32_t>(id.size());
+        header.payload_size = payload.size();
+        uint64_t id_end = sizeof(header) + padded(id.size());
+        std::vector<char> record(static_cast<size_t>(id_end + padded(payload.size())), 0);
+        std::memcpy(record.data(), &header, sizeof(header));
+        std::memcpy(record.data() + sizeof(header), id.data(), id.size());
+        std::memcpy(record.data() + id_end, payload.data(), payload.size());
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed) {
+            throw std::runtime_error("Beat archive is closed: " + path);
+        }
+        file.seekp(static_cast<std::streamoff>(end));
+        file.write(record.data(), static_cast<std::streamsize>(record.size()));
+        if (!file) {
+            throw std::runtime_error("Could not write beat archive: " + path);
+        }
+        entries.push_back({hash_id(id), end});
+        end += record.size();
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed) {
+            return;
+        }
+        closed = true;
+
+        std::sort(entries.begin(), entries.end(), [](const IndexEntry& a, const IndexEntry& b) {
+            return a.id_hash != b.id_hash ? a.id_hash < b.id_hash : a.offset < b.offset;
+        });
+        drop_replaced();
+
+        IndexTrailer trailer;
+        trailer.index_offset = end;
+        trailer.num_entries = entries.size();
+        std::memcpy(trailer.magic, index_magic, sizeof(trailer.magic));
+        trailer.version = archive_version;
+
+        file.seekp(static_cast<std::streamoff>(end));
+        file.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(IndexEntry)));
+        file.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+        file.close();
+        if (!file) {
+            throw std::runtime_error("Could not write beat archive index: " + path);
+        }
+    }
+
+private:
+    // Reads the index of a closed archive, or rebuilds it from the records if
+    // the last writer did not close it, then cuts the file back to the records
+    void open_existing() {
+        std::ifstream in(path, std::ios::binary);
+        uint64_t file_size = std::filesystem::file_size(path);
+        ArchiveHeader header;
+        in.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!in || std::memcmp(header.magic, archive_magic, sizeof(header.magic)) != 0) {
+            throw std::runtime_error("Not a beat archive: " + path);
+        }
+        if (header.version != archive_version) {
+            throw std::runtime_error("Unsupported beat archive version " + std::to_string(header.version) + ": " + path);
+        }
+
+        IndexTrailer trailer{};
+        if (file_size >= sizeof(header) + sizeof(trailer)) {
+            in.seekg(static_cast<std::streamoff>(file_size - sizeof(trailer)));
+            in.read(reinterpret_cast<char*>(&trailer), sizeof(trailer));
+        }
+        bool indexed = in && std::memcmp(trailer.magic, index_magic, sizeof(trailer.magic)) == 0 &&
+                       trailer.version == archive_version && trailer.index_offset >= sizeof(header) &&
+                       trailer.num_entries <= file_size / sizeof(IndexEntry) &&
+                       trailer.index_offset + trailer.num_entries * sizeof(IndexEntry) + sizeof(trailer) == file_size;
+        if (indexed) {
+            entries.resize(static_cast<size_t>(trailer.num_entries));
+            in.seekg(static_cast<std::streamoff>(trailer.index_offset));
+            in.read(reinterpret_cast<char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(IndexEntry)));
+            if (!in) {
+                throw std::runtime_error("Could not read beat archive index: " + path);
+            }
+            end = trailer.index_offset;
+        } else {
+            in.clear();
+            end = sizeof(header);
+            for (;;) {
+                RecordHeader record;
+                std::string id;
+                in.seekg(static_cast<std::streamoff>(end));
+                in.read(reinterpret_cast<char*>(&record), sizeof(record));
+                if (!in || std::memcmp(record.magic, record_magic, sizeof(record.magic)) != 0 || record.id_size > max_id_size) {
+                    break;
+                }
+                uint64_t record_end = end + sizeof(record) + padded(record.id_size) + padded(record.payload_size);
+                if (record.payload_size > file_size || record_end > file_size) {
+                    break;
+                }
+                id.resize(record.id_size);
+                in.read(id.data(), static_cast<std::streamsize>(id.size()));
+                if (!in) {
+                    break;
+                }
+                entries.push_back({hash_id(id), end});
+                end = record_end;
+            }
+            std::cerr << "WARNING: Beat archive " << path << " was not closed; recovered " << entries.size()
+                      << " records" << std::endl;
+        }
+        in.close();
+        std::filesystem::resize_file(path, end);
+    }
+
+    // Keeps only the newest record of each ID. Entries are sorted by hash, so
+    // only runs of equal hashes need their IDs compared.
+    void drop_replaced() {
+        std::vector<IndexEntry> kept;
+        kept.reserve(entries.size());
+        for (size_t begin = 0; begin < entries.size();) {
+            size_t run_end = begin + 1;
+            while (run_end < entries.size() && entries[run_end].id_hash == entries[begin].id_hash) {
+                ++run_end;
+            }
+            if (run_end - begin == 1) {
+                kept.push_back(entries[begin]);
+            } else {
+                std::vector<std::string> ids;
+                for (size_t i = begin; i < run_end; ++i) {
+                    ids.push_back(read_id(entries[i].offset));
+                }
+                for (size_t i = begin; i < run_end; ++i) {
+                    bool replaced = std::find(ids.begin() + (i - begin) + 1, ids.end(), ids[i - begin]) != ids.end();
+                    if (!replaced) {
+                        kept.push_back(entries[i]);
+                    }
+                }
+            }
+            begin = run_end;
+        }
+        entries = std::move(kept);
+    }
+
+    std::string read_id(uint64_t offset) {
+        RecordHeader record;
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(reinterpret_cast<char*>(&record), sizeof(record));
+        std::string id(record.id_size, '\0');
+        file.read(id.data(), static_cast<std::streamsize>(id.size()));
+        if (!file) {
+            throw std::runtime_error("Could not read beat archive record: " + path);
+        }
+        return id;
+    }
+};
+
+BeatArchiveWriter::BeatArchiveWriter(const std::string& path)
+    : pImpl(std::make_unique<Impl>(path)) {
+}
+
+BeatArchiveWriter::~BeatArchiveWriter() {
+    try {
+        pImpl->close();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
+}
+
+void BeatArchiveWriter::add(std::string_view id, const BeatResult& result) {
+    pImpl->add(id, result);
+}
+
+void BeatArchiveWriter::close() {
+    pImpl->close();
+}
+
+class BeatArchiveReader::Impl {
+public:
+    std::shared_ptr<const MappedFile> file;
+    std::string name;  // For error messages
+    const char* bytes = nullptr;
+    uint64_t index_offset = 0;
+    size_t num_entries = 0;
+
+    explicit Impl(std::shared_ptr<const MappedFile> file_)
+        : file(std::move(file_)) {
+        if (!file) {
+            throw std::runtime_error("Beat archive file is null");
+        }
+        name = file->path();
+        bytes = static_cast<const char*>(file->data());
+        uint64_t size = file->size();
+
+        ArchiveHeader header;
+        IndexTrailer trailer;
+        if (size < sizeof(header) + sizeof(trailer)) {
+            throw std::runtime_error("Not a beat archive: " + name);
+        }
+        std::memcpy(&header, bytes, sizeof(header));
+        std::memcpy(&trailer, bytes + size - sizeof(trailer), sizeof(trailer));
+        if (std::memcmp(header.magic, archive_magic, sizeof(header.magic)) != 0) {
+            throw std::runtime_error("Not a beat archive: " + name);
+        }
+        if (header.version != archive_version) {
+            throw std::runtime_error("Unsupported beat archive version " + std::to_string(header.version) + ": " + name);
+        }
+        if (std::memcmp(trailer.magic, index_magic, sizeof(trailer.magic)) != 0 || trailer.version != archive_version ||
+            trailer.index_offset < sizeof(header) || trailer.index_offset % 8 != 0 ||
+            trailer.num_entries > size / sizeof(IndexEntry) ||
+            trailer.index_offset + trailer.num_entries * sizeof(IndexEntry) + sizeof(trailer) != size) {
+            throw std::runtime_error("Beat archive has no valid index (was its writer closed?): " + name);
+        }
+        index_offset = trailer.index_offset;
+        num_entries = static_cast<size_t>(trailer.num_entries);
+    }
+
+    IndexEntry entry(size_t index) const {
+        if (index >= num_entries) {
+            throw std::out_of_range("Beat archive index out of range: " + std::to_string(index));
+        }
+        IndexEntry entry;
+        std::memcpy(&entry, bytes + index_offset + index * sizeof(IndexEntry), sizeof(entry));
+        return entry;
+    }
+
+    // ID and payload of the record an index entry points to
+    std::pair<std::string_view, std::string_view> record(size_t index) const {
+        uint64_t offset = entry(index).offset;
+        RecordHeader header;
+        // Records start on 8-byte boundaries, so anything else is a corrupt offset
+        if (offset < sizeof(ArchiveHeader) || offset > index_offset - sizeof(header) || offset % 8 != 0) {
+            throw std::runtime_error("Corrupt beat archive index: " + name);
+        }
+        std::memcpy(&header, bytes + offset, sizeof(header));
+        uint64_t available = index_offset - offset - sizeof(header);
+        if (std::memcmp(header.magic, record_magic, sizeof(header.magic)) != 0 || padded(header.id_size) > available ||
+            header.payload_size > available - padded(header.id_size)) {
+            throw std::runtime_error("Corrupt beat archive record: " + name);
+        }
+        const char* id = bytes + offset + sizeof(header);
+        return {std::string_view(id, header.id_size),
+                std::string_view(id + padded(header.id_size), static_cast<size_t>(header.payload_size))};
+    }
+
+    // First index entry with the hash of id that stores id, or num_entries
+    size_t locate(std::string_view id) const {
+        uint64_t hash = hash_id(id);
+        size_t low = 0;
+        size_t high = num_entries;
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (entry(mid).id_hash < hash) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        for (size_t i = low; i < num_entries && entry(i).id_hash == hash; ++i) {
+            if (record(i).first == id) {
+                return i;
+            }
+        }
+        return num_entries;
+    }
+
+    BeatRecord read(size_t index) const {
+        auto [id, payload] = record(index);
+        BeatRecord result;
+        try {
+            result = decode_beats(payload.data(), payload.size());
+        } catch (const std::exception& e) {
+            throw std::runtime_error(std::string(e.what()) + " in track '" + std::string(id) + "' of " + name);
+        }
+        result.id = id;
+        return result;
+    }
+};
+
+namespace {
+    std::shared_ptr<const MappedFile> map_archive(const std::string& path) {
+        std::error_code ec;
+        if (!std::filesystem::is_regular_file(path, ec)) {
+            throw std::runtime_error("Beat archive not found: " + path);
+        }
+        return MappedFile::open(path);
+    }
+}
+
+BeatArchiveReader::BeatArchiveReader(const std::string& path)
+    : pImpl(std::make_unique<Impl>(map_archive(path))) {
+}
+
+BeatArchiveReader::BeatArchiveReader(std::shared_ptr<const MappedFile> file)
+    : pImpl(std::make_unique<Impl>(std::move(file))) {
+}
+
+BeatArchiveReader::~BeatArchiveReader() = default;
+
+size_t BeatArchiveReader::size() const {
+    return pImpl->num_entries;
+}
+
+std::string_view BeatArchiveReader::id(size_t index) const {
+    return pImpl->record(index).first;
+}
+
+BeatRecord BeatArchiveReader::read(size_t index) const {
+    return pImpl->read(index);
+}
+
+std::optional<BeatRecord> BeatArchiveReader::find(std::string_view id) const {
+    size_t index = pImpl->locate(id);
+    if (index == pImpl->num_entries) {
+        return std::nullopt;
+    }
+    return pImpl->read(index);
+}
+
+bool BeatArchiveReader::contains(std::string_view id) const {
+    return pImpl->locate(id) != pImpl->num_entries;
+}
+
+} // namespace BeatThis
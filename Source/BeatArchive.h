@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <optional>
+#include <cstddef>
+
+#include "beat_this_api.h"
+
+namespace BeatThis {
+
+class MappedFile;
+
+// One decoded beats file or archive track
+struct BeatRecord {
+    std::string id;      // Track ID (archives only)
+    BeatResult result;   // logits are set if they were stored
+    float bpm = 0.0f;    // calculate_bpm() of the beats, computed when they were stored
+};
+
+// Compact binary encoding of a BeatResult: a 40-byte header with the counts
+// and the BPM, the float32 logits and spectrogram if result.logits is set,
+// then the beat and downbeat frame indices as delta-encoded varints and the
+// beat counts as varints. Beats from the model sit on the 50 fps frame grid
+// and take about two bytes each; times off the grid are stored as float32
+// instead, so decoding always returns the exact values. Native byte order.
+std::vector<char> encode_beats(const BeatResult& result);
+
+// Throws std::runtime_error if data is not a valid encoding
+BeatRecord decode_beats(const void* data, size_t size);
+
+// Single-track files holding one encode_beats() blob (.btb)
+void save_beats(const BeatResult& result, const std::string& path);
+BeatRecord load_beats(const std::string& path);
+
+/**
+ * Appends many tracks to one archive file, each under a track ID.
+ *
+ * Tracks are written as encode_beats() records one after another; close()
+ * appends an index sorted by ID hash, which BeatArchiveReader memory-maps
+ * for random access. Opening an existing archive appends to it: the old
+ * index is dropped and rewritten with the new tracks on close(). An archive
+ * whose writer never got to close() has no index; opening it for appending
+ * again recovers every complete track. Adding an ID that is already stored
+ * replaces that track.
+ *
+ * add() is thread-safe, so batch workers can share one writer. Only one
+ * writer may have an archive open at a time.
+ */
+class BeatArchiveWriter {
+public:
+    // Creates the archive or opens it for appending; throws std::runtime_error on I/O or format errors
+    explicit BeatArchiveWriter(const std::string& path);
+    ~BeatArchiveWriter();  // Calls close(), reporting errors on std::cerr
+
+    BeatArchiveWriter(const BeatArchiveWriter&) = delete;
+    BeatArchiveWriter& operator=(const BeatArchiveWriter&) = delete;
+
+    // Stores the result, including result.logits if set
+    void add(std::string_view id, const BeatResult& result);
+
+    // Writes the index; later add() calls throw
+    void close();
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> pImpl;
+};
+
+/**
+ * Read-only view of a closed archive. The file is memory-mapped and only the
+ * records that are read are touched, so opening is cheap for any size and
+ * concurrent readers share the pages. All methods are thread-safe.
+ */
+class BeatArchiveReader {
+public:
+    // Both throw std::runtime_error if the file is not a closed archive
+    explicit BeatArchiveReader(const std::string& path);
+    explicit BeatArchiveReader(std::shared_ptr<const MappedFile> file);
+    ~BeatArchiveReader();
+
+    // Number of tracks
+    size_t size() const;
+
+    // Tracks in index order (sorted by ID hash, not by insertion)
+    std::string_view id(size_t index) const;
+    BeatRecord read(size_t index) const;
+
+    // Track by ID, via a binary search of the index
+    std::optional<BeatRecord> find(std::string_view id) const;
+    bool contains(std::string_view id) const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> pImpl;
+};
+
+} // namespace BeatThis
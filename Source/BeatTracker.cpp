@@ -0,0 +1,494 @@
+#include "BeatTracker.h"
+#include "MelSpectrogram.h"
+#include "InferenceProcessor.h"
+#include "Spectrogram.h"
+#include "Resampler.h"
+#include "PipelineOptions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace BeatThis {
+
+namespace {
+    constexpr long no_frame = std::numeric_limits<long>::max();
+
+    float frame_time(long frame) { return static_cast<float>(frame) / model_fps; }
+
+    // Running mean of a group of nearby peaks (streaming deduplicate_peaks)
+    struct PeakGroup {
+        bool active = false;
+        double mean = 0.0;
+        int count = 0;
+    };
+}
+
+class BeatTracker::Impl {
+public:
+    StreamingConfig config;
+    MelSpectrogram mel;
+    std::unique_ptr<InferenceProcessor> processor;
+    int n_fft;
+    int hop_length;
+    int n_mels;
+    int border_size;
+
+    // Input conversion (downmix + resampling to 22050 Hz mono)
+    std::unique_ptr<Resampler> resampler;
+    std::vector<float> resampled_buffer;
+
+    // Reflection-padded analysis signal; padded[0] is padded sample padded_base
+    bool started = false;
+    bool ended = false;
+    std::vector<float> head;          // Samples collected before the reflection prefix can be built
+    std::vector<float> padded;
+    long padded_base = 0;
+
+    // Ring buffer of Mel frames. Padded frame p (= frame + border_size) is stored
+    // at rows p % capacity and p % capacity + capacity, so any window of up to
+    // capacity frames is contiguous.
+    Spectrogram ring;
+    int capacity = 0;
+    long padded_frames = 0;           // Padded frames written (including zero borders)
+    long num_frames = 0;              // Real Mel frames computed
+    long frames_since_inference = 0;
+
+    // Logits of frames [logits_base, logits_base + beat_logits.size())
+    std::vector<float> beat_logits;
+    std::vector<float> downbeat_logits;
+    long logits_base = 0;
+    long finalized_end = 0;           // Logits of frames below this are final
+    std::vector<float> window_beat;
+    std::vector<float> window_downbeat;
+
+    // Peak picking and deduplication, with the analyzer's PostprocessOptions
+    int peak_half_kernel;             // Half width of the max filter
+    float threshold;
+    int dedup_width;                  // Peaks at most this many frames apart are merged
+    long peak_scan = 0;               // Peaks are decided for frames below this
+    PeakGroup beat_group;
+    PeakGroup downbeat_group;
+    std::deque<long> beat_frames;     // Deduplicated beats awaiting emission
+    std::deque<long> downbeat_frames; // Deduplicated downbeats awaiting snapping
+
+    // Emission
+    int counter = 1;
+    bool emitted_any_beat = false;
+    BeatResult pending;
+
+    Impl(BeatThis& analyzer, const StreamingConfig& config);
+    ~Impl();
+
+    void reset();
+    void push(const float* samples, size_t num_frames);
+    void append_samples(const float* samples, size_t count);
+    void compute_available_frames();
+    void write_ring_row(const float* row);
+    void run_inference();
+    void advance_peaks();
+    void feed_peak(PeakGroup& group, std::deque<long>& out, long frame);
+    void close_group(PeakGroup& group, std::deque<long>& out, bool force);
+    void emit_beats();
+    void finish();
+
+    bool is_peak(const std::vector<float>& logits, long frame) const;
+    float logit(const std::vector<float>& logits, long frame) const { return logits[frame - logits_base]; }
+};
+
+BeatTracker::Impl::Impl(BeatThis& analyzer, const StreamingConfig& config_)
+    : config(config_),
+      mel([&analyzer] {
+          MelSpectrogram::Options options;
+          options.fast_log = analyzer.get_config().fast_log;
+          return options;
+      }()),
+      processor(analyzer.create_inference_processor()),
+      peak_half_kernel(analyzer.get_config().postprocess.kernel_size / 2),
+      threshold(analyzer.get_config().postprocess.threshold),
+      dedup_width(analyzer.get_config().postprocess.dedup_width) {
+    int kernel_size = analyzer.get_config().postprocess.kernel_size;
+    if (kernel_size < 1 || kernel_size % 2 == 0) {
+        throw std::runtime_error("Postprocessor kernel size must be a positive odd number, got " +
+                                 std::to_string(kernel_size));
+    }
+    n_fft = mel.get_n_fft();
+    hop_length = mel.get_hop_length();
+    n_mels = mel.get_n_mels();
+    border_size = processor->get_border_size();
+
+    if (config.channels < 1 || config.samplerate <= 0) {
+        throw std::runtime_error("Invalid streaming config: bad input format");
+    }
+    if (config.window_frames > processor->get_chunk_size()) {
+        throw std::runtime_error("Invalid streaming config: window_frames exceeds the model chunk size of " +
+                                 std::to_string(processor->get_chunk_size()));
+    }
+    if (config.update_interval_frames < 1 || config.lookahead_frames < 0 || config.max_hold_frames < 0) {
+        throw std::runtime_error("Invalid streaming config: negative interval, lookahead or hold");
+    }
+    // Every frame must be interior to some window before it is finalized, including
+    // the final window, which also holds the end padding and the right border
+    if (config.window_frames < config.update_interval_frames + config.lookahead_frames + 3 * border_size + 2) {
+        throw std::runtime_error("Invalid streaming config: window_frames must be at least "
+                                 "update_interval_frames + lookahead_frames + " + std::to_string(3 * border_size + 2));
+    }
+
+    capacity = config.window_frames;
+    ring.resize(2 * capacity, n_mels);
+
+    if (config.samplerate != mel.get_sample_rate() || config.channels != 1) {
+        Resampler::Quality quality = config.resample_quality == ResampleQuality::Sinc ? Resampler::Quality::Sinc
+                                                                                      : Resampler::Quality::Linear;
+        resampler = std::make_unique<Resampler>(config.samplerate, mel.get_sample_rate(), config.channels, quality);
+    }
+
+    reset();
+}
+
+BeatTracker::Impl::~Impl() = default;
+
+void BeatTracker::Impl::reset() {
+    if (resampler) {
+        resampler->reset();
+    }
+    started = false;
+    ended = false;
+    head.clear();
+    padded.clear();
+    padded_base = 0;
+    padded_frames = 0;
+    num_frames = 0;
+    frames_since_inference = 0;
+    beat_logits.clear();
+    downbeat_logits.clear();
+    logits_base = 0;
+    finalized_end = 0;
+    peak_scan = 0;
+    beat_group = PeakGroup();
+    downbeat_group = PeakGroup();
+    beat_frames.clear();
+    downbeat_frames.clear();
+    counter = 1;
+    emitted_any_beat = false;
+    pending = BeatResult();
+
+    // Left zero border, like the first chunk of split_piece (start = -border_size)
+    std::vector<float> zeros(n_mels, 0.0f);
+    for (int i = 0; i < border_size; ++i) {
+        write_ring_row(zeros.data());
+    }
+}
+
+void BeatTracker::Impl::push(const float* samples, size_t frames) {
+    if (ended) {
+        throw std::runtime_error("BeatTracker: push_samples() called after flush(); call reset() first");
+    }
+
+    if (!resampler) {
+        append_samples(samples, frames);
+        return;
+    }
+
+    // The resampler keeps its filter state between calls
+    resampled_buffer.clear();
+    resampler->process(samples, frames, resampled_buffer);
+    append_samples(resampled_buffer.data(), resampled_buffer.size());
+}
+
+void BeatTracker::Impl::append_samples(const float* samples, size_t count) {
+    int pad_size = n_fft / 2;
+    if (!started) {
+        head.insert(head.end(), samples, samples + count);
+        if (head.size() < static_cast<size_t>(pad_size + 1)) {
+            return;
+        }
+        // Pre-padding (reflection), as in MelSpectrogram::compute
+        padded.clear();
+        for (int i = pad_size; i >= 1; --i) {
+            padded.push_back(head[i]);
+        }
+        padded.insert(padded.end(), head.begin(), head.end());
+        head.clear();
+        started = true;
+    } else {
+        padded.insert(padded.end(), samples, samples + count);
+    }
+    compute_available_frames();
+}
+
+void BeatTracker::Impl::compute_available_frames() {
+    std::vector<float> row(n_mels);
+    while (num_frames * hop_length + n_fft <= padded_base + static_cast<long>(padded.size())) {
+        mel.compute_frame(padded.data() + (num_frames * hop_length - padded_base), row.data());
+        write_ring_row(row.data());
+        ++num_frames;
+        if (++frames_since_inference >= config.update_interval_frames) {
+            run_inference();
+        }
+    }
+
+    // Drop consumed samples; at least n_fft - hop_length remain for the end reflection
+    long consumed = num_frames * hop_length - padded_base;
+    if (consumed >= 16 * n_fft) {
+        padded.erase(padded.begin(), padded.begin() + consumed);
+        padded_base += consumed;
+    }
+}
+
+void BeatTracker::Impl::write_ring_row(const float* row) {
+    int r = static_cast<int>(padded_frames % capacity);
+    std::memcpy(ring.row(r), row, n_mels * sizeof(float));
+    std::memcpy(ring.row(r + capacity), row, n_mels * sizeof(float));
+    ++padded_frames;
+}
+
+void BeatTracker::Impl::run_inference() {
+    frames_since_inference = 0;
+    long length = std::min<long>(capacity, padded_frames);
+    long p0 = padded_frames - length;
+    if (length <= 2 * border_size) {
+        return;
+    }
+
+    processor->run_chunk(ring.row(static_cast<int>(p0 % capacity)), static_cast<int>(length), n_mels,
+                        window_beat, window_downbeat);
+
+    // Window entry j is frame p0 + j - border_size; keep the interior only
+    long interior_begin = std::max(p0, finalized_end);
+    long interior_end = std::min(p0 + length - 2 * border_size, num_frames);
+    long needed = interior_end - logits_base;
+    if (needed > static_cast<long>(beat_logits.size())) {
+        beat_logits.resize(needed, -1000.0f);
+        downbeat_logits.resize(needed, -1000.0f);
+    }
+    for (long f = interior_begin; f < interior_end; ++f) {
+        long j = f - p0 + border_size;
+        beat_logits[f - logits_base] = window_beat[j];
+        downbeat_logits[f - logits_base] = window_downbeat[j];
+    }
+
+    if (ended) {
+        finalized_end = num_frames;
+    } else {
+        finalized_end = std::max(finalized_end, interior_end - config.lookahead_frames);
+    }
+
+    advance_peaks();
+    emit_beats();
+}
+
+bool BeatTracker::Impl::is_peak(const std::vector<float>& logits, long frame) const {
+    float value = logit(logits, frame);
+    if (!(value > threshold)) {
+        return false;
+    }
+    long first = std::max(0L, frame - peak_half_kernel);
+    long last = std::min(num_frames - 1, frame + peak_half_kernel);
+    for (long k = first; k <= last; ++k) {
+        if (logit(logits, k) > value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BeatTracker::Impl::feed_peak(PeakGroup& group, std::deque<long>& out, long frame) {
+    if (group.active && frame - group.mean <= dedup_width) {
+        group.count += 1;
+        group.mean += (static_cast<double>(frame) - group.mean) / group.count; // update mean
+        return;
+    }
+    if (group.active) {
+        out.push_back(static_cast<long>(std::round(group.mean)));
+    }
+    group.active = true;
+    group.mean = frame;
+    group.count = 1;
+}
+
+void BeatTracker::Impl::close_group(PeakGroup& group, std::deque<long>& out, bool force) {
+    // No later peak (>= peak_scan) can join a group whose mean is more than dedup_width behind
+    if (group.active && (force || peak_scan - group.mean > dedup_width)) {
+        out.push_back(static_cast<long>(std::round(group.mean)));
+        group.active = false;
+    }
+}
+
+void BeatTracker::Impl::advance_peaks() {
+    // A peak needs peak_half_kernel frames of final logits on both sides
+    long limit = ended ? finalized_end : finalized_end - peak_half_kernel;
+    for (; peak_scan < limit; ++peak_scan) {
+        if (is_peak(beat_logits, peak_scan)) {
+            feed_peak(beat_group, beat_frames, peak_scan);
+        }
+        if (is_peak(downbeat_logits, peak_scan)) {
+            feed_peak(downbeat_group, downbeat_frames, peak_scan);
+        }
+    }
+    close_group(beat_group, beat_frames, ended);
+    close_group(downbeat_group, downbeat_frames, ended);
+
+    // Keep the logits the max filter may still look back at
+    long keep_from = peak_scan - peak_half_kernel;
+    if (keep_from - logits_base >= 4096) {
+        long drop = keep_from - logits_base;
+        beat_logits.erase(beat_logits.begin(), beat_logits.begin() + drop);
+        downbeat_logits.erase(downbeat_logits.begin(), downbeat_logits.begin() + drop);
+        logits_base += drop;
+    }
+}
+
+void BeatTracker::Impl::emit_beats() {
+    // Beat and downbeat frames below `known` can no longer change
+    long known = no_frame;
+    if (!ended) {
+        known = peak_scan;
+        if (beat_group.active) {
+            known = std::min(known, static_cast<long>(std::floor(beat_group.mean)));
+        }
+        if (downbeat_group.active) {
+            known = std::min(known, static_cast<long>(std::floor(downbeat_group.mean)));
+        }
+    }
+
+    while (!beat_frames.empty()) {
+        long beat = beat_frames.front();
+        bool has_next = beat_frames.size() > 1;
+        long next = has_next ? beat_frames[1] : no_frame;
+
+        bool ready = ended || (has_next && next <= known) ||
+                     (!has_next && known != no_frame && known >= beat + config.max_hold_frames);
+        if (!ready) {
+            break;
+        }
+
+        // Move downbeats to the nearest beat; ties go to the earlier beat. Distances
+        // are compared in seconds, like Postprocessor, so rounding matches offline
+        long bound = has_next ? next : known;
+        float beat_time = frame_time(beat);
+        bool is_downbeat = false;
+        while (!downbeat_frames.empty()) {
+            long d = downbeat_frames.front();
+            float d_time = frame_time(d);
+            bool snaps_here = d <= beat || bound == no_frame ||
+                              std::abs(beat_time - d_time) <= std::abs(frame_time(bound) - d_time);
+            if (!snaps_here) {
+                break;
+            }
+            if (d >= known) {
+                break;
+            }
+            is_downbeat = true;
+            downbeat_frames.pop_front();
+        }
+
+        counter = is_downbeat ? 1 : counter + 1;
+        float time = beat_time;
+        pending.beats.push_back(time);
+        pending.beat_counts.push_back(counter);
+        if (is_downbeat) {
+            pending.downbeats.push_back(time);
+        }
+        emitted_any_beat = true;
+        beat_frames.pop_front();
+    }
+
+    // Without any beat there is nothing to move downbeats to
+    if (ended && !emitted_any_beat) {
+        for (long d : downbeat_frames) {
+            pending.downbeats.push_back(frame_time(d));
+        }
+        downbeat_frames.clear();
+    }
+}
+
+void BeatTracker::Impl::finish() {
+    if (ended) {
+        return;
+    }
+    if (resampler) {
+        // Samples held back by the resampler's look-ahead
+        resampled_buffer.clear();
+        resampler->flush(resampled_buffer);
+        append_samples(resampled_buffer.data(), resampled_buffer.size());
+    }
+    if (!started) {
+        // Too short for reflection padding; nothing to analyze
+        ended = true;
+        return;
+    }
+
+    // Post-padding (reflection), as in MelSpectrogram::compute
+    int pad_size = n_fft / 2;
+    size_t size = padded.size();
+    for (int i = 1; i <= pad_size; ++i) {
+        padded.push_back(padded[size - 1 - i]);
+    }
+    frames_since_inference = 0;
+    ended = true;
+    // Frames completed by the padding; inference is deferred to the final window
+    std::vector<float> row(n_mels);
+    while (num_frames * hop_length + n_fft <= padded_base + static_cast<long>(padded.size())) {
+        mel.compute_frame(padded.data() + (num_frames * hop_length - padded_base), row.data());
+        write_ring_row(row.data());
+        ++num_frames;
+    }
+
+    // Right zero border, like the last chunk of split_piece
+    std::vector<float> zeros(n_mels, 0.0f);
+    for (int i = 0; i < border_size; ++i) {
+        write_ring_row(zeros.data());
+    }
+    run_inference();
+}
+
+BeatTracker::BeatTracker(BeatThis& analyzer, const StreamingConfig& config)
+    : pImpl(std::make_unique<Impl>(analyzer, config)) {
+}
+
+BeatTracker::~BeatTracker() = default;
+BeatTracker::BeatTracker(BeatTracker&&) noexcept = default;
+BeatTracker& BeatTracker::operator=(BeatTracker&&) noexcept = default;
+
+void BeatTracker::push_samples(const float* samples, size_t num_frames) {
+    try {
+        pImpl->push(samples, num_frames);
+    } catch (const Ort::Exception& e) {
+        throw std::runtime_error("ONNX Runtime error: " + std::string(e.what()));
+    }
+}
+
+BeatResult BeatTracker::poll_beats() {
+    BeatResult result = std::move(pImpl->pending);
+    pImpl->pending = BeatResult();
+    return result;
+}
+
+void BeatTracker::flush() {
+    try {
+        pImpl->finish();
+    } catch (const Ort::Exception& e) {
+        throw std::runtime_error("ONNX Runtime error: " + std::string(e.what()));
+    }
+}
+
+void BeatTracker::reset() {
+    pImpl->reset();
+}
+
+double BeatTracker::max_latency_seconds() const {
+    const StreamingConfig& config = pImpl->config;
+    // Finalization (border + lookahead), inference cadence, peak decision,
+    // deduplication and waiting for the next beat, plus the STFT half window
+    long frames = config.update_interval_frames + pImpl->border_size + config.lookahead_frames +
+                  pImpl->peak_half_kernel + pImpl->dedup_width + 1 + config.max_hold_frames;
+    double frontend = static_cast<double>(pImpl->n_fft / 2 + pImpl->hop_length) / pImpl->mel.get_sample_rate();
+    return frames / model_fps + frontend;
+}
+
+} // namespace BeatThis
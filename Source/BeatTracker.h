@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+#include "beat_this_api.h"
+
+namespace BeatThis {
+
+struct StreamingConfig {
+    int samplerate = 22050;          // Sample rate of the pushed audio
+    int channels = 1;                // Channel count of the pushed (interleaved) audio
+    int window_frames = 1500;        // Model context per inference run (<= 1500 frames = 30 s)
+    int update_interval_frames = 25; // Run inference after this many new frames (0.5 s)
+    int lookahead_frames = 50;       // Future context a frame must have before it is finalized (1 s)
+    int max_hold_frames = 100;       // Longest a beat waits for its successor before being emitted (2 s)
+    ResampleQuality resample_quality = ResampleQuality::Linear; // Used when samplerate != 22050
+};
+
+/**
+ * Real-time beat tracker for live input.
+ *
+ * Audio is pushed in arbitrary block sizes; Mel frames are computed as hops
+ * arrive and kept in a ring buffer of window_frames frames. Every
+ * update_interval_frames new frames the model runs on the most recent window,
+ * and frames that have at least lookahead_frames of future context (plus the
+ * model border) are finalized. Beats are emitted once their downbeat status
+ * is known, i.e. when the next beat is final or after max_hold_frames.
+ *
+ * CPU cost is roughly window_frames / update_interval_frames model frames per
+ * input frame. Worst-case latency is reported by max_latency_seconds().
+ *
+ * push_samples() runs inference synchronously, so it should be called from a
+ * worker thread rather than the real-time audio callback. Not thread-safe.
+ *
+ * Beats before the first downbeat are counted from 2, like the offline API
+ * does when it cannot estimate the pickup measure.
+ *
+ * Peaks are picked with the analyzer's BeatThisConfig::postprocess settings.
+ */
+class BeatTracker {
+public:
+    // The analyzer provides the ONNX session and must outlive the tracker
+    explicit BeatTracker(BeatThis& analyzer, const StreamingConfig& config = StreamingConfig());
+    ~BeatTracker();
+
+    BeatTracker(BeatTracker&&) noexcept;
+    BeatTracker& operator=(BeatTracker&&) noexcept;
+    BeatTracker(const BeatTracker&) = delete;
+    BeatTracker& operator=(const BeatTracker&) = delete;
+
+    // Push interleaved audio; num_frames is the number of sample frames
+    void push_samples(const float* samples, size_t num_frames);
+
+    // Beats finalized since the previous call (times in seconds from stream start)
+    BeatResult poll_beats();
+
+    // End of stream: pad the signal like the offline API and finalize all beats
+    void flush();
+
+    // Discard all state and start a new stream
+    void reset();
+
+    // Upper bound on the delay between a beat occurring and poll_beats() returning it
+    double max_latency_seconds() const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> pImpl;
+};
+
+} // namespace BeatThis
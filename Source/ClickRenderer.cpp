@@ -0,0 +1,167 @@
+#include "ClickRenderer.h"
+#include "SimdKernels.h"
+
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <numbers>
+
+#include "miniaudio.h"
+
+namespace {
+    // Click shape (seconds)
+    constexpr double click_duration = 0.1;
+    constexpr double attack_time = 0.01;
+    constexpr double decay_time = 0.05;
+
+    // Frames rendered and handed to the encoder at a time
+    constexpr size_t block_frames = 4096;
+
+    struct EncoderGuard {
+        ma_encoder* encoder;
+        ~EncoderGuard() { ma_encoder_uninit(encoder); }
+    };
+}
+
+ClickRenderer::ClickRenderer(int sample_rate, int channels, float click_gain)
+    : sample_rate_(sample_rate), channels_(channels) {
+    if (sample_rate <= 0 || channels <= 0) {
+        throw std::runtime_error("Invalid click track format: " + std::to_string(sample_rate) + " Hz, " +
+                                 std::to_string(channels) + " channels");
+    }
+    downbeat_click_ = make_click(880.0, sample_rate, channels, click_gain);
+    beat_click_ = make_click(440.0, sample_rate, channels, click_gain);
+    click_frames_ = beat_click_.size() / static_cast<size_t>(channels);
+}
+
+// Sine with a linear attack and decay, copied into every channel
+std::vector<float> ClickRenderer::make_click(double frequency, int sample_rate, int channels, float gain) {
+    int num_samples = static_cast<int>(click_duration * sample_rate);
+    int attack_samples = static_cast<int>(attack_time * sample_rate);
+    int decay_samples = static_cast<int>(decay_time * sample_rate);
+
+    std::vector<float> click(static_cast<size_t>(num_samples) * channels);
+    for (int i = 0; i < num_samples; ++i) {
+        double t = static_cast<double>(i) / sample_rate;
+        double amplitude = 1.0;
+
+        // Attack phase
+        if (i < attack_samples) {
+            amplitude = static_cast<double>(i) / attack_samples;
+        }
+        // Decay phase
+        else if (i > num_samples - decay_samples) {
+            amplitude = static_cast<double>(num_samples - i) / decay_samples;
+        }
+
+        float sample = static_cast<float>(amplitude * std::sin(2.0 * std::numbers::pi * frequency * t)) * gain;
+        std::fill_n(click.begin() + static_cast<size_t>(i) * channels, channels, sample);
+    }
+    return click;
+}
+
+bool ClickRenderer::write_wav(const BeatThis::BeatResult& result, const std::string& path,
+                              const float* original, size_t original_frames, float original_gain) const {
+    if (result.beats.empty()) {
+        std::cerr << "Error: No beats to generate audio from." << std::endl;
+        return false;
+    }
+    if (!original) {
+        original_frames = 0;
+    }
+
+    // Long enough for the last click to decay, and at least as long as the original
+    double clicks_end = std::max(0.0, (result.beats.back() + click_duration + decay_time) * sample_rate_);
+    size_t total_frames = std::max(static_cast<size_t>(clicks_end), original_frames);
+
+    std::vector<Click> clicks;
+    clicks.reserve(result.beats.size());
+    for (size_t i = 0; i < result.beats.size(); ++i) {
+        bool downbeat = i < result.beat_counts.size() && result.beat_counts[i] == 1;
+        clicks.push_back({static_cast<int64_t>(result.beats[i] * sample_rate_), downbeat});
+    }
+    std::stable_sort(clicks.begin(), clicks.end(), [](const Click& a, const Click& b) { return a.start < b.start; });
+
+    // A click alone stays within [-1, 1]; only overlapping clicks or the
+    // original can push the mix past full scale and need the peak pass
+    bool may_clip = original_frames > 0;
+    for (size_t i = 1; i < clicks.size() && !may_clip; ++i) {
+        may_clip = clicks[i].start < clicks[i - 1].start + static_cast<int64_t>(click_frames_);
+    }
+
+    std::vector<float> block(block_frames * channels_);
+    float scale = 1.0f;
+    if (may_clip) {
+        float peak = 0.0f;
+        size_t first_click = 0;
+        for (size_t begin = 0; begin < total_frames; begin += block_frames) {
+            size_t frames = std::min(block_frames, total_frames - begin);
+            render_block(clicks, first_click, static_cast<int64_t>(begin), frames, original, original_frames, original_gain, block.data());
+            peak = std::max(peak, max_abs_kernel(block.data(), static_cast<int>(frames * channels_)));
+        }
+        if (peak > 1.0f) {
+            scale = 1.0f / peak;
+        }
+    }
+
+    ma_encoder encoder;
+    ma_encoder_config config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_f32,
+                                                      static_cast<ma_uint32>(channels_), static_cast<ma_uint32>(sample_rate_));
+    ma_result ma_status = ma_encoder_init_file(path.c_str(), &config, &encoder);
+    if (ma_status != MA_SUCCESS) {
+        std::cerr << "Error: Could not open WAV file for writing: " << ma_result_description(ma_status) << std::endl;
+        return false;
+    }
+    EncoderGuard encoder_guard{&encoder};
+
+    size_t first_click = 0;
+    for (size_t begin = 0; begin < total_frames; begin += block_frames) {
+        size_t frames = std::min(block_frames, total_frames - begin);
+        render_block(clicks, first_click, static_cast<int64_t>(begin), frames, original, original_frames, original_gain, block.data());
+        if (scale != 1.0f) {
+            scale_kernel(block.data(), block.data(), scale, static_cast<int>(frames * channels_));
+        }
+
+        ma_uint64 frames_written = 0;
+        ma_status = ma_encoder_write_pcm_frames(&encoder, block.data(), frames, &frames_written);
+        if (ma_status != MA_SUCCESS || frames_written != frames) {
+            std::cerr << "Error: Could not write all audio frames: " << ma_result_description(ma_status) << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void ClickRenderer::render_block(const std::vector<Click>& clicks, size_t& first_click, int64_t begin, size_t frames,
+                                 const float* original, size_t original_frames, float original_gain, float* block) const {
+    const size_t channels = static_cast<size_t>(channels_);
+
+    // The original under the clicks, silence after its end
+    size_t original_in_block = static_cast<size_t>(begin) < original_frames
+        ? std::min(frames, original_frames - static_cast<size_t>(begin)) : 0;
+    if (original_in_block > 0) {
+        scale_kernel(block, original + static_cast<size_t>(begin) * channels, original_gain,
+                     static_cast<int>(original_in_block * channels));
+    }
+    std::fill(block + original_in_block * channels, block + frames * channels, 0.0f);
+
+    // Clicks are sorted by start, so the ones reaching this block are contiguous
+    const int64_t click_frames = static_cast<int64_t>(click_frames_);
+    const int64_t end = begin + static_cast<int64_t>(frames);
+    while (first_click < clicks.size() && clicks[first_click].start + click_frames <= begin) {
+        ++first_click;
+    }
+    for (size_t c = first_click; c < clicks.size() && clicks[c].start < end; ++c) {
+        const Click& click = clicks[c];
+        int64_t from = std::max(click.start, begin);
+        int64_t to = std::min(click.start + click_frames, end);
+        if (from >= to) {
+            continue;
+        }
+        const float* waveform = click.downbeat ? downbeat_click_.data() : beat_click_.data();
+        add_kernel(block + static_cast<size_t>(from - begin) * channels,
+                   waveform + static_cast<size_t>(from - click.start) * channels,
+                   static_cast<int>(static_cast<size_t>(to - from) * channels));
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef CLICK_RENDERER_H
+#define CLICK_RENDERER_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#include "beat_this_api.h"
+
+/**
+ * @class ClickRenderer
+ * @brief Offline rendering of click tracks, alone or mixed over the analyzed audio
+ *
+ * The two click waveforms (880 Hz for downbeats, 440 Hz for other beats,
+ * 0.1 s with a linear attack and decay) are computed once per renderer,
+ * already scaled by the click gain and interleaved for the output channel
+ * count. Rendering then only adds templates into the output.
+ *
+ * The output is rendered and written to the WAV encoder in blocks, so memory
+ * does not grow with the length of the track. If the mix could clip, a first
+ * pass over the blocks finds its peak and the second pass scales the output
+ * down to full scale while writing it.
+ */
+class ClickRenderer {
+public:
+    /**
+     * @param sample_rate Output sample rate
+     * @param channels Output channel count; every channel gets the clicks
+     * @param click_gain Amplitude of the clicks
+     */
+    ClickRenderer(int sample_rate, int channels, float click_gain = 1.0f);
+
+    /**
+     * @brief Writes a float WAV file with the clicks of result
+     * @param original Interleaved audio at the output rate and channel count to
+     *                 mix under the clicks, or nullptr for the clicks alone
+     * @param original_frames Frames in original
+     * @param original_gain Amplitude of original in the mix
+     * @return False (with a message on std::cerr) if there are no beats or the file cannot be written
+     */
+    bool write_wav(const BeatThis::BeatResult& result, const std::string& path,
+                   const float* original = nullptr, size_t original_frames = 0, float original_gain = 1.0f) const;
+
+private:
+    struct Click {
+        int64_t start;   // First output frame
+        bool downbeat;
+    };
+
+    int sample_rate_;
+    int channels_;
+    size_t click_frames_;          // Frames per click
+    std::vector<float> downbeat_click_;  // Interleaved [click_frames_][channels_]
+    std::vector<float> beat_click_;
+
+    static std::vector<float> make_click(double frequency, int sample_rate, int channels, float gain);
+
+    // Renders output frames [begin, begin + frames) into block; first_click is
+    // the first click that may reach the block and is advanced past the ones that end before it
+    void render_block(const std::vector<Click>& clicks, size_t& first_click, int64_t begin, size_t frames,
+                      const float* original, size_t original_frames, float original_gain, float* block) const;
+};
+
+#endif // CLICK_RENDERER_H
@@ -0,0 +1,44 @@
+#ifndef DOWNMIX_H
+#define DOWNMIX_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Conversion of interleaved PCM to the mono float signal of the frontend
+ *
+ * Shared by the resampler and the Mel spectrogram, so caller buffers in any
+ * supported sample format are read in place by whichever stage consumes them
+ * first, without a float or mono copy of the whole signal.
+ */
+
+// Sample value scaled to [-1, 1)
+inline float pcm_to_float(float sample) { return sample; }
+inline float pcm_to_float(int16_t sample) { return static_cast<float>(sample) * (1.0f / 32768.0f); }
+inline float pcm_to_float(int32_t sample) { return static_cast<float>(sample) * (1.0f / 2147483648.0f); }
+
+// Averages the channels of interleaved frames into out
+template <typename Sample>
+inline void downmix_interleaved(const Sample* input, size_t num_frames, int channels, float* out) {
+    if (channels == 1) {
+        for (size_t i = 0; i < num_frames; ++i) {
+            out[i] = pcm_to_float(input[i]);
+        }
+        return;
+    }
+    if (channels == 2) {
+        for (size_t i = 0; i < num_frames; ++i) {
+            out[i] = (pcm_to_float(input[2 * i]) + pcm_to_float(input[2 * i + 1])) / 2.0f;
+        }
+        return;
+    }
+    for (size_t i = 0; i < num_frames; ++i) {
+        float sum = 0.0f;
+        for (int ch = 0; ch < channels; ++ch) {
+            sum += pcm_to_float(input[i * channels + ch]);
+        }
+        out[i] = sum / channels;
+    }
+}
+
+#endif // DOWNMIX_H
@@ -1,105 +1,327 @@
 #include "InferenceProcessor.h"
 #include <algorithm>
 #include <numeric>
+#include <cstring>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <array>
 
+namespace {
+    static_assert(sizeof(Ort::Float16_t) == sizeof(uint16_t), "Ort::Float16_t must be a plain 16-bit value");
 
-InferenceProcessor::InferenceProcessor(Ort::Session& session, Ort::Env& env)
-    : session_(session), env_(env) {}
+    // IEEE 754 binary32 -> binary16, round to nearest even
+    uint16_t float_to_half(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000u;
+        uint32_t abs = bits & 0x7FFFFFFFu;
 
-// Helper to run ONNX inference on a single chunk
-std::pair<std::vector<float>, std::vector<float>> InferenceProcessor::run_onnx_inference(
-    const std::vector<std::vector<float>>& chunk_spect
-) {
-    // Prepare ONNX Input Tensor
-    size_t input_tensor_size = chunk_spect.size() * chunk_spect[0].size();
-    std::vector<float> input_tensor_values(input_tensor_size);
-    // Flatten the spectrogram
-    for(size_t i=0; i < chunk_spect.size(); ++i) {
-        memcpy(input_tensor_values.data() + i * chunk_spect[0].size(), chunk_spect[i].data(), chunk_spect[0].size() * sizeof(float));
+        if (abs >= 0x7F800000u) {  // Inf or NaN
+            return static_cast<uint16_t>(sign | 0x7C00u | (abs > 0x7F800000u ? 0x200u : 0u));
+        }
+        if (abs >= 0x477FF000u) {  // Rounds to a value beyond the float16 range
+            return static_cast<uint16_t>(sign | 0x7C00u);
+        }
+        if (abs < 0x38800000u) {   // Subnormal float16 (or zero)
+            if (abs < 0x33000000u) {
+                return static_cast<uint16_t>(sign);
+            }
+            uint32_t mantissa = (abs & 0x007FFFFFu) | 0x00800000u;
+            int shift = 126 - static_cast<int>(abs >> 23);
+            uint32_t half = mantissa >> shift;
+            uint32_t rest = mantissa & ((1u << shift) - 1);
+            uint32_t halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (half & 1u))) {
+                ++half;
+            }
+            return static_cast<uint16_t>(sign | half);
+        }
+        uint32_t half = ((abs - 0x38000000u) >> 13);
+        uint32_t rest = abs & 0x1FFFu;
+        if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) {
+            ++half;  // May carry into the exponent, which is the correct rounding
+        }
+        return static_cast<uint16_t>(sign | half);
     }
-    
-    std::vector<int64_t> input_shape = {1, (int64_t)chunk_spect.size(), (int64_t)chunk_spect[0].size()};
 
-    Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-    Ort::Value input_tensor = Ort::Value::CreateTensor<float>(memory_info, input_tensor_values.data(), input_tensor_size, input_shape.data(), input_shape.size());
+    // IEEE 754 binary16 -> binary32 (exact)
+    float half_to_float(uint16_t half) {
+        uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+        uint32_t exponent = (half >> 10) & 0x1Fu;
+        uint32_t mantissa = half & 0x3FFu;
+        uint32_t bits;
+        if (exponent == 0x1Fu) {
+            bits = sign | 0x7F800000u | (mantissa << 13);
+        } else if (exponent != 0) {
+            bits = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+        } else if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Subnormal: normalize the mantissa
+            int e = -1;
+            do {
+                ++e;
+                mantissa <<= 1;
+            } while ((mantissa & 0x400u) == 0);
+            bits = sign | (static_cast<uint32_t>(112 - e) << 23) | ((mantissa & 0x3FFu) << 13);
+        }
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // Element type of a model input or output, checked against what the processor can convert
+    bool is_half_tensor(const Ort::TypeInfo& info, const char* what) {
+        ONNXTensorElementDataType type = info.GetTensorTypeAndShapeInfo().GetElementType();
+        if (type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16) {
+            return true;
+        }
+        if (type != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
+            throw std::runtime_error(std::string("Unsupported element type for model ") + what + ": " +
+                                     std::to_string(static_cast<int>(type)) + " (expected float or float16)");
+        }
+        return false;
+    }
+}
 
-    const char* input_names[] = {"input_spectrogram"};
-    const char* output_names[] = {"beat", "downbeat"};
-    
-    auto output_tensors = session_.Run(Ort::RunOptions{nullptr}, input_names, &input_tensor, 1, output_names, 2);
+InferenceProcessor::InferenceProcessor(Ort::Session& session, Ort::Env& env, int max_batch_size)
+    : session_(session), env_(env), max_batch_size_(std::max(1, max_batch_size)),
+      memory_info_(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)),
+      io_binding_(session) {
+    // Models exported without a dynamic batch axis only accept [1, T, 128]
+    if (max_batch_size_ > 1 && !supports_dynamic_batch()) {
+        max_batch_size_ = 1;
+    }
 
-    float* beat_output_data = output_tensors[0].GetTensorMutableData<float>();
-    float* downbeat_output_data = output_tensors[1].GetTensorMutableData<float>();
+    // INT8 models keep float I/O; FP16 models may use float16 at the boundary
+    half_input_ = is_half_tensor(session_.GetInputTypeInfo(0), "input");
+    bool half_beat = is_half_tensor(session_.GetOutputTypeInfo(0), "beat output");
+    bool half_downbeat = is_half_tensor(session_.GetOutputTypeInfo(1), "downbeat output");
+    if (half_beat != half_downbeat) {
+        throw std::runtime_error("Model beat and downbeat outputs must have the same element type");
+    }
+    half_output_ = half_beat;
 
-    auto beat_shape = output_tensors[0].GetTensorTypeAndShapeInfo().GetShape();
-    size_t beat_output_size = beat_shape[0] * beat_shape[1]; // Assuming batch_size=1
+    // Room for the largest run up front, so the buffers are allocated once
+    size_t max_outputs = static_cast<size_t>(max_batch_size_) * chunk_size;
+    if (half_output_) {
+        half_beat_values_.reserve(max_outputs);
+        half_downbeat_values_.reserve(max_outputs);
+    }
+    beat_output_values_.reserve(max_outputs);
+    downbeat_output_values_.reserve(max_outputs);
+}
 
-    std::vector<float> beat_logits(beat_output_data, beat_output_data + beat_output_size);
-    std::vector<float> downbeat_logits(downbeat_output_data, downbeat_output_data + beat_output_size);
+bool InferenceProcessor::supports_dynamic_batch() const {
+    auto input_shape = session_.GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+    return !input_shape.empty() && input_shape[0] < 0;
+}
 
+// Output tensors are views of the output buffers, so they only change with the output shape
+void InferenceProcessor::bind_outputs(size_t count, size_t num_frames) {
+    if (count == bound_count_ && num_frames == bound_frames_) {
+        return;
+    }
+    size_t output_size = count * num_frames;
+    std::array<int64_t, 2> output_shape = {(int64_t)count, (int64_t)num_frames};
 
-    return {beat_logits, downbeat_logits};
+    beat_output_values_.resize(output_size);
+    downbeat_output_values_.resize(output_size);
+    if (half_output_) {
+        half_beat_values_.resize(output_size);
+        half_downbeat_values_.resize(output_size);
+        beat_output_tensor_ = Ort::Value::CreateTensor<Ort::Float16_t>(
+            memory_info_, reinterpret_cast<Ort::Float16_t*>(half_beat_values_.data()), output_size,
+            output_shape.data(), output_shape.size());
+        downbeat_output_tensor_ = Ort::Value::CreateTensor<Ort::Float16_t>(
+            memory_info_, reinterpret_cast<Ort::Float16_t*>(half_downbeat_values_.data()), output_size,
+            output_shape.data(), output_shape.size());
+    } else {
+        beat_output_tensor_ = Ort::Value::CreateTensor<float>(
+            memory_info_, beat_output_values_.data(), output_size, output_shape.data(), output_shape.size());
+        downbeat_output_tensor_ = Ort::Value::CreateTensor<float>(
+            memory_info_, downbeat_output_values_.data(), output_size, output_shape.data(), output_shape.size());
+    }
+    io_binding_.BindOutput("beat", beat_output_tensor_);
+    io_binding_.BindOutput("downbeat", downbeat_output_tensor_);
+    bound_count_ = count;
+    bound_frames_ = num_frames;
 }
 
+// Helper to run the session on one [count, num_frames, num_bins] input tensor
+void InferenceProcessor::run_session(
+    const float* input_data,
+    size_t count,
+    size_t num_frames,
+    size_t num_bins
+) {
+    size_t input_tensor_size = count * num_frames * num_bins;
+    std::array<int64_t, 3> input_shape = {(int64_t)count, (int64_t)num_frames, (int64_t)num_bins};
 
-// Helper function: zeropad (from Python's inference.py)
-std::vector<std::vector<float>> zeropad(
-    const std::vector<std::vector<float>>& spect,
-    int left,
-    int right
+    Ort::Value input_tensor(nullptr);
+    if (half_input_) {
+        half_input_values_.resize(input_tensor_size);
+        for (size_t i = 0; i < input_tensor_size; ++i) {
+            half_input_values_[i] = float_to_half(input_data[i]);
+        }
+        input_tensor = Ort::Value::CreateTensor<Ort::Float16_t>(
+            memory_info_, reinterpret_cast<Ort::Float16_t*>(half_input_values_.data()), input_tensor_size,
+            input_shape.data(), input_shape.size());
+    } else {
+        // ONNX Runtime only reads from input tensors, so dropping const is safe here
+        input_tensor = Ort::Value::CreateTensor<float>(memory_info_, const_cast<float*>(input_data), input_tensor_size, input_shape.data(), input_shape.size());
+    }
+
+    // The input may point into a spectrogram, so it is rebound on every run
+    io_binding_.BindInput("input_spectrogram", input_tensor);
+    bind_outputs(count, num_frames);
+    session_.Run(Ort::RunOptions{nullptr}, io_binding_);
+    io_binding_.ClearBoundInputs();
+
+    if (half_output_) {
+        size_t output_size = count * num_frames;
+        for (size_t i = 0; i < output_size; ++i) {
+            beat_output_values_[i] = half_to_float(half_beat_values_[i]);
+            downbeat_output_values_[i] = half_to_float(half_downbeat_values_[i]);
+        }
+    }
+}
+
+// Run the model on one contiguous block of frames
+void InferenceProcessor::run_chunk(
+    const float* frames,
+    int num_frames,
+    int num_bins,
+    std::vector<float>& beat_logits,
+    std::vector<float>& downbeat_logits
 ) {
-    if (left == 0 && right == 0) {
-        return spect;
+    run_session(frames, 1, num_frames, num_bins);
+
+    beat_logits.assign(beat_output_values_.begin(), beat_output_values_.begin() + num_frames);
+    downbeat_logits.assign(downbeat_output_values_.begin(), downbeat_output_values_.begin() + num_frames);
+}
+
+// Helper to run ONNX inference on a batch of equally sized chunks
+void InferenceProcessor::run_batch(const ChunkRef* batch, size_t count) {
+    if (count > static_cast<size_t>(max_batch_size_)) {
+        throw std::runtime_error("Chunk batch of " + std::to_string(count) + " exceeds the maximum batch size of " +
+                                 std::to_string(max_batch_size_));
+    }
+
+    // Prepare ONNX Input Tensor
+    const ChunkRef& head = batch[0];
+    size_t num_frames = head.chunk.length;
+    size_t num_bins = head.spectrogram->num_bins();
+    size_t chunk_values = num_frames * num_bins;
+    size_t input_tensor_size = count * chunk_values;
+
+    const float* input_data = nullptr;
+    int head_frames = head.spectrogram->num_frames();
+    if (count == 1 && head.chunk.start >= 0 && head.chunk.start + head.chunk.length <= head_frames) {
+        // Chunk lies entirely inside the spectrogram: point the tensor straight at it
+        input_data = head.spectrogram->row(head.chunk.start);
     } else {
-        int original_rows = spect.size();
-        int original_cols = spect[0].size();
-        std::vector<std::vector<float>> padded_spect(original_rows + left + right, std::vector<float>(original_cols, 0.0f));
-        for (int i = 0; i < original_rows; ++i) {
-            for (int j = 0; j < original_cols; ++j) {
-                padded_spect[i + left][j] = spect[i][j];
+        // Stack the chunks, filling frames outside their spectrogram with zeros
+        input_tensor_values_.resize(input_tensor_size);
+        for (size_t b = 0; b < count; ++b) {
+            const Spectrogram& spect = *batch[b].spectrogram;
+            const Chunk& chunk = batch[b].chunk;
+            if (static_cast<size_t>(chunk.length) != num_frames || spect.num_bins() != num_bins) {
+                throw std::runtime_error("Chunks in one batch must have the same shape");
+            }
+            int len_spect = spect.num_frames();
+            float* dst = input_tensor_values_.data() + b * chunk_values;
+            for (int i = 0; i < chunk.length; ++i) {
+                int frame = chunk.start + i;
+                if (frame >= 0 && frame < len_spect) {
+                    memcpy(dst + i * num_bins, spect.row(frame), num_bins * sizeof(float));
+                } else {
+                    memset(dst + i * num_bins, 0, num_bins * sizeof(float));
+                }
             }
         }
-        return padded_spect;
+        input_data = input_tensor_values_.data();
     }
+
+    run_session(input_data, count, num_frames, num_bins);
 }
 
-// Helper function: split_piece (from Python's inference.py)
-std::vector<std::vector<std::vector<float>>> InferenceProcessor::split_piece(
-    const std::vector<std::vector<float>>& spect,
-    int chunk_size,
-    int border_size
+std::vector<InferenceProcessor::ChunkLogits> InferenceProcessor::run_chunk_batch(
+    const std::vector<ChunkRef>& batch
 ) {
-    std::vector<std::vector<std::vector<float>>> chunks;
-    std::vector<int> starts;
+    if (batch.empty()) {
+        return {};
+    }
+    run_batch(batch.data(), batch.size());
 
-    int len_spect = spect.size();
-    
-    // generate the start and end indices
-    for (int start = -border_size; start < len_spect - border_size; start += (chunk_size - 2 * border_size)) {
-        starts.push_back(start);
+    // Split the [count, frames] outputs back into per-chunk predictions
+    size_t num_frames = batch.front().chunk.length;
+    std::vector<ChunkLogits> pred_chunks;
+    pred_chunks.reserve(batch.size());
+    for (size_t b = 0; b < batch.size(); ++b) {
+        auto beat_row = beat_output_values_.begin() + b * num_frames;
+        auto downbeat_row = downbeat_output_values_.begin() + b * num_frames;
+        pred_chunks.emplace_back(
+            std::vector<float>(beat_row, beat_row + num_frames),
+            std::vector<float>(downbeat_row, downbeat_row + num_frames));
     }
 
-    // If avoid_short_end is true (which it is in Python), adjust the last start
-    if (len_spect > chunk_size - 2 * border_size) {
-        starts.back() = len_spect - (chunk_size - border_size);
+    return pred_chunks;
+}
+
+// Chunks arrive in plan order and their kept ranges end in increasing order, so
+// "keep_first" means writing only the frames past piece_end_ (the kept ranges
+// of the earlier chunks tile [0, piece_end_))
+void InferenceProcessor::keep_chunk_output(const Chunk& chunk, size_t row, size_t num_frames) {
+    // Same border cut as aggregate_prediction(), including chunks too short for borders
+    bool cut_borders = chunk.length >= 2 * border_size;
+    int first = std::max(chunk.start + (cut_borders ? border_size : 0), piece_end_);
+    int last = chunk.start + (cut_borders ? chunk.length - border_size : chunk.length);
+    if (last <= first) {
+        return;
+    }
+    if (piece_beat_.size() < static_cast<size_t>(last)) {
+        piece_beat_.resize(last, -1000.0f);
+        piece_downbeat_.resize(last, -1000.0f);
     }
+    size_t offset = row * num_frames + (first - chunk.start);
+    std::copy_n(beat_output_values_.begin() + offset, last - first, piece_beat_.begin() + first);
+    std::copy_n(downbeat_output_values_.begin() + offset, last - first, piece_downbeat_.begin() + first);
+    piece_end_ = last;
+}
 
-    // generate the chunks
-    for (int start : starts) {
-        int actual_start = std::max(0, start);
-        int actual_end = std::min(start + chunk_size, len_spect);
-        
-        std::vector<std::vector<float>> current_chunk;
-        if (actual_end > actual_start) {
-            current_chunk.assign(spect.begin() + actual_start, spect.begin() + actual_end);
+// Helper function: split_piece (from Python's inference.py)
+// Returns views into the spectrogram instead of copies; the zero padding that
+// Python's zeropad() adds is applied when the chunk is turned into a tensor.
+template <typename Chunks>
+void InferenceProcessor::split_piece(
+    int len_spect,
+    int chunk_size,
+    int border_size,
+    Chunks& chunks
+) {
+    int step = chunk_size - 2 * border_size;
+
+    // generate the start indices; the count is known, so no temporary list is needed
+    int num_starts = len_spect > 0 ? (len_spect - 1) / step + 1 : 0;
+    chunks.clear();
+    chunks.reserve(num_starts);
+    for (int i = 0; i < num_starts; ++i) {
+        int start = -border_size + i * step;
+
+        // If avoid_short_end is true (which it is in Python), adjust the last start
+        if (i == num_starts - 1 && len_spect > step) {
+            start = len_spect - (chunk_size - border_size);
         }
 
+        int actual_start = std::max(0, start);
+        int actual_end = std::min(start + chunk_size, len_spect);
         int left_pad = std::max(0, -start);
         int right_pad = std::max(0, std::min(border_size, start + chunk_size - len_spect));
         
-        chunks.push_back(zeropad(current_chunk, left_pad, right_pad));
+        chunks.push_back({start, std::max(0, actual_end - actual_start) + left_pad + right_pad});
     }
-    return chunks;
 }
 
 // Helper function: aggregate_prediction (from Python's inference.py)
@@ -149,26 +371,192 @@ std::pair<std::vector<float>, std::vector<float>> InferenceProcessor::aggregate_
 
 // Main processing method
 std::pair<std::vector<float>, std::vector<float>> InferenceProcessor::process_spectrogram(
-    const std::vector<std::vector<float>>& spectrogram
+    const Spectrogram& spectrogram
 ) {
-    std::vector<std::vector<std::vector<float>>> chunks = split_piece(spectrogram, chunk_size, border_size);
+    begin_spectrogram();
+    return finish_spectrogram(spectrogram);
+}
 
-    std::vector<std::pair<std::vector<float>, std::vector<float>>> pred_chunks;
+std::vector<InferenceProcessor::Chunk> InferenceProcessor::plan_chunks(const Spectrogram& spectrogram) {
+    std::vector<Chunk> chunks;
+    split_piece(static_cast<int>(spectrogram.num_frames()), chunk_size, border_size, chunks);
+    return chunks;
+}
+
+InferenceProcessor::ChunkLogits InferenceProcessor::run_planned_chunk(
+    const Spectrogram& spectrogram,
+    const Chunk& chunk
+) {
+    return std::move(run_chunk_batch({{&spectrogram, chunk}}).front());
+}
+
+std::pair<std::vector<float>, std::vector<float>> InferenceProcessor::aggregate_chunks(
+    const std::vector<ChunkLogits>& chunk_logits,
+    const std::vector<Chunk>& chunks,
+    int full_size
+) {
     std::vector<int> starts;
+    starts.reserve(chunks.size());
+    for (const auto& chunk : chunks) {
+        starts.push_back(chunk.start);
+    }
+    return aggregate_prediction(chunk_logits, starts, full_size, chunk_size, border_size);
+}
+
+void InferenceProcessor::begin_spectrogram() {
+    piece_beat_.clear();
+    piece_downbeat_.clear();
+    piece_end_ = 0;
+    leading_chunks_ = 0;
+    run_timings_.clear();
+}
+
+// Runs the next leading chunk of a spectrogram that is still growing
+void InferenceProcessor::run_leading_chunk(const float* frames, int num_bins) {
+    auto run_start = std::chrono::steady_clock::now();
+    run_session(frames, 1, chunk_size, num_bins);
+    keep_chunk_output({leading_chunk_start(leading_chunks_), chunk_size}, 0, chunk_size);
+    std::chrono::duration<double> run_time = std::chrono::steady_clock::now() - run_start;
+    run_timings_.push_back({leading_chunks_, 1, chunk_size, run_time.count()});
+    ++leading_chunks_;
+}
+
+// Runs the chunks not covered by run_leading_chunk() and returns the piece logits
+std::pair<std::vector<float>, std::vector<float>> InferenceProcessor::finish_spectrogram(
+    const Spectrogram& spectrogram
+) {
+    std::pair<std::vector<float>, std::vector<float>> piece;
+    finish_spectrogram(spectrogram, piece.first, piece.second);
+    return piece;
+}
 
-    // Re-calculate starts for aggregation, as split_piece doesn't return them directly
-    // This is a simplified re-calculation based on the Python logic
-    int len_spect = spectrogram.size();
-    for (int start = -border_size; start < len_spect - border_size; start += (chunk_size - 2 * border_size)) {
-        starts.push_back(start);
+void InferenceProcessor::finish_spectrogram(
+    const Spectrogram& spectrogram,
+    std::vector<float>& beat_logits,
+    std::vector<float>& downbeat_logits
+) {
+    scratch_.reset();
+    ScratchVector<Chunk> chunks{ArenaAllocator<Chunk>(scratch_)};
+    split_piece(static_cast<int>(spectrogram.num_frames()), chunk_size, border_size, chunks);
+
+    // The final chunk depends on the total length, so it is never a leading chunk
+    if (leading_chunks_ > 0 && static_cast<size_t>(leading_chunks_) >= chunks.size()) {
+        throw std::runtime_error("More leading chunks than the spectrogram has: " +
+                                 std::to_string(leading_chunks_) + " of " + std::to_string(chunks.size()));
     }
-    if (len_spect > chunk_size - 2 * border_size) {
-        starts.back() = len_spect - (chunk_size - border_size);
+
+    int full_size = spectrogram.num_frames();
+    piece_beat_.reserve(full_size);
+    piece_downbeat_.reserve(full_size);
+
+    run_chunks(spectrogram, 0, chunks.data(), leading_chunks_, chunks.size());
+
+    // Frames no chunk keeps stay at -1000, as in aggregate_prediction()
+    piece_beat_.resize(full_size, -1000.0f);
+    piece_downbeat_.resize(full_size, -1000.0f);
+
+    // Hand the logits over and keep the caller's old storage for the next piece
+    beat_logits.swap(piece_beat_);
+    downbeat_logits.swap(piece_downbeat_);
+    piece_beat_.clear();
+    piece_downbeat_.clear();
+    piece_end_ = 0;
+    leading_chunks_ = 0;
+}
+
+// Stacks consecutive chunks of equal length into batches of up to max_batch_size_
+void InferenceProcessor::run_chunks(const Spectrogram& spectrogram, int first_frame, const Chunk* chunks,
+                                    size_t first, size_t last) {
+    ChunkRef* batch = scratch_.allocate_array<ChunkRef>(max_batch_size_);
+    while (first < last) {
+        size_t count = 1;
+        while (count < static_cast<size_t>(max_batch_size_) && first + count < last
+               && chunks[first + count].length == chunks[first].length) {
+            ++count;
+        }
+        auto run_start = std::chrono::steady_clock::now();
+        for (size_t b = 0; b < count; ++b) {
+            batch[b] = {&spectrogram, {chunks[first + b].start - first_frame, chunks[first + b].length}};
+        }
+        run_batch(batch, count);
+        for (size_t b = 0; b < count; ++b) {
+            keep_chunk_output(chunks[first + b], b, chunks[first].length);
+        }
+        std::chrono::duration<double> run_time = std::chrono::steady_clock::now() - run_start;
+        run_timings_.push_back({(int)first, (int)count, chunks[first].length, run_time.count()});
+        first += count;
     }
+}
 
-    for (const auto& chunk : chunks) {
-        pred_chunks.push_back(run_onnx_inference(chunk));
+InferenceProcessor::ChunkSpan InferenceProcessor::chunks_reading(int num_frames, int first_frame, int last_frame) {
+    scratch_.reset();
+    ScratchVector<Chunk> chunks{ArenaAllocator<Chunk>(scratch_)};
+    split_piece(num_frames, chunk_size, border_size, chunks);
+
+    // Chunk starts increase, so the chunks reading the range are consecutive
+    ChunkSpan span{0, 0, 0, 0};
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        int read_first = std::max(0, chunks[i].start);
+        int read_last = std::min(num_frames, chunks[i].start + chunks[i].length);
+        if (read_first >= last_frame || read_last <= first_frame || read_last <= read_first) {
+            continue;
+        }
+        if (span.last_chunk == 0) {
+            span = {static_cast<int>(i), static_cast<int>(i), read_first, read_last};
+        }
+        span.last_chunk = static_cast<int>(i) + 1;
+        span.first_frame = std::min(span.first_frame, read_first);
+        span.last_frame = std::max(span.last_frame, read_last);
     }
+    return span;
+}
 
-    return aggregate_prediction(pred_chunks, starts, spectrogram.size(), chunk_size, border_size);
-}
\ No newline at end of file
+std::pair<int, int> InferenceProcessor::rerun_chunks(
+    const Spectrogram& frames,
+    const ChunkSpan& span,
+    int num_frames,
+    std::vector<float>& beat_logits,
+    std::vector<float>& downbeat_logits
+) {
+    run_timings_.clear();
+    if (span.last_chunk <= span.first_chunk) {
+        return {0, 0};
+    }
+    if (beat_logits.size() != static_cast<size_t>(num_frames) || downbeat_logits.size() != static_cast<size_t>(num_frames)) {
+        throw std::runtime_error("Logits of " + std::to_string(beat_logits.size()) + " frames do not match a piece of " +
+                                 std::to_string(num_frames) + " frames");
+    }
+    if (frames.num_frames() != static_cast<size_t>(span.last_frame - span.first_frame)) {
+        throw std::runtime_error("Spectrogram window of " + std::to_string(frames.num_frames()) +
+                                 " frames does not match the chunks it is run for");
+    }
+
+    scratch_.reset();
+    ScratchVector<Chunk> chunks{ArenaAllocator<Chunk>(scratch_)};
+    split_piece(num_frames, chunk_size, border_size, chunks);
+
+    // Work on the caller's logits; earlier chunks keep their frames ("keep_first")
+    piece_beat_.swap(beat_logits);
+    piece_downbeat_.swap(downbeat_logits);
+    piece_end_ = 0;
+    if (span.first_chunk > 0) {
+        const Chunk& previous = chunks[span.first_chunk - 1];
+        piece_end_ = previous.start + (previous.length >= 2 * border_size ? previous.length - border_size : previous.length);
+    }
+    int first_kept = piece_end_;
+    try {
+        run_chunks(frames, span.first_frame, chunks.data(), span.first_chunk, span.last_chunk);
+    } catch (...) {
+        piece_beat_.swap(beat_logits);
+        piece_downbeat_.swap(downbeat_logits);
+        throw;
+    }
+    std::pair<int, int> rewritten{std::max(0, first_kept), std::min(num_frames, piece_end_)};
+
+    piece_beat_.swap(beat_logits);
+    piece_downbeat_.swap(downbeat_logits);
+    piece_beat_.clear();
+    piece_downbeat_.clear();
+    piece_end_ = 0;
+    return rewritten;
+}
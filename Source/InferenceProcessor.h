@@ -3,7 +3,10 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
 #include "onnxruntime_cxx_api.h"
+#include "Spectrogram.h"
+#include "ScratchArena.h"
 
 /**
  * @class InferenceProcessor
@@ -12,10 +15,26 @@
  * This class processes Mel spectrograms through a trained ONNX model to detect
  * beats and downbeats. It handles chunking of long audio sequences and
  * aggregates predictions from overlapping chunks.
+ *
+ * Each run binds its input and the preallocated output buffers with an
+ * Ort::IoBinding, so ONNX Runtime writes the logits straight into memory the
+ * processor owns (on GPU providers: one host-to-device copy of the input and
+ * one device-to-host copy of the outputs per batch). process_spectrogram()
+ * copies the kept frames of each run directly into the final logits.
+ *
+ * FP32, FP16 and INT8-quantized models are supported. Models whose input or
+ * outputs are float16 (FP16 exports without keep_io_types) are converted at
+ * the tensor boundary, so callers always see float spectrograms and logits.
  */
 class InferenceProcessor {
 public:
-    InferenceProcessor(Ort::Session& session, Ort::Env& env);
+    /**
+     * @param session ONNX Runtime session holding the Beat This! model
+     * @param env ONNX Runtime environment the session was created with
+     * @param max_batch_size Maximum number of chunks stacked into one
+     *        session run. Clamped to 1 if the model has a fixed batch axis.
+     */
+    InferenceProcessor(Ort::Session& session, Ort::Env& env, int max_batch_size = 1);
 
     /**
      * @brief Process a full spectrogram and return beat/downbeat logits
@@ -23,23 +42,198 @@ public:
      * @return Pair of vectors containing beat and downbeat logits
      */
     std::pair<std::vector<float>, std::vector<float>> process_spectrogram(
-        const std::vector<std::vector<float>>& spectrogram
+        const Spectrogram& spectrogram
+    );
+
+    // A chunk is a view of frames [start, start + length) of the spectrogram.
+    // Frames outside the spectrogram are treated as zero padding.
+    struct Chunk {
+        int start;   // First frame of the chunk (negative for left padding)
+        int length;  // Number of frames including zero padding
+    };
+
+    using ChunkLogits = std::pair<std::vector<float>, std::vector<float>>;
+
+    /**
+     * @brief Chunk-level access for schedulers that run each chunk as its own task
+     *
+     * plan_chunks() returns the chunks process_spectrogram() would run,
+     * run_planned_chunk() runs one of them, and aggregate_chunks() merges the
+     * logits of all of them (in plan order). The three steps together give the
+     * same result as process_spectrogram(). run_planned_chunk() only reads the
+     * spectrogram, so different processors may run chunks of one spectrogram
+     * concurrently.
+     */
+    std::vector<Chunk> plan_chunks(const Spectrogram& spectrogram);
+
+    // A planned chunk of some spectrogram, for batches that mix pieces
+    struct ChunkRef {
+        const Spectrogram* spectrogram;
+        Chunk chunk;
+    };
+
+    /**
+     * @brief Runs equally long chunks, possibly of different spectrograms, as one batch
+     * @param batch At most get_max_batch_size() chunks, all of the same length
+     * @return Logits of each chunk, in batch order
+     */
+    std::vector<ChunkLogits> run_chunk_batch(const std::vector<ChunkRef>& batch);
+
+    ChunkLogits run_planned_chunk(const Spectrogram& spectrogram, const Chunk& chunk);
+    std::pair<std::vector<float>, std::vector<float>> aggregate_chunks(
+        const std::vector<ChunkLogits>& chunk_logits,
+        const std::vector<Chunk>& chunks,
+        int full_size
+    );
+
+    /**
+     * @brief Incremental chunking for a spectrogram that is still being computed
+     *
+     * Every chunk except the last starts at leading_chunk_start(index) and
+     * covers chunk_size frames (the first one with border_size frames of zero
+     * padding), no matter how long the spectrogram ends up. Once frames
+     * [0, leading_chunk_end(index)) are final, chunk index can be run with
+     * run_leading_chunk() while later frames are still being produced.
+     * finish_spectrogram() then runs the remaining chunks and returns the same
+     * logits as process_spectrogram(). begin_spectrogram() starts a new piece.
+     */
+    void begin_spectrogram();
+    int leading_chunk_start(int index) const { return index * (chunk_size - 2 * border_size) - border_size; }
+    int leading_chunk_end(int index) const { return leading_chunk_start(index) + chunk_size; }
+
+    /**
+     * @param frames Row-major input [chunk_size][num_bins] of the next leading
+     *        chunk, including its zero padding
+     * @param num_bins Number of Mel bins per frame
+     */
+    void run_leading_chunk(const float* frames, int num_bins);
+
+    std::pair<std::vector<float>, std::vector<float>> finish_spectrogram(
+        const Spectrogram& spectrogram
+    );
+
+    /**
+     * @brief finish_spectrogram() into caller-owned vectors
+     *
+     * The logits are swapped into beat_logits and downbeat_logits, and their
+     * previous storage is kept for the next piece. Callers that keep the two
+     * vectors across calls thus reuse the same two allocations every time.
+     */
+    void finish_spectrogram(
+        const Spectrogram& spectrogram,
+        std::vector<float>& beat_logits,
+        std::vector<float>& downbeat_logits
+    );
+
+    /**
+     * @brief Re-running part of a piece after some of its frames changed
+     *
+     * chunks_reading() returns the planned chunks of a piece of num_frames
+     * frames that read frames [first_frame, last_frame), and the frames those
+     * chunks read. rerun_chunks() runs them on `frames`, which holds exactly
+     * these frames of the changed spectrogram, and overwrites the logit
+     * frames they keep in the logits of the whole piece. The logits are then
+     * the same as process_spectrogram() on the changed spectrogram.
+     */
+    struct ChunkSpan {
+        int first_chunk;  // Chunks [first_chunk, last_chunk) of plan_chunks()
+        int last_chunk;
+        int first_frame;  // Frames [first_frame, last_frame) they read
+        int last_frame;
+    };
+    ChunkSpan chunks_reading(int num_frames, int first_frame, int last_frame);
+
+    // Returns the range of logit frames that was rewritten
+    std::pair<int, int> rerun_chunks(
+        const Spectrogram& frames,
+        const ChunkSpan& span,
+        int num_frames,
+        std::vector<float>& beat_logits,
+        std::vector<float>& downbeat_logits
+    );
+
+    /**
+     * @brief Run the model on one contiguous block of frames (no chunking)
+     * @param frames Row-major input [num_frames][num_bins]
+     * @param num_frames Number of frames in the block
+     * @param num_bins Number of Mel bins per frame
+     * @param beat_logits Resized to num_frames and filled with beat logits
+     * @param downbeat_logits Resized to num_frames and filled with downbeat logits
+     */
+    void run_chunk(
+        const float* frames,
+        int num_frames,
+        int num_bins,
+        std::vector<float>& beat_logits,
+        std::vector<float>& downbeat_logits
     );
 
+    // Timing of one session run inside process_spectrogram()
+    struct RunTiming {
+        int first_chunk;  // Index of the first chunk in the run
+        int chunks;       // Chunks stacked into the run
+        int frames;       // Frames per chunk
+        double seconds;   // Wall time of the run, including input packing
+    };
+
+    // Session runs of the most recent process_spectrogram() call, in order
+    const std::vector<RunTiming>& get_last_run_timings() const { return run_timings_; }
+
+    // Bytes held by the reusable model input, output, conversion and scratch buffers
+    size_t get_buffer_bytes() const {
+        return input_tensor_values_.capacity() * sizeof(float) + half_input_values_.capacity() * sizeof(uint16_t)
+            + (beat_output_values_.capacity() + downbeat_output_values_.capacity()) * sizeof(float)
+            + (half_beat_values_.capacity() + half_downbeat_values_.capacity()) * sizeof(uint16_t)
+            + (piece_beat_.capacity() + piece_downbeat_.capacity()) * sizeof(float) + scratch_.capacity();
+    }
+
+    // True if the model takes a float16 spectrogram or returns float16 logits
+    bool has_half_precision_io() const { return half_input_ || half_output_; }
+
+    // Chunks per session run after clamping to what the model supports
+    int get_max_batch_size() const { return max_batch_size_; }
+
+    int get_chunk_size() const { return chunk_size; }
+    int get_border_size() const { return border_size; }
+
 private:
     Ort::Session& session_;
     Ort::Env& env_;
+    int max_batch_size_;              // Chunks per session run (1 = unbatched)
+    Ort::MemoryInfo memory_info_;     // CPU memory info shared by all input tensors
+    std::vector<float> input_tensor_values_; // Scratch input buffer reused across runs
+    bool half_input_ = false;         // Model input is float16
+    bool half_output_ = false;        // Model outputs are float16
+    std::vector<uint16_t> half_input_values_;   // float16 copy of the input (half_input_ only)
+    std::vector<float> beat_output_values_;     // [count, frames] logits of the last run
+    std::vector<float> downbeat_output_values_;
+    std::vector<uint16_t> half_beat_values_;    // Bound float16 outputs (half_output_ only)
+    std::vector<uint16_t> half_downbeat_values_;
+    Ort::IoBinding io_binding_;       // Input and outputs of the session runs
+    Ort::Value beat_output_tensor_{nullptr}; // Bound output tensors over the output buffers
+    Ort::Value downbeat_output_tensor_{nullptr};
+    size_t bound_count_ = 0;          // Output shape the tensors were created for
+    size_t bound_frames_ = 0;
+    std::vector<RunTiming> run_timings_;     // Filled by process_spectrogram()
+    std::vector<float> piece_beat_;   // Logits of the current piece, filled in plan order
+    std::vector<float> piece_downbeat_;
+    int piece_end_ = 0;               // Frames [0, piece_end_) of the piece logits are final
+    int leading_chunks_ = 0;          // Chunks run by run_leading_chunk()
+    ScratchArena scratch_;            // Chunk plans and batches of one finish_spectrogram() call
 
     // Chunking parameters (must match Python implementation)
     const int chunk_size = 1500;      // Size of each chunk in frames
     const int border_size = 6;        // Border size for overlap handling
     // overlap_mode is "keep_first" in Python, processed in reverse order
 
-    // Helper functions for chunking and aggregation
-    std::vector<std::vector<std::vector<float>>> split_piece(
-        const std::vector<std::vector<float>>& spect,
+    // Helper functions for chunking and aggregation; split_piece() appends to
+    // any vector of chunks (std::vector, ScratchVector)
+    template <typename Chunks>
+    void split_piece(
+        int len_spect,
         int chunk_size,
-        int border_size
+        int border_size,
+        Chunks& chunks
     );
 
     std::pair<std::vector<float>, std::vector<float>> aggregate_prediction(
@@ -50,10 +244,32 @@ private:
         int border_size
     );
 
-    // Helper to run ONNX inference on a single chunk
-    std::pair<std::vector<float>, std::vector<float>> run_onnx_inference(
-        const std::vector<std::vector<float>>& chunk_spect
+    // Runs chunks [first, last) of a plan in batches and keeps their outputs;
+    // frame f of the piece is row f - first_frame of spectrogram
+    void run_chunks(const Spectrogram& spectrogram, int first_frame, const Chunk* chunks, size_t first, size_t last);
+
+    // Stacks the chunks into one [count, frames, mel_bins] tensor and runs it;
+    // the logits are left in the output buffers
+    void run_batch(const ChunkRef* batch, size_t count);
+
+    // Runs the session on the [count, num_frames, num_bins] tensor at input_data
+    // and leaves the [count, num_frames] logits in the output buffers
+    void run_session(
+        const float* input_data,
+        size_t count,
+        size_t num_frames,
+        size_t num_bins
     );
+
+    // (Re)creates and binds the output tensors for a [count, num_frames] output
+    void bind_outputs(size_t count, size_t num_frames);
+
+    // Copies the frames of `chunk` (row `row` of the last run's outputs) that no
+    // earlier chunk keeps into the piece logits
+    void keep_chunk_output(const Chunk& chunk, size_t row, size_t num_frames);
+
+    // True if the model's input has a dynamic batch axis
+    bool supports_dynamic_batch() const;
 };
 
 #endif // INFERENCE_PROCESSOR_H
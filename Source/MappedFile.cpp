@@ -0,0 +1,90 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace BeatThis {
+
+std::shared_ptr<const MappedFile> MappedFile::open(const std::string& path) {
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    file->path_ = path;
+
+#ifdef _WIN32
+    std::filesystem::path file_path(std::u8string(path.begin(), path.end()));
+    HANDLE handle = CreateFileW(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Cannot open file: " + path);
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(handle, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(handle);
+        throw std::runtime_error("Cannot map empty or unreadable file: " + path);
+    }
+    // The mapping object keeps the file open after its handle is closed
+    HANDLE mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(handle);
+    if (!mapping) {
+        throw std::runtime_error("Cannot map file: " + path);
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        throw std::runtime_error("Cannot map file: " + path);
+    }
+    file->mapping_handle_ = mapping;
+    file->data_ = view;
+    file->size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        int open_error = errno;
+        throw std::runtime_error("Cannot open file: " + path + " (" + std::strerror(open_error) + ")");
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("Cannot map empty or unreadable file: " + path);
+    }
+    // A shared read-only mapping is backed by the page cache, so every process
+    // mapping the file uses the same physical pages
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    int map_error = errno;
+    close(fd);
+    if (view == MAP_FAILED) {
+        throw std::runtime_error("Cannot map file: " + path + " (" + std::strerror(map_error) + ")");
+    }
+    file->data_ = view;
+    file->size_ = static_cast<size_t>(st.st_size);
+#endif
+
+    return file;
+}
+
+MappedFile::~MappedFile() {
+    if (!data_) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_handle_);
+#else
+    munmap(data_, size_);
+#endif
+}
+
+} // namespace BeatThis
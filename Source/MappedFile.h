@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstddef>
+
+namespace BeatThis {
+
+/**
+ * Read-only memory mapping of a whole file. The mapping is shared and backed
+ * by the page cache, so every process mapping the same file uses one copy of
+ * its bytes. Used for model files (ModelData) and beat archives.
+ */
+class MappedFile {
+public:
+    // Throws std::runtime_error if the file cannot be opened, is empty or cannot be mapped
+    static std::shared_ptr<const MappedFile> open(const std::string& path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const void* data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::string& path() const { return path_; }
+
+private:
+    MappedFile() = default;
+
+    void* data_ = nullptr;
+    size_t size_ = 0;
+    std::string path_;
+    void* mapping_handle_ = nullptr;  // File mapping object (Windows only)
+};
+
+} // namespace BeatThis
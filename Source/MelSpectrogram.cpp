@@ -5,11 +5,74 @@
 #include <numeric>
 #include <algorithm>
 #include <numbers>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <exception>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
 #include "pocketfft_hdronly.h"
+#include "SimdKernels.h"
+#include "Downmix.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+    // Computes out[k] = |spectrum[k]| * scale for n complex bins
+    void magnitude_kernel(const std::complex<float>* spectrum, float* out, int n, float scale) {
+        const float* src = reinterpret_cast<const float*>(spectrum);
+        int k = 0;
+#if defined(__AVX2__)
+        const __m256 vscale = _mm256_set1_ps(scale);
+        for (; k + 8 <= n; k += 8) {
+            __m256 a = _mm256_loadu_ps(src + 2 * k);       // c0..c3 interleaved
+            __m256 b = _mm256_loadu_ps(src + 2 * k + 8);   // c4..c7 interleaved
+            // hadd yields |c|^2 in order 0 1 4 5 | 2 3 6 7; restore 0..7
+            __m256 sq = _mm256_hadd_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+            sq = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sq), _MM_SHUFFLE(3, 1, 2, 0)));
+            _mm256_storeu_ps(out + k, _mm256_mul_ps(_mm256_sqrt_ps(sq), vscale));
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
+        const __m128 vscale = _mm_set1_ps(scale);
+        for (; k + 4 <= n; k += 4) {
+            __m128 a = _mm_loadu_ps(src + 2 * k);          // r0 i0 r1 i1
+            __m128 b = _mm_loadu_ps(src + 2 * k + 4);      // r2 i2 r3 i3
+            __m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            __m128 sq = _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im));
+            _mm_storeu_ps(out + k, _mm_mul_ps(_mm_sqrt_ps(sq), vscale));
+        }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+        const float32x4_t vscale = vdupq_n_f32(scale);
+        for (; k + 4 <= n; k += 4) {
+            float32x4x2_t c = vld2q_f32(src + 2 * k);      // De-interleave re / im
+            float32x4_t sq = vaddq_f32(vmulq_f32(c.val[0], c.val[0]), vmulq_f32(c.val[1], c.val[1]));
+            vst1q_f32(out + k, vmulq_f32(vsqrtq_f32(sq), vscale));
+        }
+#endif
+        for (; k < n; ++k) {
+            float re = src[2 * k];
+            float im = src[2 * k + 1];
+            out[k] = std::sqrt(re * re + im * im) * scale;
+        }
+    }
+}
 
 // Constructor
-MelSpectrogram::MelSpectrogram() {
+MelSpectrogram::MelSpectrogram() : MelSpectrogram(Options()) {}
+
+MelSpectrogram::MelSpectrogram(const Options& options) : options(options) {
     create_mel_filterbank();
+    create_mel_bands();
+    window = create_hann_window(win_length);
+    workers.push_back(create_worker());
 }
 
 // Destructor
@@ -118,81 +181,418 @@ void MelSpectrogram::create_mel_filterbank() {
     }
 }
 
-std::vector<std::vector<float>> MelSpectrogram::compute(const std::vector<float>& audio) {
-    // Apply padding similar to torchaudio.stft(center=True, pad_mode="reflect")
-    int pad_size = n_fft / 2;
-    std::vector<float> padded_audio;
-    padded_audio.reserve(audio.size() + 2 * pad_size);
+// Helper function: Extract the nonzero span of each mel filter as float weights
+void MelSpectrogram::create_mel_bands() {
+    int n_freqs = n_fft / 2 + 1;
+    mel_bands.assign(n_mels, MelBand{0, 0, 0});
+    mel_band_weights.clear();
+
+    for (int m = 0; m < n_mels; ++m) {
+        int first = n_freqs;
+        int last = -1;
+        for (int k = 0; k < n_freqs; ++k) {
+            if (mel_filterbank[k][m] != 0.0) {
+                first = std::min(first, k);
+                last = k;
+            }
+        }
 
-    // Pre-padding (reflection)
-    for (int i = pad_size; i >= 1; --i) {
-        padded_audio.push_back(audio[i]);
+        MelBand& band = mel_bands[m];
+        band.offset = static_cast<int>(mel_band_weights.size());
+        if (last >= first) {
+            band.start_bin = first;
+            band.length = last - first + 1;
+            for (int k = first; k <= last; ++k) {
+                mel_band_weights.push_back(static_cast<float>(mel_filterbank[k][m]));
+            }
+        }
     }
+}
 
-    // Original audio
-    padded_audio.insert(padded_audio.end(), audio.begin(), audio.end());
+// Helper function: Allocate the FFT plan and scratch buffers of one worker
+MelSpectrogram::FrameWorker MelSpectrogram::create_worker() const {
+    FrameWorker worker;
+    worker.plan = std::make_unique<pocketfft::pocketfft_r<float>>(n_fft);
+    worker.in_pocket.resize(n_fft);
+    worker.out_pocket.resize(n_fft / 2 + 1);
+    worker.amplitude_spectrum.resize(n_fft / 2 + 1);
+    worker.magnitude_spectrum.resize(n_fft / 2 + 1);
+    worker.reference_row.resize(n_mels);
+    return worker;
+}
 
-    // Post-padding (reflection)
-    for (int i = 1; i <= pad_size; ++i) {
-        padded_audio.push_back(audio[audio.size() - 1 - i]);
+// Banded single-precision mel projection of one frame
+void MelSpectrogram::apply_banded_filterbank(FrameWorker& worker, float* mel_row, int frame) {
+    int n_freqs = n_fft / 2 + 1;
+    float normalization_factor = 1.0f / std::sqrt(static_cast<float>(win_length));
+    std::vector<float>& magnitude_spectrum = worker.magnitude_spectrum;
+    magnitude_kernel(worker.out_pocket.data(), magnitude_spectrum.data(), n_freqs, normalization_factor);
+
+    bool capture = options.capture_debug && frame >= 0;
+    if (capture) {
+        std::vector<double>& power_row = last_power_spectrum[frame];
+        for (int k = 0; k < n_freqs; ++k) {
+            power_row[k] = magnitude_spectrum[k];
+        }
+    }
+
+    for (int m = 0; m < n_mels; ++m) {
+        const MelBand& band = mel_bands[m];
+        float mel_energy = dot_kernel(magnitude_spectrum.data() + band.start_bin,
+                                      mel_band_weights.data() + band.offset, band.length);
+        if (capture) {
+            log1p_input_cpp[frame][m] = log_multiplier * mel_energy;
+        }
+        mel_row[m] = log_multiplier * std::max(mel_energy, static_cast<float>(amin));
     }
+    if (options.fast_log) {
+        log1p_kernel(mel_row, n_mels);
+    } else {
+        for (int m = 0; m < n_mels; ++m) {
+            mel_row[m] = std::log1p(mel_row[m]);
+        }
+    }
+}
 
-    std::vector<float> window = create_hann_window(win_length);
+// Dense double-precision mel projection of one frame (reference path)
+void MelSpectrogram::apply_reference_filterbank(FrameWorker& worker, float* mel_row, int frame) {
+    const std::complex<float>* spectrum = worker.out_pocket.data();
+    std::vector<double>& amplitude_spectrum = worker.amplitude_spectrum;
+
+    // Compute amplitude spectrum and apply normalization
+    double normalization_factor = std::sqrt(static_cast<double>(win_length));
+    for (int j = 0; j < n_fft / 2 + 1; ++j) {
+        double real = spectrum[j].real();
+        double imag = spectrum[j].imag();
+        amplitude_spectrum[j] = std::sqrt(real * real + imag * imag) / normalization_factor;
+    }
+    
+    // Store the computed spectrum for this frame
+    bool capture = options.capture_debug && frame >= 0;
+    if (capture) {
+        last_power_spectrum[frame] = amplitude_spectrum;
+    }
+
+    // Apply Mel filterbank and log scaling
+    for (int m = 0; m < n_mels; ++m) {
+        double mel_energy = 0.0;
+        for (int k = 0; k < n_fft / 2 + 1; ++k) {
+            mel_energy += amplitude_spectrum[k] * mel_filterbank[k][m];
+        }
+        if (capture) {
+            log1p_input_cpp[frame][m] = log_multiplier * mel_energy;
+        }
+        mel_row[m] = std::log1p(log_multiplier * std::max(mel_energy, amin));
+    }
+}
+
+Spectrogram MelSpectrogram::compute(const std::vector<float>& audio) {
+    Spectrogram output;
+    compute(audio, output);
+    return output;
+}
+
+void MelSpectrogram::compute(const std::vector<float>& audio, Spectrogram& mel_spectrogram_output) {
+    compute(audio.data(), audio.size(), mel_spectrogram_output);
+}
+
+void MelSpectrogram::compute(const float* audio, size_t num_samples, Spectrogram& mel_spectrogram_output) {
+    compute_interleaved(audio, num_samples, 1, mel_spectrogram_output);
+}
+
+void MelSpectrogram::compute(const float* audio, size_t num_frames, int channels, Spectrogram& output) {
+    compute_interleaved(audio, num_frames, channels, output);
+}
+
+void MelSpectrogram::compute(const int16_t* audio, size_t num_frames, int channels, Spectrogram& output) {
+    compute_interleaved(audio, num_frames, channels, output);
+}
+
+void MelSpectrogram::compute(const int32_t* audio, size_t num_frames, int channels, Spectrogram& output) {
+    compute_interleaved(audio, num_frames, channels, output);
+}
+
+template <typename Sample>
+void MelSpectrogram::compute_interleaved(const Sample* audio, size_t num_samples, int channels,
+                                         Spectrogram& mel_spectrogram_output) {
+    // Apply padding similar to torchaudio.stft(center=True, pad_mode="reflect")
+    size_t pad_size = n_fft / 2;
+    if (num_samples <= pad_size) {
+        // Too short for reflection padding
+        mel_spectrogram_output.resize(0, n_mels);
+        return;
+    }
+    padded_audio.resize(num_samples + 2 * pad_size);
+
+    // Original audio, downmixed into place
+    float* signal = padded_audio.data() + pad_size;
+    downmix_interleaved(audio, num_samples, channels, signal);
+
+    // Pre- and post-padding (reflection)
+    for (size_t i = 1; i <= pad_size; ++i) {
+        signal[-static_cast<ptrdiff_t>(i)] = signal[i];
+        signal[num_samples - 1 + i] = signal[num_samples - 1 - i];
+    }
 
     // Calculate number of frames based on padded audio
     int num_frames = (padded_audio.size() - n_fft) / hop_length + 1;
-    if (num_frames <= 0) {
-        return std::vector<std::vector<float>>();
+    mel_spectrogram_output.resize(num_frames, n_mels);
+    compute_frame_range(padded_audio.data(), 0, num_frames, mel_spectrogram_output);
+}
+
+int MelSpectrogram::num_frames(size_t num_samples) const {
+    size_t pad_size = n_fft / 2;
+    if (num_samples <= pad_size) {
+        return 0;
     }
+    return static_cast<int>((num_samples + 2 * pad_size - n_fft) / hop_length + 1);
+}
 
-    std::vector<std::vector<float>> mel_spectrogram_output(num_frames, std::vector<float>(n_mels));
-    log1p_input_cpp.resize(num_frames, std::vector<double>(n_mels));
-    last_power_spectrum.resize(num_frames, std::vector<double>(n_fft / 2 + 1));
+// Frame f covers samples [f * hop_length - pad_size, f * hop_length - pad_size + n_fft)
+// of the signal; positions outside it reflect at sample 0 and sample num_samples - 1
+std::pair<int, int> MelSpectrogram::changed_frames(size_t first_sample, size_t last_sample, size_t num_samples) const {
+    int total = num_frames(num_samples);
+    if (first_sample >= last_sample || total == 0) {
+        return {0, 0};
+    }
+    size_t pad_size = n_fft / 2;
+    int first = 0;
+    if (first_sample > pad_size) {
+        // Samples 1..pad_size also appear in the pre-padding, which frame 0 reads
+        first = static_cast<int>((first_sample + 1 - pad_size + hop_length - 1) / hop_length);
+    }
+    int last = total;
+    if (last_sample + pad_size < num_samples) {
+        // Samples that close to the end appear in the post-padding, which the last frame reads
+        last = std::min(total, static_cast<int>((last_sample + pad_size - 1) / hop_length + 1));
+    }
+    return {std::min(first, last), last};
+}
 
-    // PocketFFT setup
-    std::vector<std::complex<float>> out_pocket(n_fft / 2 + 1);
-    std::vector<float> in_pocket(n_fft);
-    pocketfft::shape_t shape = { (size_t)n_fft };
-    pocketfft::stride_t stride_in = { sizeof(float) };
-    pocketfft::stride_t stride_out = { sizeof(std::complex<float>) };
+std::pair<size_t, size_t> MelSpectrogram::frame_samples(int first_frame, int last_frame, size_t num_samples) const {
+    if (first_frame >= last_frame) {
+        return {0, 0};
+    }
+    int64_t pad_size = n_fft / 2;
+    int64_t length = static_cast<int64_t>(num_samples);
+    int64_t lowest = static_cast<int64_t>(first_frame) * hop_length - pad_size;
+    int64_t highest = static_cast<int64_t>(last_frame - 1) * hop_length - pad_size + n_fft;  // Exclusive
+    int64_t first = std::max<int64_t>(0, lowest);
+    int64_t last = std::min(length, highest);
+    if (lowest < 0) {
+        last = std::max(last, std::min(length, 1 - lowest));  // Reflected at sample 0
+    }
+    if (highest > length) {
+        first = std::min(first, std::max<int64_t>(0, 2 * length - 1 - highest));  // Reflected at the end
+    }
+    return {static_cast<size_t>(first), static_cast<size_t>(last)};
+}
 
-    for (int i = 0; i < num_frames; ++i) {
-        // Extract frame and apply window
-        int start_idx = i * hop_length;
-        for (int j = 0; j < n_fft; ++j) {
-            in_pocket[j] = padded_audio[start_idx + j] * window[j];
+void MelSpectrogram::compute_frames(const float* samples, size_t num_samples, int first_frame, int last_frame,
+                                    Spectrogram& output) {
+    output.resize(std::max(0, last_frame - first_frame), n_mels);
+    if (first_frame >= last_frame) {
+        return;
+    }
+    size_t first_sample = frame_samples(first_frame, last_frame, num_samples).first;
+
+    // The padded signal of compute() for just these frames
+    int64_t pad_size = n_fft / 2;
+    int64_t length = static_cast<int64_t>(num_samples);
+    int64_t begin = static_cast<int64_t>(first_frame) * hop_length;
+    int64_t end = static_cast<int64_t>(last_frame - 1) * hop_length + n_fft;
+    padded_audio.resize(end - begin);
+    for (int64_t j = begin; j < end; ++j) {
+        int64_t t = j - pad_size;
+        if (t < 0) {
+            t = -t;
+        } else if (t >= length) {
+            t = 2 * (length - 1) - t;
         }
+        padded_audio[j - begin] = samples[t - static_cast<int64_t>(first_sample)];
+    }
+    compute_frame_range(padded_audio.data(), 0, last_frame - first_frame, output);
+}
 
-        // Execute FFT
-        pocketfft::r2c(shape, stride_in, stride_out, 0, true, in_pocket.data(), out_pocket.data(), 1.0f);
+void MelSpectrogram::begin_stream(Spectrogram& output) {
+    stream_buffer.clear();
+    stream_base = 0;
+    stream_started = false;
+    output.resize(0, n_mels);
+}
 
+void MelSpectrogram::push_samples(const float* samples, size_t num_samples, Spectrogram& output) {
+    int pad_size = n_fft / 2;
+    stream_buffer.insert(stream_buffer.end(), samples, samples + num_samples);
 
-        // Compute amplitude spectrum and apply normalization
-        std::vector<double> amplitude_spectrum(n_fft / 2 + 1);
-        double normalization_factor = std::sqrt(static_cast<double>(win_length));
-        for (int j = 0; j < n_fft / 2 + 1; ++j) {
-            double real = out_pocket[j].real();
-            double imag = out_pocket[j].imag();
-            amplitude_spectrum[j] = std::sqrt(real * real + imag * imag) / normalization_factor;
+    if (!stream_started) {
+        // The pre-padding reflects samples 1..pad_size, so wait until they have arrived
+        if (stream_buffer.size() <= static_cast<size_t>(pad_size)) {
+            return;
+        }
+        // Shift the samples up first: inserting a range of the vector into itself is undefined
+        size_t count = stream_buffer.size();
+        stream_buffer.resize(count + pad_size);
+        std::move_backward(stream_buffer.begin(), stream_buffer.begin() + count, stream_buffer.end());
+        for (int i = 1; i <= pad_size; ++i) {
+            stream_buffer[pad_size - i] = stream_buffer[pad_size + i];
         }
-        
-        // Store the computed spectrum for this frame
-        last_power_spectrum[i] = amplitude_spectrum;
+        stream_started = true;
+    }
 
-        // Apply Mel filterbank and log scaling
-        for (int m = 0; m < n_mels; ++m) {
-            double mel_energy = 0.0;
-            for (int k = 0; k < n_fft / 2 + 1; ++k) {
-                mel_energy += amplitude_spectrum[k] * mel_filterbank[k][m];
+    compute_stream_frames(output, false);
+
+    // Drop consumed samples; at least n_fft - hop_length remain for the post-padding
+    size_t consumed = output.num_frames() * hop_length - stream_base;
+    if (consumed >= stream_trim_samples) {
+        stream_buffer.erase(stream_buffer.begin(), stream_buffer.begin() + consumed);
+        stream_base += consumed;
+    }
+}
+
+void MelSpectrogram::end_stream(Spectrogram& output) {
+    int pad_size = n_fft / 2;
+    if (!stream_started) {
+        // Too short for reflection padding, as in compute()
+        output.resize(0, n_mels);
+        return;
+    }
+
+    // Post-padding (reflection)
+    size_t end = stream_buffer.size();
+    for (int i = 1; i <= pad_size; ++i) {
+        stream_buffer.push_back(stream_buffer[end - 1 - i]);
+    }
+    compute_stream_frames(output, true);
+
+    stream_buffer.clear();
+    stream_base = 0;
+    stream_started = false;
+}
+
+// Appends every frame that lies completely inside stream_buffer. Unless flush is
+// set, waits with several threads until each of them would get a full share.
+void MelSpectrogram::compute_stream_frames(Spectrogram& output, bool flush) {
+    size_t buffered_end = stream_base + stream_buffer.size();
+    if (buffered_end < static_cast<size_t>(n_fft)) {
+        return;
+    }
+    int first_frame = static_cast<int>(output.num_frames());
+    int last_frame = static_cast<int>((buffered_end - n_fft) / hop_length + 1);
+    if (last_frame <= first_frame ||
+        (!flush && options.num_threads > 1 && last_frame - first_frame < options.num_threads * min_frames_per_thread)) {
+        return;
+    }
+    output.resize(last_frame, n_mels);
+    compute_frame_range(stream_buffer.data() + (first_frame * hop_length - stream_base), first_frame, last_frame, output);
+}
+
+// Computes frames [first_frame, last_frame) into output rows, splitting the
+// range across worker threads. Frame i starts at samples + (i - first_frame) * hop_length.
+void MelSpectrogram::compute_frame_range(const float* samples, int first_frame, int last_frame, Spectrogram& output) {
+    int num_frames = last_frame - first_frame;
+    if (num_frames <= 0) {
+        return;
+    }
+    if (options.capture_debug) {
+        log1p_input_cpp.resize(last_frame, std::vector<double>(n_mels));
+        last_power_spectrum.resize(last_frame, std::vector<double>(n_fft / 2 + 1));
+    }
+
+    // Split the frame range into contiguous blocks, one per worker
+    int num_workers = std::max(1, std::min(options.num_threads, num_frames / min_frames_per_thread));
+    while (static_cast<int>(workers.size()) < num_workers) {
+        workers.push_back(create_worker());
+    }
+
+    int frames_per_worker = (num_frames + num_workers - 1) / num_workers;
+    // Errors are kept per worker, so the single-threaded path allocates nothing per block
+    std::vector<std::thread> threads;
+    threads.reserve(num_workers - 1);
+    for (int w = 0; w < num_workers; ++w) {
+        workers[w].error = nullptr;
+    }
+    for (int w = 1; w < num_workers; ++w) {
+        int first = std::min(num_frames, w * frames_per_worker);
+        int last = std::min(num_frames, first + frames_per_worker);
+        threads.emplace_back([this, w, samples, first, last, first_frame, &output]() {
+            try {
+                compute_frames(workers[w], samples + first * hop_length, first_frame + first, first_frame + last, output);
+            } catch (...) {
+                workers[w].error = std::current_exception();
             }
-            log1p_input_cpp[i][m] = log_multiplier * mel_energy;
-            mel_spectrogram_output[i][m] = std::log1p(log_multiplier * std::max(mel_energy, amin));
+        });
+    }
+
+    try {
+        compute_frames(workers[0], samples, first_frame, first_frame + std::min(num_frames, frames_per_worker), output);
+    } catch (...) {
+        workers[0].error = std::current_exception();
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    last_verification_error = 0.0f;
+    for (int w = 0; w < num_workers; ++w) {
+        last_verification_error = std::max(last_verification_error, workers[w].verification_error);
+    }
+    for (int w = 0; w < num_workers; ++w) {
+        if (workers[w].error) {
+            std::rethrow_exception(workers[w].error);
         }
     }
+}
 
-    // No explicit cleanup needed for PocketFFT with std::vector
+// Computes frames [first_frame, last_frame) into output rows; frame first_frame starts at samples
+void MelSpectrogram::compute_frames(FrameWorker& worker, const float* samples, int first_frame, int last_frame, Spectrogram& output) {
+    worker.verification_error = 0.0f;
+    for (int i = first_frame; i < last_frame; ++i) {
+        compute_frame(worker, samples + (i - first_frame) * hop_length, output.row(i), i);
+    }
+}
 
-    return mel_spectrogram_output;
+void MelSpectrogram::compute_frame(const float* frame_samples, float* mel_row) {
+    compute_frame(workers[0], frame_samples, mel_row, -1);
 }
 
+// Computes one mel frame from n_fft samples; frame < 0 skips debug capture
+void MelSpectrogram::compute_frame(FrameWorker& worker, const float* frame_samples, float* mel_row, int frame) {
+    std::vector<float>& in_pocket = worker.in_pocket;
+    std::vector<std::complex<float>>& out_pocket = worker.out_pocket;
 
+    // Extract frame and apply window
+    for (int j = 0; j < n_fft; ++j) {
+        in_pocket[j] = frame_samples[j] * window[j];
+    }
+
+    // Execute FFT in place with the cached plan; the result is in halfcomplex
+    // order r0, r1, i1, r2, i2, ..., r(n/2), unpacked here like pocketfft::r2c does
+    worker.plan->exec(in_pocket.data(), 1.0f, true);
+    out_pocket[0] = std::complex<float>(in_pocket[0], 0.0f);
+    for (int k = 1; k < n_fft / 2; ++k) {
+        out_pocket[k] = std::complex<float>(in_pocket[2 * k - 1], in_pocket[2 * k]);
+    }
+    out_pocket[n_fft / 2] = std::complex<float>(in_pocket[n_fft - 1], 0.0f);
+
+    if (options.use_reference_kernel) {
+        apply_reference_filterbank(worker, mel_row, frame);
+    } else {
+        apply_banded_filterbank(worker, mel_row, frame);
+
+        if (options.verify) {
+            // Reference pass overwrites the debug buffers with double-precision values
+            std::vector<float>& reference_row = worker.reference_row;
+            apply_reference_filterbank(worker, reference_row.data(), frame);
+            for (int m = 0; m < n_mels; ++m) {
+                float error = std::abs(mel_row[m] - reference_row[m]);
+                worker.verification_error = std::max(worker.verification_error, error);
+                if (!(error <= options.verify_tolerance)) {
+                    throw std::runtime_error("Mel kernel verification failed at frame " + std::to_string(frame) +
+                                             ", mel bin " + std::to_string(m) + ": banded=" + std::to_string(mel_row[m]) +
+                                             ", reference=" + std::to_string(reference_row[m]));
+                }
+            }
+        }
+    }
+}
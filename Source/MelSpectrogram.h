@@ -6,7 +6,12 @@
 #include <cmath>
 #include <numeric>
 #include <algorithm>
+#include <memory>
+#include <exception>
+#include <cstdint>
+#include <utility>
 #include "pocketfft_hdronly.h"
+#include "Spectrogram.h"
 
 /**
  * @class MelSpectrogram
@@ -18,21 +23,128 @@
  */
 class MelSpectrogram {
 public:
+    struct Options {
+        // Use the dense double-precision filterbank (reference path for Python parity)
+        // instead of the banded single-precision SIMD kernel
+        bool use_reference_kernel = false;
+        // Take the log1p of the banded path with the vectorized approximation of
+        // SimdKernels.h instead of std::log1p per bin (about one float ulp of
+        // error, far below verify_tolerance). Ignored by the reference path.
+        bool fast_log = false;
+        // Additionally run the reference path on every frame and throw
+        // std::runtime_error if the outputs differ by more than verify_tolerance
+        bool verify = false;
+        float verify_tolerance = 1e-3f;
+        // Number of worker threads the frame range is split across (1 = serial).
+        // Output is bit-identical for any thread count.
+        int num_threads = 1;
+        // Record per-frame magnitudes and pre-log mel energies for the debugging
+        // accessors (parity tests against Python). Costs (513 + 128) doubles per
+        // frame, so it is off by default.
+        bool capture_debug = false;
+    };
+
     MelSpectrogram();
+    explicit MelSpectrogram(const Options& options);
     ~MelSpectrogram();
     
     /**
      * @brief Computes Mel-scale spectrogram from audio signal
      * @param audio Input audio signal (mono, 22050 Hz)
-     * @return 2D vector representing Mel spectrogram [frames][mel_bins]
+     * @return Contiguous Mel spectrogram [frames][mel_bins]
+     */
+    Spectrogram compute(const std::vector<float>& audio);
+
+    /**
+     * @brief Computes Mel-scale spectrogram into an existing buffer
+     * @param audio Input audio signal (mono, 22050 Hz)
+     * @param output Resized to [frames][mel_bins]; its allocation is reused
+     */
+    void compute(const std::vector<float>& audio, Spectrogram& output);
+
+    /**
+     * @brief Computes Mel-scale spectrogram from a raw buffer into an existing buffer
+     * @param audio Input audio signal (mono, 22050 Hz)
+     * @param num_samples Number of samples in audio
+     * @param output Resized to [frames][mel_bins]; its allocation is reused
+     */
+    void compute(const float* audio, size_t num_samples, Spectrogram& output);
+
+    /**
+     * @brief Computes Mel-scale spectrogram from interleaved multi-channel input
+     *
+     * The channels are averaged (and integer PCM scaled to [-1, 1)) while the
+     * padded frame buffer is filled, so no separate mono copy is made.
+     * @param audio Interleaved input at 22050 Hz [num_frames][channels]
+     * @param num_frames Number of sample frames in audio
+     * @param channels Channel count of audio
+     * @param output Resized to [frames][mel_bins]; its allocation is reused
+     */
+    void compute(const float* audio, size_t num_frames, int channels, Spectrogram& output);
+    void compute(const int16_t* audio, size_t num_frames, int channels, Spectrogram& output);
+    void compute(const int32_t* audio, size_t num_frames, int channels, Spectrogram& output);
+
+    /**
+     * @brief Incremental computation for audio that arrives in blocks
+     *
+     * begin_stream() clears output, push_samples() appends every frame that
+     * is complete, and end_stream() applies the end padding and appends the
+     * remaining frames. The result is identical to compute() on the
+     * concatenated input, but only about one frame of audio is buffered.
+     * With num_threads > 1, push_samples() instead holds complete frames back
+     * until every worker gets min_frames_per_thread of them, so block-wise
+     * input is split across the threads like compute() input.
+     * Uses the same scratch state as compute(), so the two must not be interleaved.
+     */
+    void begin_stream(Spectrogram& output);
+    void push_samples(const float* samples, size_t num_samples, Spectrogram& output);
+    void end_stream(Spectrogram& output);
+
+    /**
+     * @brief Partial recomputation after samples of the signal have changed
+     *
+     * For a signal of num_samples samples, changed_frames() returns the
+     * frames [first, last) of compute() whose windows, including the
+     * reflection padding, reach samples [first_sample, last_sample).
+     * frame_samples() returns the samples [first, last) that frames
+     * [first_frame, last_frame) read, and compute_frames() computes those
+     * frames from exactly these samples, with the same values as compute().
      */
-    std::vector<std::vector<float>> compute(const std::vector<float>& audio);
+    std::pair<int, int> changed_frames(size_t first_sample, size_t last_sample, size_t num_samples) const;
+    std::pair<size_t, size_t> frame_samples(int first_frame, int last_frame, size_t num_samples) const;
+
+    /**
+     * @param samples Samples [frame_samples().first, frame_samples().second) of the signal
+     * @param num_samples Length of the whole signal
+     * @param output Resized to [last_frame - first_frame][mel_bins]
+     */
+    void compute_frames(const float* samples, size_t num_samples, int first_frame, int last_frame, Spectrogram& output);
+
+    // Number of frames compute() returns for num_samples samples
+    int num_frames(size_t num_samples) const;
+
+    /**
+     * @brief Computes a single Mel frame for incremental (streaming) use
+     * @param frame_samples n_fft consecutive samples; the frame is centered on
+     *        sample n_fft / 2, so the caller is responsible for edge padding
+     * @param mel_row Output row of n_mels values
+     */
+    void compute_frame(const float* frame_samples, float* mel_row);
+
+    int get_sample_rate() const { return sample_rate; }
+    int get_n_fft() const { return n_fft; }
+    int get_hop_length() const { return hop_length; }
+    int get_n_mels() const { return n_mels; }
 
-    // Debugging accessors - remove in production
+    // Debugging accessors - only filled when Options::capture_debug is set
     const std::vector<std::vector<double>>& get_mel_filterbank() const { return mel_filterbank; }
     const std::vector<std::vector<double>>& get_last_power_spectrum() const { return last_power_spectrum; }
     const std::vector<std::vector<double>>& get_log1p_input() const { return log1p_input_cpp; }
 
+    // Largest absolute difference to the reference path seen by the last
+    // compute() call (only updated when Options::verify is set)
+    float get_last_verification_error() const { return last_verification_error; }
+
 private:
     // Audio processing parameters (must match Python implementation)
     const int sample_rate = 22050;     // Target sample rate
@@ -46,12 +158,64 @@ private:
     const float log_multiplier = 1000.0f; // Log scaling factor
     const double amin = 1e-10;         // Minimum amplitude clipping
 
+    Options options;
+
     std::vector<std::vector<double>> mel_filterbank; // (n_freqs, n_mels)
+
+    // Banded single-precision copy of mel_filterbank: each triangular filter
+    // only covers a few FFT bins, so only its nonzero span is stored
+    struct MelBand {
+        int start_bin;  // First FFT bin with a nonzero weight
+        int length;     // Number of consecutive bins covered
+        int offset;     // Index of the first weight in mel_band_weights
+    };
+    std::vector<MelBand> mel_bands;                // (n_mels)
+    std::vector<float> mel_band_weights;           // Concatenated band weights
+    float last_verification_error = 0.0f;
     std::vector<std::vector<double>> last_power_spectrum;
     std::vector<std::vector<double>> log1p_input_cpp;
 
+    // Precomputed once and reused across compute() calls
+    std::vector<float> window;                     // Hann window (win_length)
+
+    // Scratch buffers reused across compute() calls
+    std::vector<float> padded_audio;               // Reflection-padded input
+
+    // Incremental computation state (begin_stream / push_samples / end_stream)
+    std::vector<float> stream_buffer;              // Padded samples from stream_base on
+    size_t stream_base = 0;                        // Padded-signal index of stream_buffer[0]
+    bool stream_started = false;                   // Pre-padding has been applied
+    static constexpr size_t stream_trim_samples = 1 << 16; // Trim stream_buffer once this many samples are consumed
+
+    // Per-thread FFT plan and scratch buffers; worker 0 runs on the calling thread
+    struct FrameWorker {
+        std::unique_ptr<pocketfft::pocketfft_r<float>> plan; // Cached real FFT plan (n_fft)
+        std::vector<float> in_pocket;                  // Windowed frame, transformed in place (n_fft)
+        std::vector<std::complex<float>> out_pocket;   // FFT output (n_fft / 2 + 1)
+        std::vector<double> amplitude_spectrum;        // Per-frame magnitudes, reference path (n_fft / 2 + 1)
+        std::vector<float> magnitude_spectrum;         // Per-frame magnitudes, banded path (n_fft / 2 + 1)
+        std::vector<float> reference_row;              // Reference output for verification (n_mels)
+        float verification_error = 0.0f;
+        std::exception_ptr error;                      // Failure of the last compute_frames() run
+    };
+    std::vector<FrameWorker> workers;
+
+    // Minimum number of frames per worker thread (~5 s of audio); shorter
+    // inputs use fewer threads so thread start-up never dominates
+    static constexpr int min_frames_per_thread = 256;
+
     // Helper functions
     void create_mel_filterbank();
+    void create_mel_bands();
+    FrameWorker create_worker() const;
+    template <typename Sample>
+    void compute_interleaved(const Sample* audio, size_t num_frames, int channels, Spectrogram& output);
+    void compute_stream_frames(Spectrogram& output, bool flush);
+    void compute_frame_range(const float* samples, int first_frame, int last_frame, Spectrogram& output);
+    void compute_frames(FrameWorker& worker, const float* samples, int first_frame, int last_frame, Spectrogram& output);
+    void compute_frame(FrameWorker& worker, const float* frame_samples, float* mel_row, int frame);
+    void apply_banded_filterbank(FrameWorker& worker, float* mel_row, int frame);
+    void apply_reference_filterbank(FrameWorker& worker, float* mel_row, int frame);
     float hz_to_mel(float hz);
     float mel_to_hz(float mel);
     std::vector<float> create_hann_window(int size);
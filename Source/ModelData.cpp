@@ -0,0 +1,51 @@
+#include "ModelData.h"
+#include "MappedFile.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <filesystem>
+
+namespace BeatThis {
+
+std::shared_ptr<const ModelData> ModelData::map_file(const std::string& path) {
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(path, ec)) {
+        throw std::runtime_error("ONNX model file not found: " + path);
+    }
+    std::shared_ptr<ModelData> model(new ModelData());
+    model->path_ = path;
+    model->file_ = MappedFile::open(path);
+    model->data_ = model->file_->data();
+    model->size_ = model->file_->size();
+    return model;
+}
+
+std::shared_ptr<const ModelData> ModelData::from_buffer(const void* data, size_t size) {
+    if (!data || size == 0) {
+        throw std::runtime_error("Model buffer is empty");
+    }
+    std::shared_ptr<ModelData> model(new ModelData());
+    model->data_ = data;
+    model->size_ = size;
+    return model;
+}
+
+std::shared_ptr<const ModelData> ModelData::from_bytes(std::vector<char> bytes) {
+    if (bytes.empty()) {
+        throw std::runtime_error("Model buffer is empty");
+    }
+    std::shared_ptr<ModelData> model(new ModelData());
+    model->bytes_ = std::move(bytes);
+    model->data_ = model->bytes_.data();
+    model->size_ = model->bytes_.size();
+    return model;
+}
+
+ModelData::~ModelData() = default;
+
+// ORT-format models are FlatBuffers with the file identifier "ORTM" after the root offset
+bool ModelData::is_ort_format() const {
+    return size_ >= 8 && std::memcmp(static_cast<const char*>(data_) + 4, "ORTM", 4) == 0;
+}
+
+} // namespace BeatThis
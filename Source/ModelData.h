@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstddef>
+
+namespace BeatThis {
+
+class MappedFile;
+
+/**
+ * Read-only bytes of an ONNX or ORT-format model, for creating BeatThis
+ * instances without ONNX Runtime reading the model file again.
+ *
+ * map_file() memory-maps the file (see MappedFile), so every instance and worker process that
+ * maps the same model shares one copy of its bytes in the page cache.
+ * from_buffer() wraps memory owned by the caller (e.g. a model embedded in
+ * the binary or received over the network), and from_bytes() takes ownership
+ * of a copy.
+ *
+ * Sessions keep the ModelData they were created from alive. For models in
+ * ORT format, ONNX Runtime then uses the weights in place instead of copying
+ * them, so mapped ORT-format models are shared across processes as well.
+ */
+class ModelData {
+public:
+    // Throws std::runtime_error if the file cannot be opened or mapped
+    static std::shared_ptr<const ModelData> map_file(const std::string& path);
+
+    // data must stay valid until every BeatThis created from it is destroyed
+    static std::shared_ptr<const ModelData> from_buffer(const void* data, size_t size);
+
+    static std::shared_ptr<const ModelData> from_bytes(std::vector<char> bytes);
+
+    ~ModelData();
+
+    ModelData(const ModelData&) = delete;
+    ModelData& operator=(const ModelData&) = delete;
+
+    const void* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // Source file of map_file(); empty for buffers
+    const std::string& path() const { return path_; }
+
+    // True for ORT-format (FlatBuffers) models, false for ONNX protobuf models
+    bool is_ort_format() const;
+
+private:
+    ModelData() = default;
+
+    const void* data_ = nullptr;
+    size_t size_ = 0;
+    std::string path_;
+    std::vector<char> bytes_;  // Owned copy (from_bytes)
+    std::shared_ptr<const MappedFile> file_;  // Mapped file (map_file)
+};
+
+} // namespace BeatThis
@@ -0,0 +1,33 @@
+#ifndef PIPELINE_OPTIONS_H
+#define PIPELINE_OPTIONS_H
+
+#include "MelSpectrogram.h"
+#include "Resampler.h"
+
+/**
+ * @brief Pipeline settings shared by BeatThis and AsyncAnalyzer
+ *
+ * Both build their stages from the same BeatThisConfig, so the translation to
+ * stage options lives in one place and new settings reach every path.
+ */
+
+namespace BeatThis {
+
+struct BeatThisConfig;
+enum class ResampleQuality;
+
+// Sample rate the model was trained on
+constexpr int target_samplerate = 22050;
+
+// Spectrogram frames per second (22050 Hz / hop of 441 samples)
+constexpr float model_fps = 50.0f;
+
+// Frontend options for config
+MelSpectrogram::Options make_mel_options(const BeatThisConfig& config);
+
+// Resampler algorithm for a configured quality
+Resampler::Quality to_resampler_quality(ResampleQuality quality);
+
+} // namespace BeatThis
+
+#endif // PIPELINE_OPTIONS_H
@@ -1,14 +1,25 @@
 #include "Postprocessor.h"
 #include <limits>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <set>
 
-Postprocessor::Postprocessor(float fps) : fps_(fps) {}
+Postprocessor::Postprocessor(float fps, int kernel_size, float threshold, int dedup_width, bool verify)
+    : fps_(fps), kernel_size_(kernel_size), threshold_(threshold), dedup_width_(dedup_width), verify_(verify) {
+    if (kernel_size_ < 1 || kernel_size_ % 2 == 0) {
+        throw std::runtime_error("Postprocessor kernel size must be a positive odd number, got " +
+                                 std::to_string(kernel_size_));
+    }
+}
 
 // Helper for deduplicate_peaks
-std::vector<int> Postprocessor::deduplicate_peaks(const std::vector<int>& peaks, int width) {
-    std::vector<int> result;
+ScratchVector<int> Postprocessor::deduplicate_peaks(const ScratchVector<int>& peaks, int width) {
+    ScratchVector<int> result{ArenaAllocator<int>(scratch_)};
     if (peaks.empty()) {
         return result;
     }
+    result.reserve(peaks.size());
 
     double p = peaks[0];
     int c = 1;
@@ -28,108 +39,431 @@ std::vector<int> Postprocessor::deduplicate_peaks(const std::vector<int>& peaks,
     return result;
 }
 
-// Helper for max_pool1d equivalent
-// This is a simplified version that assumes kernel_size is odd and padding is (kernel_size - 1) / 2
-std::vector<float> Postprocessor::max_pool1d_equivalent(const std::vector<float>& input, int kernel_size, int stride, int padding) {
-    std::vector<float> output(input.size());
-    int half_kernel = kernel_size / 2;
-
-    for (size_t i = 0; i < input.size(); ++i) {
-        float max_val = -std::numeric_limits<float>::infinity();
-        for (int k = -half_kernel; k <= half_kernel; ++k) {
-            int idx = i + k;
-            if (idx >= 0 && idx < input.size()) {
-                max_val = std::max(max_val, input[idx]);
+namespace {
+    // Sliding-window maximum over [i - half_kernel, i + half_kernel] using a
+    // monotonic deque of indices: values are non-increasing from front to back,
+    // so the front is always the window maximum. Each index is pushed and
+    // popped at most once, making a full pass O(n) for any kernel size.
+    class SlidingMax {
+    public:
+        SlidingMax(const float* values, int size, int half_kernel, std::vector<int>& storage)
+            : values_(values), half_kernel_(half_kernel), queue_(storage) {
+            queue_.resize(size);
+        }
+
+        // Appends element j to the window
+        void push(int j) {
+            // Equal values stay, so ties keep the earliest index in front
+            while (tail_ > head_ && values_[queue_[tail_ - 1]] < values_[j]) {
+                --tail_;
+            }
+            queue_[tail_++] = j;
+        }
+
+        // Maximum of [i - half_kernel, i + half_kernel]; elements up to i + half_kernel must be pushed
+        float window_max(int i) {
+            while (queue_[head_] < i - half_kernel_) {
+                ++head_;
             }
+            return values_[queue_[head_]];
         }
-        output[i] = max_val;
+
+    private:
+        const float* values_;
+        int half_kernel_;
+        std::vector<int>& queue_;
+        int head_ = 0;
+        int tail_ = 0;
+    };
+
+    // Brute-force references for the verify option
+
+    // Peak frames of one track, scanning the whole kernel window of every frame
+    std::vector<int> reference_peaks(const std::vector<float>& logits, int size, int half_kernel, float threshold) {
+        std::vector<int> peaks;
+        for (int i = 0; i < size; ++i) {
+            float max_val = -std::numeric_limits<float>::infinity();
+            for (int k = std::max(0, i - half_kernel); k <= std::min(size - 1, i + half_kernel); ++k) {
+                max_val = std::max(max_val, logits[k]);
+            }
+            if (logits[i] == max_val && logits[i] > threshold) {
+                peaks.push_back(i);
+            }
+        }
+        return peaks;
+    }
+
+    // Moves every downbeat onto the nearest beat by scanning all beats, then
+    // counts beats by looking the downbeats up in a set of beat times
+    void reference_downbeats(const std::vector<float>& beat_time,
+                             std::vector<float> downbeat_time,
+                             std::vector<float>& downbeats,
+                             std::vector<int>& beat_counts) {
+        if (!beat_time.empty()) {
+            for (float& d_time : downbeat_time) {
+                float min_diff = std::numeric_limits<float>::max();
+                float nearest = d_time;
+                for (float b_time : beat_time) {
+                    float diff = std::abs(b_time - d_time);
+                    if (diff < min_diff) {
+                        min_diff = diff;
+                        nearest = b_time;
+                    }
+                }
+                d_time = nearest;
+            }
+        }
+        std::sort(downbeat_time.begin(), downbeat_time.end());
+        downbeat_time.erase(std::unique(downbeat_time.begin(), downbeat_time.end()), downbeat_time.end());
+        downbeats = downbeat_time;
+
+        beat_counts.assign(beat_time.size(), 0);
+        std::set<float> beat_set(beat_time.begin(), beat_time.end());
+        if (beat_time.empty() || downbeats.empty() ||
+            std::any_of(downbeats.begin(), downbeats.end(), [&](float d) { return !beat_set.count(d); })) {
+            return;
+        }
+        int start_counter = 1;
+        if (downbeats.size() >= 2) {
+            auto first = std::lower_bound(beat_time.begin(), beat_time.end(), downbeats[0]) - beat_time.begin();
+            auto second = std::lower_bound(beat_time.begin(), beat_time.end(), downbeats[1]) - beat_time.begin();
+            int beats_in_first_measure = static_cast<int>(second - first);
+            int pickup_beats = static_cast<int>(first);
+            if (pickup_beats < beats_in_first_measure) {
+                start_counter = beats_in_first_measure - pickup_beats;
+            }
+        }
+        int counter = start_counter;
+        size_t next_downbeat = 0;
+        for (size_t i = 0; i < beat_time.size(); ++i) {
+            if (next_downbeat < downbeats.size() && std::abs(beat_time[i] - downbeats[next_downbeat]) < 1e-6f) {
+                counter = 1;
+                ++next_downbeat;
+            } else {
+                counter++;
+            }
+            beat_counts[i] = counter;
+        }
+    }
+
+    // Index of the first element where a and b differ (the shorter size if one is a prefix), or -1
+    template <typename A, typename B>
+    long first_difference(const A& a, const B& b) {
+        size_t n = std::min(a.size(), b.size());
+        for (size_t i = 0; i < n; ++i) {
+            if (a[i] != b[i]) {
+                return static_cast<long>(i);
+            }
+        }
+        return a.size() == b.size() ? -1 : static_cast<long>(n);
     }
-    return output;
 }
 
-std::pair<std::vector<float>, std::vector<float>> Postprocessor::process(
-    const std::vector<float>& beat_logits,
-    const std::vector<float>& downbeat_logits
-) {
-    // 1. Max pooling equivalent and thresholding
-    // Combine beat and downbeat for parallel processing as in Python
-    std::vector<float> combined_logits(beat_logits.size() * 2);
-    for (size_t i = 0; i < beat_logits.size(); ++i) {
-        combined_logits[i] = beat_logits[i];
-        combined_logits[i + beat_logits.size()] = downbeat_logits[i];
+// Single pass over beat and downbeat logits: a frame is a peak if it equals the
+// maximum of its kernel window (max_pool1d with same padding) and exceeds the threshold
+void Postprocessor::find_peaks(const std::vector<float>& beat_logits,
+                               const std::vector<float>& downbeat_logits,
+                               ScratchVector<int>& beat_peaks,
+                               ScratchVector<int>& downbeat_peaks) {
+    beat_peaks.clear();
+    downbeat_peaks.clear();
+
+    int size = static_cast<int>(std::min(beat_logits.size(), downbeat_logits.size()));
+    if (size == 0) {
+        return;
     }
+    // Every frame of a plateau can be a peak, so size bounds both lists
+    beat_peaks.reserve(size);
+    downbeat_peaks.reserve(size);
 
-    std::vector<float> pred_peaks_combined(combined_logits.size());
-    std::vector<float> max_pooled_combined = max_pool1d_equivalent(combined_logits, 7, 1, 3);
+    int half_kernel = kernel_size_ / 2;
+    SlidingMax beat_max(beat_logits.data(), size, half_kernel, beat_queue_);
+    SlidingMax downbeat_max(downbeat_logits.data(), size, half_kernel, downbeat_queue_);
 
-    for (size_t i = 0; i < combined_logits.size(); ++i) {
-        if (combined_logits[i] == max_pooled_combined[i] && combined_logits[i] > 0) {
-            pred_peaks_combined[i] = 1.0f; // True
-        } else {
-            pred_peaks_combined[i] = 0.0f; // False
+    for (int j = 0; j < std::min(half_kernel, size); ++j) {
+        beat_max.push(j);
+        downbeat_max.push(j);
+    }
+
+    for (int i = 0; i < size; ++i) {
+        if (i + half_kernel < size) {
+            beat_max.push(i + half_kernel);
+            downbeat_max.push(i + half_kernel);
+        }
+
+        float beat_value = beat_logits[i];
+        if (beat_value > threshold_ && beat_max.window_max(i) == beat_value) {
+            beat_peaks.push_back(i);
+        }
+        float downbeat_value = downbeat_logits[i];
+        if (downbeat_value > threshold_ && downbeat_max.window_max(i) == downbeat_value) {
+            downbeat_peaks.push_back(i);
         }
     }
+}
 
-    // Separate beat and downbeat peaks
-    std::vector<float> beat_peaks_bool(beat_logits.size());
-    std::vector<float> downbeat_peaks_bool(downbeat_logits.size());
-    for (size_t i = 0; i < beat_logits.size(); ++i) {
-        beat_peaks_bool[i] = pred_peaks_combined[i];
-        downbeat_peaks_bool[i] = pred_peaks_combined[i + beat_logits.size()];
+template <typename Frames>
+Postprocessor::Result Postprocessor::assemble(const Frames& beat_frame, const Frames& downbeat_frame) {
+    // 3. Convert from frame to seconds
+    Result result;
+    result.beats.resize(beat_frame.size());
+    for (size_t i = 0; i < beat_frame.size(); ++i) {
+        result.beats[i] = static_cast<float>(beat_frame[i]) / fps_;
     }
+    const std::vector<float>& beat_time = result.beats;
 
-    // Convert boolean arrays to frame indices
-    std::vector<int> beat_frame;
-    for (size_t i = 0; i < beat_peaks_bool.size(); ++i) {
-        if (beat_peaks_bool[i] > 0.5f) { // Check for true
-            beat_frame.push_back(i);
+    result.downbeats.reserve(downbeat_frame.size());
+    if (beat_time.empty()) {
+        // Nothing to move the downbeats to or to count
+        for (int frame : downbeat_frame) {
+            result.downbeats.push_back(static_cast<float>(frame) / fps_);
         }
+        return result;
     }
 
-    std::vector<int> downbeat_frame;
-    for (size_t i = 0; i < downbeat_peaks_bool.size(); ++i) {
-        if (downbeat_peaks_bool[i] > 0.5f) { // Check for true
-            downbeat_frame.push_back(i);
+    // 4. Move each downbeat to the nearest beat (the first one on ties). Both
+    // lists are sorted, so the nearest beat index never decreases and a single
+    // merge pass finds all of them. Downbeats moved onto the same beat collapse.
+    ScratchVector<size_t> downbeat_beat_idx{ArenaAllocator<size_t>(scratch_)};
+    downbeat_beat_idx.reserve(downbeat_frame.size());
+    size_t j = 0;
+    for (int frame : downbeat_frame) {
+        float d_time = static_cast<float>(frame) / fps_;
+        while (j + 1 < beat_time.size() && std::abs(beat_time[j + 1] - d_time) < std::abs(beat_time[j] - d_time)) {
+            ++j;
+        }
+        if (downbeat_beat_idx.empty() || downbeat_beat_idx.back() != j) {
+            downbeat_beat_idx.push_back(j);
+            result.downbeats.push_back(beat_time[j]);
         }
     }
 
-    // 2. Deduplicate peaks
-    beat_frame = deduplicate_peaks(beat_frame, 1);
-    downbeat_frame = deduplicate_peaks(downbeat_frame, 1);
+    // 5. Count beats within measures (1 = downbeat)
+    result.beat_counts.resize(beat_time.size());
+    if (downbeat_beat_idx.empty()) {
+        return result;
+    }
 
-    // 3. Convert from frame to seconds
+    // Handle pickup measure
+    int start_counter = 1;
+    if (downbeat_beat_idx.size() >= 2) {
+        int beats_in_first_measure = static_cast<int>(downbeat_beat_idx[1] - downbeat_beat_idx[0]);
+        int pickup_beats = static_cast<int>(downbeat_beat_idx[0]);
+
+        if (pickup_beats < beats_in_first_measure) {
+            start_counter = beats_in_first_measure - pickup_beats;
+        } else {
+            std::cerr << "WARNING: There are more beats in the pickup measure than in the first measure. "
+                     << "The beat count will start from 2 without trying to estimate the length of the pickup measure." << std::endl;
+            start_counter = 1;
+        }
+    } else {
+        std::cerr << "WARNING: There are less than two downbeats in the predictions. Something may be wrong. "
+                 << "The beat count will start from 2 without trying to estimate the length of the pickup measure." << std::endl;
+        start_counter = 1;
+    }
+
+    int counter = start_counter;
+    size_t next_downbeat = 0;
+    for (size_t i = 0; i < beat_time.size(); ++i) {
+        if (next_downbeat < downbeat_beat_idx.size() && downbeat_beat_idx[next_downbeat] == i) {
+            counter = 1;
+            ++next_downbeat;
+        } else {
+            counter++;
+        }
+        result.beat_counts[i] = counter;
+    }
+
+    return result;
+}
+
+void Postprocessor::verify_peaks(const std::vector<float>& beat_logits,
+                                 const std::vector<float>& downbeat_logits,
+                                 const ScratchVector<int>& beat_peaks,
+                                 const ScratchVector<int>& downbeat_peaks) const {
+    int size = static_cast<int>(std::min(beat_logits.size(), downbeat_logits.size()));
+    int half_kernel = kernel_size_ / 2;
+    for (int track = 0; track < 2; ++track) {
+        const std::vector<float>& logits = track == 0 ? beat_logits : downbeat_logits;
+        const ScratchVector<int>& peaks = track == 0 ? beat_peaks : downbeat_peaks;
+        std::vector<int> reference = reference_peaks(logits, size, half_kernel, threshold_);
+        long index = first_difference(peaks, reference);
+        if (index >= 0) {
+            throw std::runtime_error(std::string("Peak picking verification failed for the ") +
+                                     (track == 0 ? "beat" : "downbeat") + " track at peak " + std::to_string(index) +
+                                     ": " + std::to_string(peaks.size()) + " peaks, reference has " +
+                                     std::to_string(reference.size()));
+        }
+    }
+}
+
+template <typename Frames>
+void Postprocessor::verify_result(const Frames& beat_frame, const Frames& downbeat_frame, const Result& result) const {
     std::vector<float> beat_time(beat_frame.size());
     for (size_t i = 0; i < beat_frame.size(); ++i) {
         beat_time[i] = static_cast<float>(beat_frame[i]) / fps_;
     }
-
     std::vector<float> downbeat_time(downbeat_frame.size());
     for (size_t i = 0; i < downbeat_frame.size(); ++i) {
         downbeat_time[i] = static_cast<float>(downbeat_frame[i]) / fps_;
     }
+    std::vector<float> downbeats;
+    std::vector<int> beat_counts;
+    reference_downbeats(beat_time, downbeat_time, downbeats, beat_counts);
 
-    // 4. Move downbeat to the nearest beat
-    if (!beat_time.empty()) {
-        for (size_t i = 0; i < downbeat_time.size(); ++i) {
-            float d_time = downbeat_time[i];
-            float min_diff = std::numeric_limits<float>::max();
-            int beat_idx = -1;
-            for (size_t j = 0; j < beat_time.size(); ++j) {
-                float diff = std::abs(beat_time[j] - d_time);
-                if (diff < min_diff) {
-                    min_diff = diff;
-                    beat_idx = j;
-                }
+    long index = first_difference(result.beats, beat_time);
+    if (index >= 0) {
+        throw std::runtime_error("Postprocessor verification failed at beat " + std::to_string(index));
+    }
+    index = first_difference(result.downbeats, downbeats);
+    if (index >= 0) {
+        throw std::runtime_error("Downbeat snapping verification failed at downbeat " + std::to_string(index) +
+                                 ": " + std::to_string(result.downbeats.size()) + " downbeats, reference has " +
+                                 std::to_string(downbeats.size()));
+    }
+    index = first_difference(result.beat_counts, beat_counts);
+    if (index >= 0) {
+        throw std::runtime_error("Beat count verification failed at beat " + std::to_string(index));
+    }
+}
+
+Postprocessor::Result Postprocessor::process(
+    const std::vector<float>& beat_logits,
+    const std::vector<float>& downbeat_logits
+) {
+    // Intermediates of the previous call are gone, so their scratch can be reused
+    scratch_.reset();
+
+    // 1. Peak picking (max pooling, thresholding and frame extraction in one pass)
+    ScratchVector<int> beat_frame{ArenaAllocator<int>(scratch_)};
+    ScratchVector<int> downbeat_frame{ArenaAllocator<int>(scratch_)};
+    find_peaks(beat_logits, downbeat_logits, beat_frame, downbeat_frame);
+    if (verify_) {
+        verify_peaks(beat_logits, downbeat_logits, beat_frame, downbeat_frame);
+    }
+
+    // 2. Deduplicate peaks
+    beat_frame = deduplicate_peaks(beat_frame, dedup_width_);
+    downbeat_frame = deduplicate_peaks(downbeat_frame, dedup_width_);
+
+    Result result = assemble(beat_frame, downbeat_frame);
+    if (verify_) {
+        verify_result(beat_frame, downbeat_frame, result);
+    }
+    return result;
+}
+
+
+void Postprocessor::pick_peaks(const std::vector<float>& beat_logits,
+                               const std::vector<float>& downbeat_logits,
+                               std::vector<int>& beat_peaks,
+                               std::vector<int>& downbeat_peaks) {
+    scratch_.reset();
+    ScratchVector<int> beat_frame{ArenaAllocator<int>(scratch_)};
+    ScratchVector<int> downbeat_frame{ArenaAllocator<int>(scratch_)};
+    find_peaks(beat_logits, downbeat_logits, beat_frame, downbeat_frame);
+    if (verify_) {
+        verify_peaks(beat_logits, downbeat_logits, beat_frame, downbeat_frame);
+    }
+    beat_frame = deduplicate_peaks(beat_frame, dedup_width_);
+    downbeat_frame = deduplicate_peaks(downbeat_frame, dedup_width_);
+    beat_peaks.assign(beat_frame.begin(), beat_frame.end());
+    downbeat_peaks.assign(downbeat_frame.begin(), downbeat_frame.end());
+}
+
+Postprocessor::Result Postprocessor::make_result(const std::vector<int>& beat_peaks, const std::vector<int>& downbeat_peaks) {
+    scratch_.reset();
+    Result result = assemble(beat_peaks, downbeat_peaks);
+    if (verify_) {
+        verify_result(beat_peaks, downbeat_peaks, result);
+    }
+    return result;
+}
+
+bool Postprocessor::is_peak(const std::vector<float>& logits, int i) const {
+    float value = logits[i];
+    if (!(value > threshold_)) {
+        return false;
+    }
+    int half_kernel = kernel_size_ / 2;
+    int last = std::min(static_cast<int>(logits.size()) - 1, i + half_kernel);
+    for (int j = std::max(0, i - half_kernel); j <= last; ++j) {
+        if (logits[j] > value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Postprocessor::update_peaks(const std::vector<float>& beat_logits,
+                                 const std::vector<float>& downbeat_logits,
+                                 int first_frame,
+                                 int last_frame,
+                                 std::vector<int>& beat_peaks,
+                                 std::vector<int>& downbeat_peaks) {
+    scratch_.reset();
+    update_track(beat_logits, first_frame, last_frame, beat_peaks);
+    update_track(downbeat_logits, first_frame, last_frame, downbeat_peaks);
+}
+
+// Frame i is a peak candidate if logits [i - half_kernel, i + half_kernel]
+// allow it, so only candidates within half_kernel of the change can differ.
+// deduplicate_peaks() merges a candidate into the running group if it is at
+// most dedup_width_ frames after the group's mean. The mean never exceeds the
+// group's last candidate, so a candidate more than dedup_width_ frames after
+// the previous one always starts a new group. The range is widened until both
+// of its ends are such gaps, so no group crosses them and each group's
+// (rounded mean) peak lies inside the range.
+void Postprocessor::update_track(const std::vector<float>& logits, int first_frame, int last_frame, std::vector<int>& peaks) {
+    int size = static_cast<int>(logits.size());
+    int half_kernel = kernel_size_ / 2;
+    int first = std::max(0, first_frame - half_kernel);
+    int last = std::min(size, last_frame + half_kernel);
+    if (first >= last) {
+        return;
+    }
+    for (bool widened = true; widened;) {
+        widened = false;
+        for (int j = first - 1; j >= std::max(0, first - dedup_width_); --j) {
+            if (is_peak(logits, j)) {
+                first = j;
+                widened = true;
+                break;
             }
-            if (beat_idx != -1) {
-                downbeat_time[i] = beat_time[beat_idx];
+        }
+    }
+    for (bool widened = true; widened;) {
+        widened = false;
+        for (int j = last; j < std::min(size, last + dedup_width_); ++j) {
+            if (is_peak(logits, j)) {
+                last = j + 1;
+                widened = true;
+                break;
             }
         }
     }
-    
-    // Remove duplicate downbeat times (if some db were moved to the same position)
-    std::sort(downbeat_time.begin(), downbeat_time.end());
-    downbeat_time.erase(std::unique(downbeat_time.begin(), downbeat_time.end()), downbeat_time.end());
 
-    return {beat_time, downbeat_time};
+    // Candidates of the range, with the sliding maximum of find_peaks()
+    ScratchVector<int> candidates{ArenaAllocator<int>(scratch_)};
+    candidates.reserve(last - first);
+    SlidingMax window(logits.data(), size, half_kernel, beat_queue_);
+    for (int j = std::max(0, first - half_kernel); j < std::min(size, first + half_kernel); ++j) {
+        window.push(j);
+    }
+    for (int i = first; i < last; ++i) {
+        if (i + half_kernel < size) {
+            window.push(i + half_kernel);
+        }
+        if (logits[i] > threshold_ && window.window_max(i) == logits[i]) {
+            candidates.push_back(i);
+        }
+    }
+    ScratchVector<int> merged = deduplicate_peaks(candidates, dedup_width_);
+
+    auto begin = std::lower_bound(peaks.begin(), peaks.end(), first);
+    auto end = std::lower_bound(begin, peaks.end(), last);
+    size_t offset = begin - peaks.begin();
+    peaks.erase(begin, end);
+    peaks.insert(peaks.begin() + offset, merged.begin(), merged.end());
 }
@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <cmath>
 #include <numeric>
+#include "ScratchArena.h"
 
 /**
  * @class Postprocessor
@@ -16,27 +17,97 @@
  */
 class Postprocessor {
 public:
-    Postprocessor(float fps = 50.0f);
+    /**
+     * @param fps Frames per second for time conversion
+     * @param kernel_size Width of the peak picking max filter (odd, in frames)
+     * @param threshold Minimum logit for a frame to count as a peak
+     * @param dedup_width Peaks at most this many frames apart are merged
+     * @param verify Additionally run the brute-force references (a full kernel
+     *        scan per frame, nearest-beat search per downbeat and set-based
+     *        beat counting) and throw std::runtime_error if the results differ
+     */
+    Postprocessor(float fps = 50.0f, int kernel_size = 7, float threshold = 0.0f, int dedup_width = 1,
+                  bool verify = false);
+
+    struct Result {
+        std::vector<float> beats;      // Beat timestamps in seconds
+        std::vector<float> downbeats;  // Downbeat timestamps, each moved onto a beat
+        std::vector<int> beat_counts;  // Position in the measure per beat (1 = downbeat)
+    };
 
     /**
      * @brief Process neural network logits to extract beat timestamps
      * @param beat_logits Raw beat predictions from neural network
      * @param downbeat_logits Raw downbeat predictions from neural network
-     * @return Pair of vectors containing beat and downbeat timestamps in seconds
+     * @return Beat and downbeat timestamps in seconds and the beat counts
      */
-    std::pair<std::vector<float>, std::vector<float>> process(
+    Result process(
         const std::vector<float>& beat_logits,
         const std::vector<float>& downbeat_logits
     );
 
+    /**
+     * @brief process() in two steps, for callers that keep the peaks of a piece
+     *
+     * pick_peaks() finds the deduplicated peak frames of both logit tracks and
+     * make_result() turns them into beats, downbeats and beat counts. After
+     * logit frames [first_frame, last_frame) changed, update_peaks() re-picks
+     * only the peaks those frames can reach (the kernel window, extended to
+     * whole deduplication groups), so pick_peaks() and update_peaks() give the
+     * same peaks for the same logits.
+     */
+    void pick_peaks(const std::vector<float>& beat_logits,
+                    const std::vector<float>& downbeat_logits,
+                    std::vector<int>& beat_peaks,
+                    std::vector<int>& downbeat_peaks);
+    void update_peaks(const std::vector<float>& beat_logits,
+                      const std::vector<float>& downbeat_logits,
+                      int first_frame,
+                      int last_frame,
+                      std::vector<int>& beat_peaks,
+                      std::vector<int>& downbeat_peaks);
+    Result make_result(const std::vector<int>& beat_peaks, const std::vector<int>& downbeat_peaks);
+
 private:
-    float fps_;  // Frames per second for time conversion
+    float fps_;          // Frames per second for time conversion
+    int kernel_size_;    // Peak picking window (7 in Python)
+    float threshold_;    // Peak logit threshold (0 in Python)
+    int dedup_width_;    // Peak merging distance (1 in Python)
+    bool verify_;        // Check against the brute-force references
+
+    // Sliding-max index queues reused across calls
+    std::vector<int> beat_queue_;
+    std::vector<int> downbeat_queue_;
+
+    // Peak lists and other intermediates of one process() call
+    ScratchArena scratch_;
 
     // Helper for peak deduplication
-    std::vector<int> deduplicate_peaks(const std::vector<int>& peaks, int width);
+    ScratchVector<int> deduplicate_peaks(const ScratchVector<int>& peaks, int width);
+
+    // Fused max_pool1d + threshold peak detection for both logit tracks
+    void find_peaks(const std::vector<float>& beat_logits,
+                    const std::vector<float>& downbeat_logits,
+                    ScratchVector<int>& beat_peaks,
+                    ScratchVector<int>& downbeat_peaks);
+
+    // True if frame i of logits is a peak (same test as find_peaks)
+    bool is_peak(const std::vector<float>& logits, int i) const;
+
+    // update_peaks() for one track
+    void update_track(const std::vector<float>& logits, int first_frame, int last_frame, std::vector<int>& peaks);
+
+    // Steps 3-5 of process(): times, downbeats moved onto beats, beat counts
+    template <typename Frames>
+    Result assemble(const Frames& beat_frame, const Frames& downbeat_frame);
 
-    // Helper for 1D max pooling (equivalent to PyTorch's max_pool1d)
-    std::vector<float> max_pool1d_equivalent(const std::vector<float>& input, int kernel_size, int stride, int padding);
+    // Compare find_peaks() and assemble() output with the brute-force references
+    void verify_peaks(const std::vector<float>& beat_logits,
+                      const std::vector<float>& downbeat_logits,
+                      const ScratchVector<int>& beat_peaks,
+                      const ScratchVector<int>& downbeat_peaks) const;
+    template <typename Frames>
+    void verify_result(const Frames& beat_frame, const Frames& downbeat_frame, const Result& result) const;
 };
 
 #endif // POSTPROCESSOR_H
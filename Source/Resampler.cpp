@@ -0,0 +1,327 @@
+#include "Resampler.h"
+#include "SimdKernels.h"
+#include "Downmix.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include "miniaudio.h"
+
+namespace {
+    // Frames downmixed per call into the linear resampler
+    constexpr size_t linear_block_frames = 4096;
+
+    // Compact the sinc history once this many samples are consumed
+    constexpr int64_t history_trim_samples = 1 << 14;
+
+    // Frames downmixed into the sinc history at a time, so a long input is
+    // never held as a whole (the history stays below two blocks plus the taps)
+    constexpr size_t sinc_block_frames = 1 << 14;
+
+    // Zeroth-order modified Bessel function of the first kind (Kaiser window)
+    double bessel_i0(double x) {
+        double sum = 1.0;
+        double term = 1.0;
+        double half_x = x / 2.0;
+        for (int k = 1; k < 64; ++k) {
+            term *= (half_x / k) * (half_x / k);
+            sum += term;
+            if (term < sum * 1e-17) {
+                break;
+            }
+        }
+        return sum;
+    }
+}
+
+struct Resampler::LinearState {
+    ma_resampler resampler;
+};
+
+Resampler::Resampler(int in_rate_, int out_rate_, int channels_, Quality quality_)
+    : in_rate(in_rate_), out_rate(out_rate_), channels(channels_), quality(quality_) {
+    if (in_rate <= 0 || out_rate <= 0 || channels < 1) {
+        throw std::runtime_error("Invalid resampler format: " + std::to_string(in_rate) + " Hz -> " +
+                                 std::to_string(out_rate) + " Hz, " + std::to_string(channels) + " channels");
+    }
+
+    int64_t divisor = std::gcd(static_cast<int64_t>(in_rate), static_cast<int64_t>(out_rate));
+    up = out_rate / divisor;
+    step = in_rate / divisor;
+
+    if (in_rate != out_rate) {
+        if (quality == Quality::Linear) {
+            linear = std::make_unique<LinearState>();
+            ma_resampler_config config = ma_resampler_config_init(
+                ma_format_f32, 1, (ma_uint32)in_rate, (ma_uint32)out_rate, ma_resample_algorithm_linear);
+            ma_result result = ma_resampler_init(&config, nullptr, &linear->resampler);
+            if (result != MA_SUCCESS) {
+                throw std::runtime_error(std::string("ma_resampler_init failed: ") + ma_result_description(result));
+            }
+        } else {
+            create_filter_bank();
+        }
+    }
+
+    reset();
+}
+
+Resampler::~Resampler() {
+    if (linear) {
+        ma_resampler_uninit(&linear->resampler, nullptr);
+    }
+}
+
+void Resampler::reset() {
+    if (linear) {
+        ma_resampler_reset(&linear->resampler);
+    }
+    // Input before the stream start is zero; the first output needs half_taps - 1 of it
+    history.assign(std::max(0, half_taps - 1), 0.0f);
+    history_base = -static_cast<int64_t>(history.size());
+    input_count = 0;
+    output_count = 0;
+}
+
+// Builds one Kaiser-windowed sinc filter per output phase. Output time t has
+// integer part i and fraction f; tap k multiplies input i - half_taps + 1 + k,
+// which lies k - half_taps + 1 - f input samples from t.
+void Resampler::create_filter_bank() {
+    double cutoff = rolloff * std::min(1.0, static_cast<double>(up) / static_cast<double>(step));
+    half_taps = static_cast<int>(std::ceil(zero_crossings / cutoff));
+    num_taps = 2 * half_taps;
+    num_phases = static_cast<int>(std::min<int64_t>(up, max_phases));
+
+    filter_bank.assign(static_cast<size_t>(num_phases) * num_taps, 0.0f);
+    double window_norm = 1.0 / bessel_i0(kaiser_beta);
+    std::vector<double> taps(num_taps);
+
+    for (int phase = 0; phase < num_phases; ++phase) {
+        double fraction = static_cast<double>(phase) / num_phases;
+        double sum = 0.0;
+        for (int k = 0; k < num_taps; ++k) {
+            double distance = k - half_taps + 1 - fraction;
+            double x = cutoff * distance;
+            double sinc = (x == 0.0) ? 1.0 : std::sin(std::numbers::pi * x) / (std::numbers::pi * x);
+            double u = distance / half_taps;
+            double window = bessel_i0(kaiser_beta * std::sqrt(std::max(0.0, 1.0 - u * u))) * window_norm;
+            taps[k] = cutoff * sinc * window;
+            sum += taps[k];
+        }
+
+        // Unity DC gain for every phase
+        float* row = filter_bank.data() + static_cast<size_t>(phase) * num_taps;
+        for (int k = 0; k < num_taps; ++k) {
+            row[k] = static_cast<float>(taps[k] / sum);
+        }
+    }
+}
+
+void Resampler::process(const float* input, size_t num_frames, std::vector<float>& output) {
+    process_samples(input, num_frames, output);
+}
+
+void Resampler::process(const int16_t* input, size_t num_frames, std::vector<float>& output) {
+    process_samples(input, num_frames, output);
+}
+
+void Resampler::process(const int32_t* input, size_t num_frames, std::vector<float>& output) {
+    process_samples(input, num_frames, output);
+}
+
+template <typename Sample>
+void Resampler::process_samples(const Sample* input, size_t num_frames, std::vector<float>& output) {
+    if (num_frames == 0) {
+        return;
+    }
+
+    if (in_rate == out_rate) {
+        size_t offset = output.size();
+        output.resize(offset + num_frames);
+        downmix_interleaved(input, num_frames, channels, output.data() + offset);
+        return;
+    }
+
+    if (quality == Quality::Sinc) {
+        process_sinc(input, num_frames, output);
+        return;
+    }
+
+    if constexpr (std::is_same_v<Sample, float>) {
+        if (channels == 1) {
+            process_linear(input, num_frames, output);
+            return;
+        }
+    }
+    // Convert and downmix block-wise so the mono copy stays in cache
+    mono_block.resize(linear_block_frames);
+    for (size_t first = 0; first < num_frames; first += linear_block_frames) {
+        size_t count = std::min(linear_block_frames, num_frames - first);
+        downmix_interleaved(input + first * channels, count, channels, mono_block.data());
+        process_linear(mono_block.data(), count, output);
+    }
+}
+
+void Resampler::process_linear(const float* mono, size_t num_frames, std::vector<float>& output) {
+    ma_uint64 remaining = num_frames;
+    while (remaining > 0) {
+        ma_uint64 expected = 0;
+        ma_resampler_get_expected_output_frame_count(&linear->resampler, remaining, &expected);
+
+        size_t offset = output.size();
+        output.resize(offset + expected + 16);
+        ma_uint64 frames_in = remaining;
+        ma_uint64 frames_out = expected + 16;
+        ma_result result = ma_resampler_process_pcm_frames(&linear->resampler, mono, &frames_in,
+                                                           output.data() + offset, &frames_out);
+        if (result != MA_SUCCESS) {
+            throw std::runtime_error(std::string("ma_resampler_process_pcm_frames failed: ") + ma_result_description(result));
+        }
+        output.resize(offset + frames_out);
+        if (frames_in == 0 && frames_out == 0) {
+            break;
+        }
+        mono += frames_in;
+        remaining -= frames_in;
+    }
+}
+
+template <typename Sample>
+void Resampler::process_sinc(const Sample* input, size_t num_frames, std::vector<float>& output) {
+    // Downmix straight into the filter history, one block at a time
+    for (size_t first = 0; first < num_frames; first += sinc_block_frames) {
+        size_t count = std::min(sinc_block_frames, num_frames - first);
+        size_t offset = history.size();
+        history.resize(offset + count);
+        downmix_interleaved(input + first * channels, count, channels, history.data() + offset);
+        input_count += static_cast<int64_t>(count);
+
+        produce_sinc(output, -1);
+    }
+}
+
+// Computes every output sample whose taps are all in history (up to output_limit if >= 0)
+void Resampler::produce_sinc(std::vector<float>& output, int64_t output_limit) {
+    int64_t history_end = history_base + static_cast<int64_t>(history.size());
+    for (;;) {
+        if (output_limit >= 0 && static_cast<int64_t>(output_count) >= output_limit) {
+            break;
+        }
+        int64_t first_input = static_cast<int64_t>(output_count) * step / up - half_taps + 1;
+        if (first_input + num_taps > history_end) {
+            break;
+        }
+        output.push_back(sinc_output(static_cast<int64_t>(output_count), history.data(), history_base));
+        ++output_count;
+    }
+
+    // Drop input no later output can reach
+    int64_t next_first = static_cast<int64_t>(output_count) * step / up - half_taps + 1;
+    int64_t consumed = std::min(next_first, history_end) - history_base;
+    if (consumed >= history_trim_samples) {
+        history.erase(history.begin(), history.begin() + consumed);
+        history_base += consumed;
+    }
+}
+
+float Resampler::sinc_output(int64_t n, const float* mono, int64_t base) const {
+    int64_t position = n * step;
+    int64_t first_input = position / up - half_taps + 1;
+    int64_t phase = position % up;
+    if (num_phases != up) {
+        phase = phase * num_phases / up;
+    }
+    const float* taps = filter_bank.data() + static_cast<size_t>(phase) * num_taps;
+    return dot_kernel(taps, mono + (first_input - base), num_taps);
+}
+
+void Resampler::flush(std::vector<float>& output) {
+    if (quality != Quality::Sinc || in_rate == out_rate) {
+        return;
+    }
+    // Input after the stream end is zero
+    history.resize(history.size() + half_taps, 0.0f);
+    int64_t total_output = (input_count * up + step - 1) / step;
+    produce_sinc(output, total_output);
+}
+
+// Output n reads input frames [n * step / up - half_taps + 1, n * step / up + half_taps]
+std::pair<int64_t, int64_t> Resampler::affected_outputs(int64_t first_frame, int64_t last_frame) const {
+    if (last_frame <= first_frame) {
+        return {0, 0};
+    }
+    if (in_rate == out_rate) {
+        return {first_frame, last_frame};
+    }
+    if (quality == Quality::Linear) {
+        int64_t first = first_frame * up / step - linear_tail_samples;
+        int64_t last = (last_frame * up + step - 1) / step + linear_tail_samples;
+        return {std::max<int64_t>(0, first), last};
+    }
+    int64_t lowest = first_frame - half_taps;
+    int64_t first = lowest > 0 ? (lowest * up + step - 1) / step : 0;
+    int64_t last = ((last_frame + half_taps - 1) * up - 1) / step + 1;
+    return {first, last};
+}
+
+int64_t Resampler::output_length(int64_t num_frames) const {
+    if (in_rate == out_rate) {
+        return num_frames;
+    }
+    if (quality == Quality::Linear) {
+        return -1;
+    }
+    return (num_frames * up + step - 1) / step;
+}
+
+void Resampler::process_range(const float* input, size_t num_frames, int64_t first_output, int64_t last_output,
+                              std::vector<float>& output) {
+    process_range_samples(input, num_frames, first_output, last_output, output);
+}
+
+void Resampler::process_range(const int16_t* input, size_t num_frames, int64_t first_output, int64_t last_output,
+                              std::vector<float>& output) {
+    process_range_samples(input, num_frames, first_output, last_output, output);
+}
+
+void Resampler::process_range(const int32_t* input, size_t num_frames, int64_t first_output, int64_t last_output,
+                              std::vector<float>& output) {
+    process_range_samples(input, num_frames, first_output, last_output, output);
+}
+
+template <typename Sample>
+void Resampler::process_range_samples(const Sample* input, size_t num_frames, int64_t first_output,
+                                      int64_t last_output, std::vector<float>& output) {
+    output.clear();
+    if (last_output <= first_output) {
+        return;
+    }
+    if (in_rate == out_rate) {
+        output.resize(last_output - first_output);
+        downmix_interleaved(input + first_output * channels, output.size(), channels, output.data());
+        return;
+    }
+    if (quality != Quality::Sinc) {
+        throw std::runtime_error("Resampler::process_range() needs the sinc resampler");
+    }
+
+    // Mono copy of the input the outputs read, zero outside the stream as in process() and flush()
+    int64_t base = first_output * step / up - half_taps + 1;
+    int64_t end = (last_output - 1) * step / up + half_taps + 1;
+    int64_t total = static_cast<int64_t>(num_frames);
+    mono_block.assign(end - base, 0.0f);
+    int64_t first = std::clamp<int64_t>(base, 0, total);
+    int64_t last = std::clamp<int64_t>(end, 0, total);
+    if (last > first) {
+        downmix_interleaved(input + first * channels, last - first, channels, mono_block.data() + (first - base));
+    }
+
+    output.resize(last_output - first_output);
+    for (int64_t n = first_output; n < last_output; ++n) {
+        output[n - first_output] = sinc_output(n, mono_block.data(), base);
+    }
+}
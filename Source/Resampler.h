@@ -0,0 +1,146 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+/**
+ * @class Resampler
+ * @brief Streaming downmix + sample rate conversion to the model's input format
+ *
+ * Takes interleaved float, int16 or int32 audio of any channel count in
+ * blocks of any size and appends mono samples at the output rate. The
+ * sample conversion and downmix are fused into the resampling pass, so no
+ * full-length float or mono copy is made. Filter state is kept
+ * between process() calls; reset() starts a new stream without rebuilding
+ * the filter.
+ *
+ * Two algorithms are available:
+ * - Linear: miniaudio's linear resampler (the historical default)
+ * - Sinc: polyphase Kaiser-windowed sinc filter with SIMD inner products,
+ *   close to the band-limited resampling of the Python reference
+ */
+class Resampler {
+public:
+    enum class Quality {
+        Linear,
+        Sinc
+    };
+
+    /**
+     * @param in_rate Sample rate of the input
+     * @param out_rate Sample rate of the output
+     * @param channels Channel count of the interleaved input (downmixed by averaging)
+     * @param quality Resampling algorithm
+     */
+    Resampler(int in_rate, int out_rate, int channels, Quality quality = Quality::Linear);
+    ~Resampler();
+
+    Resampler(const Resampler&) = delete;
+    Resampler& operator=(const Resampler&) = delete;
+
+    /**
+     * @brief Resamples one block
+     * @param input Interleaved input [num_frames][channels]
+     * @param num_frames Number of sample frames in input
+     * @param output Mono output samples are appended here
+     */
+    void process(const float* input, size_t num_frames, std::vector<float>& output);
+
+    // Integer PCM input, scaled by the format's full-scale value
+    void process(const int16_t* input, size_t num_frames, std::vector<float>& output);
+    void process(const int32_t* input, size_t num_frames, std::vector<float>& output);
+
+    /**
+     * @brief Appends the output still held back by the filter at end of stream
+     *
+     * After flush() the Sinc path has produced ceil(input * out_rate / in_rate)
+     * samples in total. The Linear path has no look-ahead and appends nothing.
+     */
+    void flush(std::vector<float>& output);
+
+    // Start a new stream, keeping the filter tables
+    void reset();
+
+    /**
+     * @brief Output samples [first, last) that depend on input frames [first_frame, last_frame)
+     *
+     * Exact for Sinc (the filter is finite). The Linear path runs miniaudio's
+     * recursive low-pass filter, whose tail is cut after linear_tail_samples.
+     * The range is not clamped to the output length.
+     */
+    std::pair<int64_t, int64_t> affected_outputs(int64_t first_frame, int64_t last_frame) const;
+
+    // Number of samples process() and flush() produce for num_frames input
+    // frames in total (Sinc and equal rates only; -1 for Linear)
+    int64_t output_length(int64_t num_frames) const;
+
+    /**
+     * @brief Computes output samples [first_output, last_output) of the whole stream
+     *
+     * Gives the same samples as process() and flush() on all of input, but
+     * only reads the input frames they depend on, e.g. to recompute an edited
+     * region. Sinc and equal rates only; independent of the stream state.
+     * @param input Interleaved input [num_frames][channels] of the whole stream
+     * @param output Replaced with last_output - first_output mono samples
+     */
+    void process_range(const float* input, size_t num_frames, int64_t first_output, int64_t last_output,
+                       std::vector<float>& output);
+    void process_range(const int16_t* input, size_t num_frames, int64_t first_output, int64_t last_output,
+                       std::vector<float>& output);
+    void process_range(const int32_t* input, size_t num_frames, int64_t first_output, int64_t last_output,
+                       std::vector<float>& output);
+
+    int get_in_rate() const { return in_rate; }
+    int get_out_rate() const { return out_rate; }
+    int get_channels() const { return channels; }
+    Quality get_quality() const { return quality; }
+
+private:
+    int in_rate;
+    int out_rate;
+    int channels;
+    Quality quality;
+
+    // Reduced conversion ratio: output sample n lies at input time n * step / up
+    int64_t up = 1;
+    int64_t step = 1;
+
+    // Linear path (miniaudio resampler state, opaque here)
+    struct LinearState;
+    std::unique_ptr<LinearState> linear;
+    std::vector<float> mono_block;                 // Downmixed block fed to the linear resampler
+    static constexpr int64_t linear_tail_samples = 256; // Reach of the low-pass filter in affected_outputs()
+
+    // Sinc path
+    static constexpr int max_phases = 2048;        // Above this, phases are quantized
+    static constexpr int zero_crossings = 16;      // Sinc lobes on each side at the cutoff
+    static constexpr double kaiser_beta = 8.6;     // Window shape (~-90 dB stopband)
+    static constexpr double rolloff = 0.94;        // Cutoff relative to the lower Nyquist rate
+    int num_phases = 1;
+    int half_taps = 0;                             // Taps on each side of the output time
+    int num_taps = 0;                              // 2 * half_taps
+    std::vector<float> filter_bank;                // [num_phases][num_taps]
+    std::vector<float> history;                    // Mono input from input index history_base on
+    int64_t history_base = 0;
+    int64_t input_count = 0;                       // Input frames received in this stream
+    uint64_t output_count = 0;                     // Output samples produced in this stream
+
+    void create_filter_bank();
+    template <typename Sample>
+    void process_samples(const Sample* input, size_t num_frames, std::vector<float>& output);
+    template <typename Sample>
+    void process_range_samples(const Sample* input, size_t num_frames, int64_t first_output, int64_t last_output,
+                               std::vector<float>& output);
+    template <typename Sample>
+    void process_sinc(const Sample* input, size_t num_frames, std::vector<float>& output);
+    void produce_sinc(std::vector<float>& output, int64_t output_limit);
+    // Output sample n from mono input that starts at input index base
+    float sinc_output(int64_t n, const float* mono, int64_t base) const;
+    void process_linear(const float* mono, size_t num_frames, std::vector<float>& output);
+};
+
+#endif // RESAMPLER_H
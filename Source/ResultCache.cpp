@@ -0,0 +1,327 @@
+#include "ResultCache.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+#include <functional>
+#include <cstring>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace BeatThis {
+
+namespace {
+    // XXH64 (https://github.com/Cyan4973/xxHash), single-shot variant
+    constexpr uint64_t prime1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t prime3 = 0x165667B19E3779F9ull;
+    constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ull;
+    constexpr uint64_t prime5 = 0x27D4EB2F165667C5ull;
+
+    inline uint64_t rotl(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint64_t read64(const unsigned char* p) {
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline uint32_t read32(const unsigned char* p) {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * prime2;
+        acc = rotl(acc, 31);
+        return acc * prime1;
+    }
+
+    inline uint64_t merge_round(uint64_t acc, uint64_t value) {
+        acc ^= round(0, value);
+        return acc * prime1 + prime4;
+    }
+
+    // Cache file layout (native byte order): magic, version, flags, key, then
+    // the array sizes followed by the arrays themselves. Version 1 files have
+    // no flags; their logits count as stored if there are any.
+    constexpr char file_magic[4] = {'B', 'T', 'R', 'C'};
+    constexpr uint32_t file_version = 2;
+    constexpr uint32_t flag_has_logits = 1;
+
+    long long process_id() {
+#ifdef _WIN32
+        return _getpid();
+#else
+        return static_cast<long long>(getpid());
+#endif
+    }
+    static_assert(sizeof(int) == sizeof(float), "beat counts are stored as 32-bit values");
+
+    template <typename T>
+    void write_array(std::ofstream& out, const std::vector<T>& values) {
+        out.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+    }
+
+    template <typename T>
+    bool read_array(std::ifstream& in, std::vector<T>& values, uint64_t count) {
+        values.resize(static_cast<size_t>(count));
+        in.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+        return static_cast<bool>(in);
+    }
+}
+
+ResultCache::ResultCache(const CacheConfig& config_) : config(config_) {
+    if (!config.directory.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(config.directory, ec);
+        if (ec) {
+            throw std::runtime_error("Could not create cache directory '" + config.directory + "': " + ec.message());
+        }
+    }
+}
+
+uint64_t ResultCache::hash_bytes(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + prime1 + prime2;
+        uint64_t v2 = seed + prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - prime1;
+        const unsigned char* limit = end - 32;
+        do {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge_round(h, v1);
+        h = merge_round(h, v2);
+        h = merge_round(h, v3);
+        h = merge_round(h, v4);
+    } else {
+        h = seed + prime5;
+    }
+    h += static_cast<uint64_t>(size);
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * prime1 + prime4;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(read32(p)) * prime1;
+        h = rotl(h, 23) * prime2 + prime3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= static_cast<uint64_t>(*p) * prime5;
+        h = rotl(h, 11) * prime1;
+    }
+
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+ResultCache::Key ResultCache::make_key(const float* audio, size_t num_samples, uint64_t context_hash) {
+    return make_key(audio, sizeof(float), num_samples, context_hash);
+}
+
+ResultCache::Key ResultCache::make_key(const void* audio, size_t sample_bytes, size_t num_samples, uint64_t context_hash) {
+    Key key;
+    key.audio_hash = hash_bytes(audio, num_samples * sample_bytes);
+    key.context_hash = context_hash;
+    key.num_samples = num_samples;
+    return key;
+}
+
+std::optional<ResultCache::Entry> ResultCache::find(const Key& key, bool require_logits) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it != index.end() && (it->second->second.has_logits || !require_logits)) {
+            lru.splice(lru.begin(), lru, it->second);
+            ++counters.hits;
+            return it->second->second;
+        }
+    }
+
+    // Disk lookup runs without the lock; a concurrent insert of the same key is harmless
+    Entry entry;
+    if (!config.directory.empty() && load_entry(key, entry) && (entry.has_logits || !require_logits)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++counters.hits;
+        ++counters.disk_hits;
+        insert_locked(key, entry);
+        return entry;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ++counters.misses;
+    return std::nullopt;
+}
+
+void ResultCache::insert(const Key& key, Entry entry) {
+    entry.result.timings.reset();
+    entry.has_logits = config.store_logits;
+    if (!config.store_logits) {
+        entry.beat_logits.clear();
+        entry.downbeat_logits.clear();
+    }
+    if (!config.directory.empty()) {
+        store_entry(key, entry);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    insert_locked(key, std::move(entry));
+}
+
+void ResultCache::insert_locked(const Key& key, Entry entry) {
+    if (config.max_entries == 0) {
+        return;
+    }
+    auto it = index.find(key);
+    if (it != index.end()) {
+        it->second->second = std::move(entry);
+        lru.splice(lru.begin(), lru, it->second);
+        return;
+    }
+    lru.emplace_front(key, std::move(entry));
+    index[key] = lru.begin();
+    while (lru.size() > config.max_entries) {
+        index.erase(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+void ResultCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    index.clear();
+    lru.clear();
+}
+
+ResultCache::Stats ResultCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats result = counters;
+    result.entries = lru.size();
+    return result;
+}
+
+std::string ResultCache::entry_path(const Key& key) const {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx%016llx.beatcache",
+                  static_cast<unsigned long long>(key.audio_hash),
+                  static_cast<unsigned long long>(key.context_hash));
+    return (std::filesystem::path(config.directory) / name).string();
+}
+
+bool ResultCache::load_entry(const Key& key, Entry& entry) const {
+    std::ifstream in(entry_path(key), std::ios::binary);
+    if (!in) {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t flags = 0;
+    Key stored;
+    uint64_t sizes[5];
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (version == file_version) {
+        in.read(reinterpret_cast<char*>(&flags), sizeof(flags));
+    }
+    in.read(reinterpret_cast<char*>(&stored.audio_hash), sizeof(stored.audio_hash));
+    in.read(reinterpret_cast<char*>(&stored.context_hash), sizeof(stored.context_hash));
+    in.read(reinterpret_cast<char*>(&stored.num_samples), sizeof(stored.num_samples));
+    in.read(reinterpret_cast<char*>(sizes), sizeof(sizes));
+    if (!in || std::memcmp(magic, file_magic, sizeof(magic)) != 0 || (version != file_version && version != 1) ||
+        !(stored == key)) {
+        return false;
+    }
+    entry.has_logits = version == 1 ? sizes[3] > 0 : (flags & flag_has_logits) != 0;
+
+    // Sizes are bounded by the file itself, so a corrupt header cannot cause huge allocations
+    std::error_code ec;
+    uint64_t file_size = std::filesystem::file_size(entry_path(key), ec);
+    if (ec) {
+        return false;
+    }
+    uint64_t payload = 0;
+    for (uint64_t count : sizes) {
+        if (count > file_size) {
+            return false;
+        }
+        payload += count * sizeof(float); // int and float have the same size
+    }
+    if (payload > file_size) {
+        return false;
+    }
+
+    return read_array(in, entry.result.beats, sizes[0]) &&
+           read_array(in, entry.result.downbeats, sizes[1]) &&
+           read_array(in, entry.result.beat_counts, sizes[2]) &&
+           read_array(in, entry.beat_logits, sizes[3]) &&
+           read_array(in, entry.downbeat_logits, sizes[4]);
+}
+
+void ResultCache::store_entry(const Key& key, const Entry& entry) const {
+    // Write to a temporary file and rename it, so readers never see a partial entry
+    std::string path = entry_path(key);
+    // Unique per process and thread, as several processes may share one directory
+    std::string temp_path = path + ".tmp" + std::to_string(process_id()) + "_" +
+                            std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Could not write cache entry: " << temp_path << std::endl;
+            return;
+        }
+        uint64_t sizes[5] = {entry.result.beats.size(), entry.result.downbeats.size(), entry.result.beat_counts.size(),
+                             entry.beat_logits.size(), entry.downbeat_logits.size()};
+        out.write(file_magic, sizeof(file_magic));
+        uint32_t flags = entry.has_logits ? flag_has_logits : 0;
+        out.write(reinterpret_cast<const char*>(&file_version), sizeof(file_version));
+        out.write(reinterpret_cast<const char*>(&flags), sizeof(flags));
+        out.write(reinterpret_cast<const char*>(&key.audio_hash), sizeof(key.audio_hash));
+        out.write(reinterpret_cast<const char*>(&key.context_hash), sizeof(key.context_hash));
+        out.write(reinterpret_cast<const char*>(&key.num_samples), sizeof(key.num_samples));
+        out.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+        write_array(out, entry.result.beats);
+        write_array(out, entry.result.downbeats);
+        write_array(out, entry.result.beat_counts);
+        write_array(out, entry.beat_logits);
+        write_array(out, entry.downbeat_logits);
+        if (!out) {
+            std::cerr << "Could not write cache entry: " << temp_path << std::endl;
+            out.close();
+            std::error_code ec;
+            std::filesystem::remove(temp_path, ec);
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+    }
+}
+
+} // namespace BeatThis
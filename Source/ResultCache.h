@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <optional>
+#include <cstddef>
+#include <cstdint>
+
+#include "beat_this_api.h"
+
+namespace BeatThis {
+
+struct CacheConfig {
+    size_t max_entries = 1024;  // In-memory entries kept (least recently used are evicted)
+    std::string directory;      // If set, entries are also stored here and survive restarts
+    bool store_logits = false;  // Keep the raw beat/downbeat logits next to each result
+};
+
+/**
+ * Thread-safe cache of analysis results keyed by the content of the audio.
+ *
+ * Keys combine a 64-bit hash of the PCM samples with the sample format and a
+ * context hash covering the model and the analysis parameters, so a changed
+ * model or resampler never returns stale results. One cache can be shared by
+ * any number of analyzers (see BeatThis::set_cache()).
+ *
+ * Entries live in memory with LRU eviction and, if CacheConfig::directory is
+ * set, in one small binary file per entry. Disk entries found on a memory
+ * miss are loaded back into memory.
+ */
+class ResultCache {
+public:
+    struct Key {
+        uint64_t audio_hash = 0;    // Hash of the interleaved samples
+        uint64_t context_hash = 0;  // Model, parameters and sample format
+        uint64_t num_samples = 0;
+
+        bool operator==(const Key& other) const {
+            return audio_hash == other.audio_hash && context_hash == other.context_hash &&
+                   num_samples == other.num_samples;
+        }
+    };
+
+    struct Entry {
+        BeatResult result;                 // timings are never stored
+        std::vector<float> beat_logits;    // Empty unless CacheConfig::store_logits
+        std::vector<float> downbeat_logits;
+        bool has_logits = false;           // Stored by a cache with store_logits (set by insert())
+    };
+
+    struct Stats {
+        size_t hits = 0;
+        size_t disk_hits = 0;  // Included in hits
+        size_t misses = 0;
+        size_t entries = 0;
+    };
+
+    explicit ResultCache(const CacheConfig& config = CacheConfig());
+
+    // Builds a key; context_hash identifies the model and the analysis settings
+    static Key make_key(const float* audio, size_t num_samples, uint64_t context_hash);
+
+    // Key for audio in any sample format; the format must be part of context_hash
+    static Key make_key(const void* audio, size_t sample_bytes, size_t num_samples, uint64_t context_hash);
+
+    // Fast non-cryptographic 64-bit hash (XXH64)
+    static uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0);
+
+    // With require_logits, entries stored without logits count as misses
+    std::optional<Entry> find(const Key& key, bool require_logits = false);
+    void insert(const Key& key, Entry entry);
+
+    // Drops the in-memory entries (disk entries are kept)
+    void clear();
+
+    Stats stats() const;
+    const CacheConfig& get_config() const { return config; }
+
+private:
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return static_cast<size_t>(key.audio_hash ^ (key.context_hash * 0x9E3779B97F4A7C15ull) ^ key.num_samples);
+        }
+    };
+
+    using LruList = std::list<std::pair<Key, Entry>>;
+
+    CacheConfig config;
+    mutable std::mutex mutex;
+    LruList lru;  // Most recently used first
+    std::unordered_map<Key, LruList::iterator, KeyHash> index;
+    Stats counters;
+
+    void insert_locked(const Key& key, Entry entry);
+    std::string entry_path(const Key& key) const;
+    bool load_entry(const Key& key, Entry& entry) const;
+    void store_entry(const Key& key, const Entry& entry) const;
+};
+
+} // namespace BeatThis
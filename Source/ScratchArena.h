@@ -0,0 +1,127 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <algorithm>
+
+/**
+ * @class ScratchArena
+ * @brief Bump allocator for the temporary buffers of one call
+ *
+ * allocate() hands out aligned pieces of one block and reset() releases all
+ * of them at once. A call that needs more than the block holds continues in
+ * overflow blocks; the next reset() replaces them with a single block of the
+ * high-water mark, so repeated calls of similar size make no system
+ * allocations at all. Not thread-safe: every pipeline stage instance owns
+ * its own arena, and resets it when a call starts.
+ */
+class ScratchArena {
+public:
+    static constexpr std::size_t alignment = 64;
+
+    ScratchArena() = default;
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+    ScratchArena(ScratchArena&&) noexcept = default;
+    ScratchArena& operator=(ScratchArena&&) noexcept = default;
+
+    // Returns bytes aligned to `align` (at most 64), valid until the next reset()
+    void* allocate(std::size_t bytes, std::size_t align = alignof(std::max_align_t)) {
+        std::size_t offset = (used_ + align - 1) & ~(align - 1);
+        if (blocks_.empty() || offset + bytes > blocks_.back().size) {
+            add_block(bytes);
+            offset = 0;
+        }
+        // Padding counts towards the high-water mark, so the merged block fits the same call
+        total_used_ += offset + bytes - used_;
+        used_ = offset + bytes;
+        high_water_ = std::max(high_water_, total_used_);
+        return blocks_.back().data.get() + offset;
+    }
+
+    template <typename T>
+    T* allocate_array(std::size_t count) {
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // Releases every allocation, merging overflow blocks into one block of the high-water mark
+    void reset() {
+        if (blocks_.size() > 1) {
+            blocks_.clear();
+            add_block(high_water_);
+        }
+        used_ = 0;
+        total_used_ = 0;
+    }
+
+    // Bytes reserved from the system
+    std::size_t capacity() const {
+        std::size_t bytes = 0;
+        for (const auto& block : blocks_) {
+            bytes += block.size;
+        }
+        return bytes;
+    }
+
+    // Largest number of bytes allocated between two resets
+    std::size_t high_water_mark() const { return high_water_; }
+
+private:
+    struct AlignedDelete {
+        void operator()(std::byte* p) const noexcept { ::operator delete[](p, std::align_val_t(alignment)); }
+    };
+
+    struct Block {
+        std::unique_ptr<std::byte[], AlignedDelete> data;
+        std::size_t size;
+    };
+
+    std::vector<Block> blocks_;
+    std::size_t used_ = 0;        // Bytes used in the last block
+    std::size_t total_used_ = 0;  // Bytes allocated (with padding) since the last reset()
+    std::size_t high_water_ = 0;
+
+    void add_block(std::size_t min_bytes) {
+        // Grow geometrically so a growing call needs few overflow blocks
+        std::size_t size = std::max({min_bytes, blocks_.empty() ? std::size_t(4096) : blocks_.back().size * 2,
+                                     high_water_});
+        size = (size + alignment - 1) & ~(alignment - 1);
+        blocks_.push_back({std::unique_ptr<std::byte[], AlignedDelete>(
+                               static_cast<std::byte*>(::operator new[](size, std::align_val_t(alignment)))),
+                           size});
+        used_ = 0;
+    }
+};
+
+/**
+ * @brief Standard allocator drawing from a ScratchArena
+ *
+ * deallocate() is a no-op; memory returns to the arena on its next reset(),
+ * so containers using it must not outlive the call they belong to.
+ */
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    ScratchArena* arena;
+
+    explicit ArenaAllocator(ScratchArena& arena_) noexcept : arena(&arena_) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+    T* allocate(std::size_t n) { return arena->allocate_array<T>(n); }
+    void deallocate(T*, std::size_t) noexcept {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const noexcept { return arena != other.arena; }
+};
+
+template <typename T>
+using ScratchVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif // SCRATCH_ARENA_H
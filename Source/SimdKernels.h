@@ -0,0 +1,271 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <bit>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/**
+ * @brief Vector kernels shared by the Mel frontend, the resampler and the click renderer
+ *
+ * Each kernel has AVX2, SSE2 and NEON paths selected at compile time and a
+ * scalar tail, so any length and alignment is accepted.
+ */
+
+// Computes the dot product of a[0..n) and b[0..n)
+inline float dot_kernel(const float* a, const float* b, int n) {
+    int k = 0;
+    float sum = 0.0f;
+#if defined(__AVX2__)
+    __m256 acc = _mm256_setzero_ps();
+    for (; k + 8 <= n; k += 8) {
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + k), _mm256_loadu_ps(b + k)));
+    }
+    __m128 acc4 = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    acc4 = _mm_add_ps(acc4, _mm_movehl_ps(acc4, acc4));
+    acc4 = _mm_add_ss(acc4, _mm_shuffle_ps(acc4, acc4, _MM_SHUFFLE(1, 1, 1, 1)));
+    sum = _mm_cvtss_f32(acc4);
+#elif defined(__SSE2__) || defined(_M_X64)
+    __m128 acc = _mm_setzero_ps();
+    for (; k + 4 <= n; k += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + k), _mm_loadu_ps(b + k)));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 1, 1, 1)));
+    sum = _mm_cvtss_f32(acc);
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (; k + 4 <= n; k += 4) {
+        acc = vmlaq_f32(acc, vld1q_f32(a + k), vld1q_f32(b + k));
+    }
+    sum = vaddvq_f32(acc);
+#endif
+    for (; k < n; ++k) {
+        sum += a[k] * b[k];
+    }
+    return sum;
+}
+
+// log(1 + x) for one finite x >= 0; the scalar path of log1p_kernel.
+// u = 1 + x is split into m * 2^e with m in [sqrt(1/2), sqrt(2)), log(m) is
+// a degree-9 minimax polynomial (Cephes logf) and the rounding error of u is
+// added back as (x - (u - 1)) / u, which keeps small x accurate.
+inline float log1p_approx(float x) {
+    float u = 1.0f + x;
+    uint32_t bits = std::bit_cast<uint32_t>(u);
+    float e = static_cast<float>(static_cast<int>(bits >> 23) - 126);
+    float m = std::bit_cast<float>((bits & 0x007fffffu) | 0x3f000000u);  // [0.5, 1)
+    if (m < 0.707106781f) {
+        e -= 1.0f;
+        m = m + m - 1.0f;
+    } else {
+        m = m - 1.0f;
+    }
+    float z = m * m;
+    float y = 7.0376836292e-2f;
+    y = y * m - 1.1514610310e-1f;
+    y = y * m + 1.1676998740e-1f;
+    y = y * m - 1.2420140846e-1f;
+    y = y * m + 1.4249322787e-1f;
+    y = y * m - 1.6668057665e-1f;
+    y = y * m + 2.0000714765e-1f;
+    y = y * m - 2.4999993993e-1f;
+    y = y * m + 3.3333331174e-1f;
+    y = y * m * z;
+    y += -2.12194440e-4f * e;
+    y += -0.5f * z;
+    float log_u = m + y + 0.693359375f * e;
+    return log_u + (x - (u - 1.0f)) / u;
+}
+
+// Replaces values[0..n) by log(1 + values[k]). Inputs must be finite and
+// >= 0. Over all floats in [0, 1e6] the relative error is below 1.3e-7
+// (about one float ulp; std::log1p in float is within half an ulp).
+inline void log1p_kernel(float* values, int n) {
+    int k = 0;
+#if defined(__AVX2__)
+    const __m256 one = _mm256_set1_ps(1.0f);
+    for (; k + 8 <= n; k += 8) {
+        __m256 x = _mm256_loadu_ps(values + k);
+        __m256 u = _mm256_add_ps(one, x);
+        __m256i bits = _mm256_castps_si256(u);
+        __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+        __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)),
+                                                       _mm256_set1_epi32(0x3f000000)));
+        __m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(0.707106781f), _CMP_LT_OQ);
+        e = _mm256_sub_ps(e, _mm256_and_ps(one, small));
+        m = _mm256_add_ps(_mm256_sub_ps(m, one), _mm256_and_ps(m, small));
+        __m256 z = _mm256_mul_ps(m, m);
+        __m256 y = _mm256_set1_ps(7.0376836292e-2f);
+        y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(-1.1514610310e-1f));
+        y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(1.1676998740e-1f));
+        y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(-1.2420140846e-1f));
+        y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(1.4249322787e-1f));
+        y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(-1.6668057665e-1f));
+        y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(2.0000714765e-1f));
+        y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(-2.4999993993e-1f));
+        y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(3.3333331174e-1f));
+        y = _mm256_mul_ps(_mm256_mul_ps(y, m), z);
+        y = _mm256_add_ps(y, _mm256_mul_ps(_mm256_set1_ps(-2.12194440e-4f), e));
+        y = _mm256_add_ps(y, _mm256_mul_ps(_mm256_set1_ps(-0.5f), z));
+        __m256 log_u = _mm256_add_ps(_mm256_add_ps(m, y), _mm256_mul_ps(_mm256_set1_ps(0.693359375f), e));
+        __m256 correction = _mm256_div_ps(_mm256_sub_ps(x, _mm256_sub_ps(u, one)), u);
+        _mm256_storeu_ps(values + k, _mm256_add_ps(log_u, correction));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; k + 4 <= n; k += 4) {
+        __m128 x = _mm_loadu_ps(values + k);
+        __m128 u = _mm_add_ps(one, x);
+        __m128i bits = _mm_castps_si128(u);
+        __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+        __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)),
+                                                 _mm_set1_epi32(0x3f000000)));
+        __m128 small = _mm_cmplt_ps(m, _mm_set1_ps(0.707106781f));
+        e = _mm_sub_ps(e, _mm_and_ps(one, small));
+        m = _mm_add_ps(_mm_sub_ps(m, one), _mm_and_ps(m, small));
+        __m128 z = _mm_mul_ps(m, m);
+        __m128 y = _mm_set1_ps(7.0376836292e-2f);
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(-1.1514610310e-1f));
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(1.1676998740e-1f));
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(-1.2420140846e-1f));
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(1.4249322787e-1f));
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(-1.6668057665e-1f));
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(2.0000714765e-1f));
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(-2.4999993993e-1f));
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(3.3333331174e-1f));
+        y = _mm_mul_ps(_mm_mul_ps(y, m), z);
+        y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(-2.12194440e-4f), e));
+        y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(-0.5f), z));
+        __m128 log_u = _mm_add_ps(_mm_add_ps(m, y), _mm_mul_ps(_mm_set1_ps(0.693359375f), e));
+        __m128 correction = _mm_div_ps(_mm_sub_ps(x, _mm_sub_ps(u, one)), u);
+        _mm_storeu_ps(values + k, _mm_add_ps(log_u, correction));
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    for (; k + 4 <= n; k += 4) {
+        float32x4_t x = vld1q_f32(values + k);
+        float32x4_t u = vaddq_f32(one, x);
+        uint32x4_t bits = vreinterpretq_u32_f32(u);
+        float32x4_t e = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(bits, 23)), vdupq_n_s32(126)));
+        float32x4_t m = vreinterpretq_f32_u32(vorrq_u32(vandq_u32(bits, vdupq_n_u32(0x007fffff)),
+                                                        vdupq_n_u32(0x3f000000)));
+        uint32x4_t small = vcltq_f32(m, vdupq_n_f32(0.707106781f));
+        e = vsubq_f32(e, vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(one), small)));
+        m = vaddq_f32(vsubq_f32(m, one), vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(m), small)));
+        float32x4_t z = vmulq_f32(m, m);
+        float32x4_t y = vdupq_n_f32(7.0376836292e-2f);
+        y = vaddq_f32(vmulq_f32(y, m), vdupq_n_f32(-1.1514610310e-1f));
+        y = vaddq_f32(vmulq_f32(y, m), vdupq_n_f32(1.1676998740e-1f));
+        y = vaddq_f32(vmulq_f32(y, m), vdupq_n_f32(-1.2420140846e-1f));
+        y = vaddq_f32(vmulq_f32(y, m), vdupq_n_f32(1.4249322787e-1f));
+        y = vaddq_f32(vmulq_f32(y, m), vdupq_n_f32(-1.6668057665e-1f));
+        y = vaddq_f32(vmulq_f32(y, m), vdupq_n_f32(2.0000714765e-1f));
+        y = vaddq_f32(vmulq_f32(y, m), vdupq_n_f32(-2.4999993993e-1f));
+        y = vaddq_f32(vmulq_f32(y, m), vdupq_n_f32(3.3333331174e-1f));
+        y = vmulq_f32(vmulq_f32(y, m), z);
+        y = vaddq_f32(y, vmulq_f32(vdupq_n_f32(-2.12194440e-4f), e));
+        y = vaddq_f32(y, vmulq_f32(vdupq_n_f32(-0.5f), z));
+        float32x4_t log_u = vaddq_f32(vaddq_f32(m, y), vmulq_f32(vdupq_n_f32(0.693359375f), e));
+        float32x4_t correction = vdivq_f32(vsubq_f32(x, vsubq_f32(u, one)), u);
+        vst1q_f32(values + k, vaddq_f32(log_u, correction));
+    }
+#endif
+    for (; k < n; ++k) {
+        values[k] = log1p_approx(values[k]);
+    }
+}
+
+// Adds in[0..n) to out[0..n)
+inline void add_kernel(float* out, const float* in, int n) {
+    int k = 0;
+#if defined(__AVX2__)
+    for (; k + 8 <= n; k += 8) {
+        _mm256_storeu_ps(out + k, _mm256_add_ps(_mm256_loadu_ps(out + k), _mm256_loadu_ps(in + k)));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    for (; k + 4 <= n; k += 4) {
+        _mm_storeu_ps(out + k, _mm_add_ps(_mm_loadu_ps(out + k), _mm_loadu_ps(in + k)));
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    for (; k + 4 <= n; k += 4) {
+        vst1q_f32(out + k, vaddq_f32(vld1q_f32(out + k), vld1q_f32(in + k)));
+    }
+#endif
+    for (; k < n; ++k) {
+        out[k] += in[k];
+    }
+}
+
+// Writes in[k] * scale to out[k] for k in [0, n); in and out may be the same
+inline void scale_kernel(float* out, const float* in, float scale, int n) {
+    int k = 0;
+#if defined(__AVX2__)
+    const __m256 factor = _mm256_set1_ps(scale);
+    for (; k + 8 <= n; k += 8) {
+        _mm256_storeu_ps(out + k, _mm256_mul_ps(_mm256_loadu_ps(in + k), factor));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 factor = _mm_set1_ps(scale);
+    for (; k + 4 <= n; k += 4) {
+        _mm_storeu_ps(out + k, _mm_mul_ps(_mm_loadu_ps(in + k), factor));
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    const float32x4_t factor = vdupq_n_f32(scale);
+    for (; k + 4 <= n; k += 4) {
+        vst1q_f32(out + k, vmulq_f32(vld1q_f32(in + k), factor));
+    }
+#endif
+    for (; k < n; ++k) {
+        out[k] = in[k] * scale;
+    }
+}
+
+// Returns the largest |values[k]| for k in [0, n), ignoring NaNs (0 if n is 0)
+inline float max_abs_kernel(const float* values, int n) {
+    int k = 0;
+    float max_value = 0.0f;
+#if defined(__AVX2__)
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 acc = _mm256_setzero_ps();
+    for (; k + 8 <= n; k += 8) {
+        // maxps returns its second operand if either is NaN
+        acc = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(values + k), abs_mask), acc);
+    }
+    __m128 acc4 = _mm_max_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    acc4 = _mm_max_ps(acc4, _mm_movehl_ps(acc4, acc4));
+    acc4 = _mm_max_ss(acc4, _mm_shuffle_ps(acc4, acc4, _MM_SHUFFLE(1, 1, 1, 1)));
+    max_value = _mm_cvtss_f32(acc4);
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 acc = _mm_setzero_ps();
+    for (; k + 4 <= n; k += 4) {
+        acc = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(values + k), abs_mask), acc);
+    }
+    acc = _mm_max_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_max_ss(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 1, 1, 1)));
+    max_value = _mm_cvtss_f32(acc);
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (; k + 4 <= n; k += 4) {
+        acc = vmaxnmq_f32(acc, vabsq_f32(vld1q_f32(values + k)));
+    }
+    max_value = vmaxnmvq_f32(acc);
+#endif
+    for (; k < n; ++k) {
+        float value = values[k] < 0.0f ? -values[k] : values[k];
+        if (value > max_value) {
+            max_value = value;
+        }
+    }
+    return max_value;
+}
+
+#endif // SIMD_KERNELS_H
@@ -0,0 +1,86 @@
+#ifndef SPECTROGRAM_H
+#define SPECTROGRAM_H
+
+#include <vector>
+#include <cstddef>
+#include <new>
+
+/**
+ * @brief Minimal allocator returning memory aligned to `Alignment` bytes
+ *
+ * Used so that spectrogram rows start on cache line boundaries and can be
+ * handed to SIMD kernels and ONNX Runtime tensors without realignment.
+ */
+template <typename T, std::size_t Alignment>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() noexcept = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+};
+
+/**
+ * @class Spectrogram
+ * @brief Contiguous row-major spectrogram storage [frames][bins]
+ *
+ * All frames live in a single 64-byte aligned allocation, so a range of
+ * frames can be passed to ONNX Runtime as a tensor without copying.
+ */
+class Spectrogram {
+public:
+    static constexpr std::size_t alignment = 64;
+
+    Spectrogram() = default;
+    Spectrogram(std::size_t num_frames, std::size_t num_bins) { resize(num_frames, num_bins); }
+
+    /**
+     * @brief Resizes the spectrogram, keeping the allocation if it is large enough
+     * @note Existing contents are not preserved in any particular layout
+     */
+    void resize(std::size_t num_frames, std::size_t num_bins) {
+        num_frames_ = num_frames;
+        num_bins_ = num_bins;
+        data_.resize(num_frames * num_bins);
+    }
+
+    void clear() { resize(0, num_bins_); }
+
+    std::size_t num_frames() const { return num_frames_; }
+    std::size_t num_bins() const { return num_bins_; }
+    std::size_t size() const { return data_.size(); }
+    bool empty() const { return num_frames_ == 0; }
+    std::size_t capacity() const { return data_.capacity(); }
+
+    float* data() { return data_.data(); }
+    const float* data() const { return data_.data(); }
+
+    float* row(std::size_t frame) { return data_.data() + frame * num_bins_; }
+    const float* row(std::size_t frame) const { return data_.data() + frame * num_bins_; }
+
+    float& operator()(std::size_t frame, std::size_t bin) { return data_[frame * num_bins_ + bin]; }
+    float operator()(std::size_t frame, std::size_t bin) const { return data_[frame * num_bins_ + bin]; }
+
+private:
+    std::size_t num_frames_ = 0;
+    std::size_t num_bins_ = 0;
+    std::vector<float, AlignedAllocator<float, alignment>> data_;
+};
+
+#endif // SPECTROGRAM_H
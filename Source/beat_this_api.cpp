@@ -3,242 +3,1198 @@
 #include "MelSpectrogram.h"
 #include "InferenceProcessor.h"
 #include "Postprocessor.h"
+#include "Resampler.h"
+#include "ResultCache.h"
+#include "ModelData.h"
+#include "Downmix.h"
+#include "PipelineOptions.h"
 
 #include <iostream>
 #include <memory>
+#include <map>
 #include <fstream>
 #include <algorithm>
 #include <iomanip>
-#include <set>
 #include <stdexcept>
 #include <codecvt>
 #include <locale>
+#include <filesystem>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstring>
+#include <type_traits>
 #include "miniaudio.h"
+
+#if __has_include("coreml_provider_factory.h")
+#include "coreml_provider_factory.h"
+#define BEAT_THIS_HAS_COREML 1
+#endif
+#if __has_include("dml_provider_factory.h")
+#include "dml_provider_factory.h"
+#define BEAT_THIS_HAS_DML 1
+#endif
+
 namespace BeatThis {
 
-// Pimpl implementation
-class BeatThis::Impl {
-public:
-    Ort::Env env;
-    std::unique_ptr<Ort::Session> session;
-
-    explicit Impl(const std::string& onnx_model_path) 
-        : env(ORT_LOGGING_LEVEL_WARNING, "beat_this_cpp_api") {
-        // Check if file exists
-        std::ifstream file_check(onnx_model_path);
-        if (!file_check.good()) {
-            throw std::runtime_error("ONNX model file not found: " + onnx_model_path);
+MelSpectrogram::Options make_mel_options(const BeatThisConfig& config) {
+    MelSpectrogram::Options options;
+    options.num_threads = std::max(1, config.frontend_threads);
+    options.fast_log = config.fast_log;
+    return options;
+}
+
+Resampler::Quality to_resampler_quality(ResampleQuality quality) {
+    return quality == ResampleQuality::Sinc ? Resampler::Quality::Sinc : Resampler::Quality::Linear;
+}
+
+namespace {
+    // ONNX Runtime environment and session, shared by all analyzers created with share_session()
+    struct Model {
+        Ort::Env env;
+        std::shared_ptr<const ModelData> data;          // Source bytes when created from ModelData
+        std::shared_ptr<const ModelData> session_data;  // Bytes the session was created from (must outlive it)
+        std::unique_ptr<Ort::Session> session;
+        std::string path;
+
+        Model() : env(ORT_LOGGING_LEVEL_WARNING, "beat_this_cpp_api") {}
+
+        // Hash of the model bytes, computed on first use (identifies the model in cache keys).
+        // A mapped file hashes the same as loading it by path.
+        uint64_t content_hash() {
+            std::call_once(hash_once, [this] {
+                constexpr size_t block_size = 1 << 20;
+                uint64_t hash = ResultCache::hash_bytes(path.data(), path.size());
+                if (data) {
+                    const char* bytes = static_cast<const char*>(data->data());
+                    for (size_t offset = 0; offset < data->size(); offset += block_size) {
+                        hash = ResultCache::hash_bytes(bytes + offset, std::min(block_size, data->size() - offset), hash);
+                    }
+                } else {
+                    std::ifstream file(path, std::ios::binary);
+                    std::vector<char> block(block_size);
+                    while (file) {
+                        file.read(block.data(), static_cast<std::streamsize>(block.size()));
+                        std::streamsize count = file.gcount();
+                        if (count <= 0) {
+                            break;
+                        }
+                        hash = ResultCache::hash_bytes(block.data(), static_cast<size_t>(count), hash);
+                    }
+                }
+                hash_value = hash;
+            });
+            return hash_value;
         }
-        file_check.close();
-        
-        Ort::SessionOptions session_options;
 
+    private:
+        std::once_flag hash_once;
+        uint64_t hash_value = 0;
+    };
+
+    // Prepacked weights shared by every session created with share_prepacked_weights,
+    // so instances loading the same model keep one copy of the repacked MatMul weights
+    Ort::PrepackedWeightsContainer& shared_prepacked_weights() {
+        static Ort::PrepackedWeightsContainer container;
+        return container;
+    }
+
+    // Converts a UTF-8 path to the string type ONNX Runtime expects
+    std::basic_string<ORTCHAR_T> to_ort_path(const std::string& path) {
 #ifdef _WIN32
-#include <codecvt>
-#include <locale>
-#endif
-        
-        #ifdef _WIN32
         // On Windows, ONNX Runtime expects a wide string path
         std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
-        std::wstring w_model_path = converter.from_bytes(onnx_model_path);
-        const ORTCHAR_T* model_path_ort = w_model_path.c_str();
+        return converter.from_bytes(path);
 #else
         // On non-Windows, ONNX Runtime expects a narrow string path
-        const ORTCHAR_T* model_path_ort = onnx_model_path.c_str();
+        return path;
+#endif
+    }
+
+    GraphOptimizationLevel to_ort_level(GraphOptimization level) {
+        switch (level) {
+            case GraphOptimization::Disabled: return ORT_DISABLE_ALL;
+            case GraphOptimization::Basic:    return ORT_ENABLE_BASIC;
+            case GraphOptimization::Extended: return ORT_ENABLE_EXTENDED;
+            case GraphOptimization::All:      return ORT_ENABLE_ALL;
+        }
+        return ORT_ENABLE_ALL;
+    }
+
+    void append_execution_provider(Ort::SessionOptions& session_options, const BeatThisConfig& config) {
+        switch (config.execution_provider) {
+            case ExecutionProvider::CPU:
+                break;
+            case ExecutionProvider::CUDA: {
+                OrtCUDAProviderOptions cuda_options{};
+                cuda_options.device_id = config.device_id;
+                session_options.AppendExecutionProvider_CUDA(cuda_options);
+                break;
+            }
+            case ExecutionProvider::CoreML:
+#ifdef BEAT_THIS_HAS_COREML
+                Ort::ThrowOnError(OrtSessionOptionsAppendExecutionProvider_CoreML(session_options, 0));
+                break;
+#else
+                throw std::runtime_error("CoreML execution provider is not available in this build");
 #endif
-        
+            case ExecutionProvider::DirectML:
+#ifdef BEAT_THIS_HAS_DML
+                // DirectML does not support memory patterns or parallel execution
+                session_options.DisableMemPattern();
+                session_options.SetExecutionMode(ORT_SEQUENTIAL);
+                Ort::ThrowOnError(OrtSessionOptionsAppendExecutionProvider_DML(session_options, config.device_id));
+                break;
+#else
+                throw std::runtime_error("DirectML execution provider is not available in this build");
+#endif
+            case ExecutionProvider::OpenVINO: {
+                OrtOpenVINOProviderOptions openvino_options{};
+                session_options.AppendExecutionProvider_OpenVINO(openvino_options);
+                break;
+            }
+        }
+    }
+
+    Postprocessor make_postprocessor(const PostprocessOptions& options, float fps = model_fps) {
+        return Postprocessor(fps, options.kernel_size, options.threshold, options.dedup_width);
+    }
+
+    // Pipelined mode: runs the leading chunks of a growing spectrogram on a worker
+    // thread, each as soon as its frames are final, while the calling thread is
+    // still decoding and computing later frames. The frontend appends frames only
+    // inside update(); the worker copies a chunk out under the same lock and runs
+    // the model without holding it.
+    class ChunkPipeline {
+    public:
+        // chunk_frames_ is the owner's staging buffer, kept across calls
+        ChunkPipeline(InferenceProcessor& processor_, const Spectrogram& spectrogram_, std::vector<float>& chunk_frames_)
+            : processor(processor_), spectrogram(spectrogram_), chunk_frames(chunk_frames_) {
+            processor.begin_spectrogram();
+            worker = std::thread([this] { run(); });
+        }
+
+        ~ChunkPipeline() {
+            if (worker.joinable()) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    state = State::Cancelled;
+                }
+                frames_ready.notify_one();
+                worker.join();
+            }
+        }
+
+        ChunkPipeline(const ChunkPipeline&) = delete;
+        ChunkPipeline& operator=(const ChunkPipeline&) = delete;
+
+        // Runs `append` (which adds frames to the spectrogram) under the lock
+        template <typename Append>
+        void update(Append&& append) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                append();
+                available_frames = spectrogram.num_frames();
+            }
+            frames_ready.notify_one();
+        }
+
+        // The spectrogram is complete: waits for the worker and rethrows its error
+        void finish() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                state = State::Finished;
+                available_frames = spectrogram.num_frames();
+            }
+            frames_ready.notify_one();
+            worker.join();
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+    private:
+        enum class State { Running, Finished, Cancelled };
+
+        InferenceProcessor& processor;
+        const Spectrogram& spectrogram;
+        std::thread worker;
+        std::mutex mutex;
+        std::condition_variable frames_ready;
+        size_t available_frames = 0;
+        State state = State::Running;
+        std::exception_ptr error;
+        std::vector<float>& chunk_frames;
+
+        void run() {
+            try {
+                for (int index = 0;; ++index) {
+                    int start = processor.leading_chunk_start(index);
+                    int end = processor.leading_chunk_end(index);
+                    size_t num_bins = 0;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        frames_ready.wait(lock, [&] { return available_frames >= (size_t)end || state != State::Running; });
+                        if (available_frames < (size_t)end || state == State::Cancelled) {
+                            return; // The rest is run by finish_spectrogram()
+                        }
+                        num_bins = spectrogram.num_bins();
+                        int first = std::max(0, start);
+                        chunk_frames.assign(static_cast<size_t>(end - start) * num_bins, 0.0f);
+                        std::memcpy(chunk_frames.data() + static_cast<size_t>(first - start) * num_bins,
+                                    spectrogram.row(first), static_cast<size_t>(end - first) * num_bins * sizeof(float));
+                    }
+                    processor.run_leading_chunk(chunk_frames.data(), static_cast<int>(num_bins));
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+    };
+}
+
+// Pimpl implementation
+class BeatThis::Impl {
+public:
+    std::shared_ptr<Model> model;
+    BeatThisConfig config;
+
+    // Long-lived pipeline stages, initialized once and reused by every call
+    MelSpectrogram mel_spectrogram;
+    std::unique_ptr<InferenceProcessor> inference_processor;
+    Postprocessor postprocessor;
+
+    // Resamplers by (input rate, channel count), kept so filter tables are built once
+    std::map<std::pair<int, int>, std::unique_ptr<Resampler>> resamplers;
+
+    // Scratch buffers reused across process_audio() calls
+    std::vector<float> block_buffer;
+    std::vector<float> resampled_buffer;
+    Spectrogram spectrogram;
+    std::vector<float> pipeline_frames;  // Leading chunk input staged by the ChunkPipeline
+    Spectrogram edited_frames;           // Mel frames recomputed by reanalyze()
+
+    // Logits of the current call. Their storage circulates through the inference
+    // processor, so it is only reallocated when a call returns the logits.
+    std::vector<float> beat_logits;
+    std::vector<float> downbeat_logits;
+
+    // Runs inference alongside the frontend in pipelined mode (one per call)
+    std::unique_ptr<ChunkPipeline> pipeline;
+
+    // Result cache; cache_key is set while a cacheable call is running
+    std::shared_ptr<ResultCache> cache;
+    std::optional<ResultCache::Key> cache_key;
+
+    // Profiling state of the current call; untouched unless profiling is on
+    std::shared_ptr<BeatThisObserver> observer;
+    bool profiling = false;
+    StageTimings timings;
+    size_t buffer_bytes_at_start = 0;
+    std::chrono::steady_clock::time_point call_start;
+    std::chrono::steady_clock::time_point lap_start;
+
+    Impl(const std::string& onnx_model_path, const BeatThisConfig& config_) 
+        : Impl(config_) {
+        std::error_code exists_ec;
+        if (!std::filesystem::is_regular_file(onnx_model_path, exists_ec)) {
+            throw std::runtime_error("ONNX model file not found: " + onnx_model_path);
+        }
+        model->path = onnx_model_path;
+        create_session();
+    }
+
+    Impl(std::shared_ptr<const ModelData> data, const BeatThisConfig& config_)
+        : Impl(config_) {
+        if (!data) {
+            throw std::runtime_error("Model data is null");
+        }
+        model->path = data->path();
+        model->data = std::move(data);
+        create_session();
+    }
+
+    // Creates model->session from model->data if set, otherwise from the file at model->path
+    void create_session() {
         try {
-            session = std::make_unique<Ort::Session>(env, model_path_ort, session_options);
+            Ort::SessionOptions session_options;
+            if (config.intra_op_threads > 0) {
+                session_options.SetIntraOpNumThreads(config.intra_op_threads);
+            }
+            if (config.inter_op_threads > 0) {
+                session_options.SetInterOpNumThreads(config.inter_op_threads);
+            }
+            session_options.SetExecutionMode(config.parallel_execution ? ORT_PARALLEL : ORT_SEQUENTIAL);
+            session_options.SetGraphOptimizationLevel(to_ort_level(config.graph_optimization));
+            append_execution_provider(session_options, config);
+
+            // Prefer a previously saved optimized graph; otherwise save one for next time.
+            // Buffers without a source file cannot be checked for freshness and are re-optimized.
+            std::string load_path = model->path;
+            model->session_data = model->data;
+            std::basic_string<ORTCHAR_T> optimized_path_ort;
+            if (!config.optimized_model_path.empty()) {
+                std::error_code optimized_ec, source_ec;
+                auto optimized_time = std::filesystem::last_write_time(config.optimized_model_path, optimized_ec);
+                auto source_time = std::filesystem::last_write_time(model->path, source_ec);
+                if (!model->path.empty() && !optimized_ec && !source_ec && optimized_time >= source_time) {
+                    load_path = config.optimized_model_path;
+                    if (model->data) {
+                        model->session_data = ModelData::map_file(load_path);
+                    }
+                    session_options.SetGraphOptimizationLevel(ORT_DISABLE_ALL);
+                } else {
+                    optimized_path_ort = to_ort_path(config.optimized_model_path);
+                    session_options.SetOptimizedModelFilePath(optimized_path_ort.c_str());
+                }
+            }
+
+            if (model->session_data) {
+                const ModelData& bytes = *model->session_data;
+                if (bytes.is_ort_format()) {
+                    // Initializers point into the (mapped) bytes instead of being copied
+                    session_options.AddConfigEntry("session.use_ort_model_bytes_directly", "1");
+                    session_options.AddConfigEntry("session.use_ort_model_bytes_for_initializers", "1");
+                }
+                if (config.share_prepacked_weights) {
+                    model->session = std::make_unique<Ort::Session>(model->env, bytes.data(), bytes.size(),
+                                                                    session_options, shared_prepacked_weights());
+                } else {
+                    model->session = std::make_unique<Ort::Session>(model->env, bytes.data(), bytes.size(),
+                                                                    session_options);
+                }
+            } else {
+                std::basic_string<ORTCHAR_T> model_path_ort = to_ort_path(load_path);
+                if (config.share_prepacked_weights) {
+                    model->session = std::make_unique<Ort::Session>(model->env, model_path_ort.c_str(),
+                                                                    session_options, shared_prepacked_weights());
+                } else {
+                    model->session = std::make_unique<Ort::Session>(model->env, model_path_ort.c_str(),
+                                                                    session_options);
+                }
+            }
         } catch (const Ort::Exception& e) {
             std::cerr << "ONNX Runtime error during session creation: " << e.what() << std::endl;
             std::cerr << "Error code: " << e.GetOrtErrorCode() << std::endl;
             throw std::runtime_error("ONNX Runtime error: " + std::string(e.what()));
         }
+
+        inference_processor = std::make_unique<InferenceProcessor>(*model->session, model->env, config.max_batch_size);
     }
-};
 
-BeatThis::BeatThis(const std::string& onnx_model_path) 
-    : pImpl(std::make_unique<Impl>(onnx_model_path)) {
-}
+    // Returns the cached resampler for this input format, reset for a new stream
+    Resampler& get_resampler(int samplerate, int channels) {
+        auto& resampler = resamplers[{samplerate, channels}];
+        if (!resampler) {
+            resampler = std::make_unique<Resampler>(samplerate, target_samplerate, channels,
+                                                    to_resampler_quality(config.resample_quality));
+        } else {
+            resampler->reset();
+        }
+        return *resampler;
+    }
 
-BeatThis::~BeatThis() = default;
+    // Reuses an already loaded model; only the pipeline state is new
+    Impl(std::shared_ptr<Model> model_, const BeatThisConfig& config_)
+        : model(std::move(model_)), config(config_), mel_spectrogram(make_mel_options(config_)),
+          postprocessor(make_postprocessor(config_.postprocess)) {
+        inference_processor = std::make_unique<InferenceProcessor>(*model->session, model->env, config.max_batch_size);
+    }
 
-namespace {
-    // Helper function to calculate beat counts
-    std::vector<int> calculate_beat_counts(const std::vector<float>& beats, 
-                                          const std::vector<float>& downbeats) {
-        std::vector<int> beat_counts(beats.size());
-        
-        if (beats.empty() || downbeats.empty()) {
-            return beat_counts;
-        }
+    // Pipeline stages for a model that is loaded by the constructor delegating here
+    explicit Impl(const BeatThisConfig& config_)
+        : model(std::make_shared<Model>()), config(config_), mel_spectrogram(make_mel_options(config_)),
+          postprocessor(make_postprocessor(config_.postprocess)) {
+    }
 
-        // Check if all downbeats are beats
-        std::set<float> beats_set(beats.begin(), beats.end());
-        for (float db_time : downbeats) {
-            if (beats_set.find(db_time) == beats_set.end()) {
-                std::cerr << "Error: Not all downbeats are beats. Cannot calculate beat counts." << std::endl;
-                return beat_counts;
-            }
+    // Stream frontend shared by all process_* calls. In pipelined mode the frames
+    // are handed to a ChunkPipeline as they are appended.
+    void begin_frames() {
+        mel_spectrogram.begin_stream(spectrogram);
+        if (config.pipelined) {
+            pipeline = std::make_unique<ChunkPipeline>(*inference_processor, spectrogram, pipeline_frames);
         }
+    }
 
-        // Handle pickup measure and beat counting
-        int start_counter = 1;
-        if (downbeats.size() >= 2) {
-            auto it_first_downbeat = std::lower_bound(beats.begin(), beats.end(), downbeats[0]);
-            auto it_second_downbeat = std::lower_bound(beats.begin(), beats.end(), downbeats[1]);
+    void push_frames(const float* samples, size_t num_samples) {
+        if (pipeline) {
+            pipeline->update([&] { mel_spectrogram.push_samples(samples, num_samples, spectrogram); });
+        } else {
+            mel_spectrogram.push_samples(samples, num_samples, spectrogram);
+        }
+    }
 
-            int first_downbeat_idx = std::distance(beats.begin(), it_first_downbeat);
-            int second_downbeat_idx = std::distance(beats.begin(), it_second_downbeat);
+    void end_frames() {
+        if (pipeline) {
+            pipeline->update([&] { mel_spectrogram.end_stream(spectrogram); });
+        } else {
+            mel_spectrogram.end_stream(spectrogram);
+        }
+    }
 
-            int beats_in_first_measure = second_downbeat_idx - first_downbeat_idx;
-            int pickup_beats = first_downbeat_idx;
+    // Runs (or, in pipelined mode, completes) inference on the finished spectrogram
+    // Fills beat_logits and downbeat_logits for the current spectrogram
+    void infer() {
+        if (pipeline) {
+            pipeline->finish();
+            pipeline.reset();
+        } else {
+            inference_processor->begin_spectrogram();
+        }
+        inference_processor->finish_spectrogram(spectrogram, beat_logits, downbeat_logits);
+    }
 
-            if (pickup_beats < beats_in_first_measure) {
-                start_counter = beats_in_first_measure - pickup_beats;
-            } else {
-                std::cerr << "WARNING: There are more beats in the pickup measure than in the first measure. "
-                         << "The beat count will start from 2 without trying to estimate the length of the pickup measure." << std::endl;
-                start_counter = 1;
-            }
+    // Frontend of a whole signal held in memory: fills spectrogram
+    template <typename Sample>
+    void compute_spectrogram(const Sample* audio_data, size_t num_frames, int samplerate, int channels) {
+        if (samplerate != target_samplerate) {
+            // Convert, downmix and resample in one pass
+            Resampler& resampler = get_resampler(samplerate, channels);
+            resampled_buffer.clear();
+            resampler.process(audio_data, num_frames, resampled_buffer);
+            resampler.flush(resampled_buffer);
+            lap(Stage::Resample);
+            mel_spectrogram.compute(resampled_buffer.data(), resampled_buffer.size(), spectrogram);
         } else {
-            std::cerr << "WARNING: There are less than two downbeats in the predictions. Something may be wrong. "
-                     << "The beat count will start from 2 without trying to estimate the length of the pickup measure." << std::endl;
-            start_counter = 1;
-        }
-
-        // Calculate beat counts
-        int counter = start_counter;
-        size_t downbeat_idx = 0;
-        float next_downbeat = (downbeat_idx < downbeats.size()) ? downbeats[downbeat_idx] : -1.0f;
-
-        for (size_t i = 0; i < beats.size(); ++i) {
-            float beat_time = beats[i];
-            
-            if (downbeat_idx < downbeats.size() && std::abs(beat_time - next_downbeat) < 1e-6f) {
-                counter = 1;
-                downbeat_idx++;
-                next_downbeat = (downbeat_idx < downbeats.size()) ? downbeats[downbeat_idx] : -1.0f;
-            } else {
-                counter++;
-            }
-            beat_counts[i] = counter;
+            // 22050 Hz input is converted and downmixed while the Mel frame buffer is filled
+            mel_spectrogram.compute(audio_data, num_frames, channels, spectrogram);
         }
+        lap(Stage::Spectrogram);
+    }
 
-        return beat_counts;
+    size_t buffer_bytes() const {
+        return (block_buffer.capacity() + resampled_buffer.capacity() + spectrogram.capacity() + edited_frames.capacity()
+                + pipeline_frames.capacity() + beat_logits.capacity() + downbeat_logits.capacity()) * sizeof(float)
+            + inference_processor->get_buffer_bytes();
     }
 
-    // Helper function to resample audio
-    bool resample_audio(const std::vector<float>& in_buffer, int in_rate, 
-                       std::vector<float>& out_buffer, int out_rate) {
-        ma_resampler resampler;
-        ma_resampler_config resampler_config = ma_resampler_config_init(
-            ma_format_f32, 1, (ma_uint32)in_rate, (ma_uint32)out_rate, ma_resample_algorithm_linear);
+    // Starts the profile of a process_* call
+    void begin_call() {
+        cache_key.reset();
+        profiling = config.collect_timings || observer;
+        if (!profiling) {
+            return;
+        }
+        timings = StageTimings();
+        buffer_bytes_at_start = buffer_bytes();
+        call_start = lap_start = std::chrono::steady_clock::now();
+    }
 
-        ma_result result = ma_resampler_init(&resampler_config, nullptr, &resampler);
-        if (result != MA_SUCCESS) {
-            std::cerr << "Error: ma_resampler_init failed: " << ma_result_description(result) << std::endl;
-            return false;
+    // Adds the time since the previous lap to the stage; reports it once complete
+    void lap(Stage stage, bool complete = true) {
+        if (!profiling) {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - lap_start).count();
+        lap_start = now;
+        switch (stage) {
+            case Stage::Decode:      timings.decode_seconds += seconds; break;
+            case Stage::Resample:    timings.resample_seconds += seconds; break;
+            case Stage::Spectrogram: timings.spectrogram_seconds += seconds; break;
+            case Stage::Inference:   timings.inference_seconds += seconds; break;
+            case Stage::Postprocess: timings.postprocess_seconds += seconds; break;
         }
+        if (complete) {
+            report(stage);
+        }
+    }
 
-        ma_uint64 in_frames = in_buffer.size();
-        ma_uint64 out_frames_estimated = 0;
-        ma_resampler_get_expected_output_frame_count(&resampler, in_frames, &out_frames_estimated);
-        out_buffer.resize(out_frames_estimated);
+    // Tells the observer that a stage accumulated with lap(stage, false) is complete
+    void report(Stage stage) {
+        if (profiling && observer) {
+            observer->on_stage(stage, timings.seconds(stage));
+        }
+    }
 
-        ma_uint64 frames_in = in_frames;
-        ma_uint64 frames_out = out_frames_estimated;
+    void finish_timings() {
+        timings.total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - call_start).count();
+        if (timings.cache_hit) {
+            timings.buffer_bytes = buffer_bytes();
+            return;
+        }
+        timings.spectrogram_frames = spectrogram.num_frames();
+        for (const auto& run : inference_processor->get_last_run_timings()) {
+            timings.inference_chunks += run.chunks;
+            ++timings.inference_runs;
+        }
+        timings.buffer_bytes = buffer_bytes();
+        timings.bytes_allocated += timings.buffer_bytes > buffer_bytes_at_start ? timings.buffer_bytes - buffer_bytes_at_start : 0;
+    }
 
-        result = ma_resampler_process_pcm_frames(&resampler, in_buffer.data(), &frames_in, out_buffer.data(), &frames_out);
-        if (result != MA_SUCCESS) {
-            std::cerr << "Error: ma_resampler_process_pcm_frames failed: " << ma_result_description(result) << std::endl;
-            ma_resampler_uninit(&resampler, nullptr);
-            return false;
+    // Completes the profile of a successful call
+    void end_call(BeatResult& result) {
+        if (!profiling) {
+            return;
         }
+        finish_timings();
+        // The result vectors are allocated per call, and the logits when they are returned
+        if (result.logits) {
+            timings.bytes_allocated += 2 * timings.spectrogram_frames * sizeof(float);
+        }
+        timings.bytes_allocated += (result.beats.size() + result.downbeats.size()) * sizeof(float)
+            + result.beat_counts.size() * sizeof(int);
+        if (observer) {
+            observer->on_complete(timings);
+        }
+        if (config.collect_timings) {
+            result.timings = timings;
+        }
+    }
 
-        out_buffer.resize(frames_out);
-        ma_resampler_uninit(&resampler, nullptr);
-        return true;
+    // Looks up the input of process_audio(); the settings that change the result form the context
+    // format_id is 0 for float input, so float keys do not depend on the integer formats
+    std::optional<ResultCache::Entry> find_cached(const void* audio, size_t sample_bytes, uint64_t format_id,
+                                                  size_t num_samples, int samplerate, int channels) {
+        // Spectrograms are never cached, and logits only if the cache keeps them
+        if (config.return_spectrogram || (config.return_logits && !cache->get_config().store_logits)) {
+            return std::nullopt;
+        }
+        uint32_t threshold_bits = 0;
+        std::memcpy(&threshold_bits, &config.postprocess.threshold, sizeof(threshold_bits));
+        uint64_t context[] = {model->content_hash(), static_cast<uint64_t>(config.resample_quality),
+                              static_cast<uint64_t>(samplerate), static_cast<uint64_t>(channels),
+                              threshold_bits, static_cast<uint64_t>(config.postprocess.kernel_size),
+                              static_cast<uint64_t>(config.postprocess.dedup_width)};
+        uint64_t context_hash = ResultCache::hash_bytes(context, sizeof(context), format_id);
+        if (config.fast_log) {
+            // Appended only when set, so keys of the exact frontend stay as they were
+            context_hash = ResultCache::hash_bytes("fast_log", 8, context_hash);
+        }
+        cache_key = ResultCache::make_key(audio, sample_bytes, num_samples, context_hash);
+        auto entry = cache->find(*cache_key, config.return_logits);
+        if (entry) {
+            cache_key.reset();
+        }
+        return entry;
     }
 
-    // Helper function to convert to mono
-    std::vector<float> convert_to_mono(const std::vector<float>& audio_data, int channels) {
-        if (channels == 1) {
-            return audio_data;
+    // Stores the result of a call that missed the cache
+    void store_cached(const BeatResult& result, const std::vector<float>& beat_logits,
+                      const std::vector<float>& downbeat_logits) {
+        if (!cache_key) {
+            return;
+        }
+        ResultCache::Entry entry;
+        entry.result = result;
+        if (cache->get_config().store_logits) {
+            entry.beat_logits = beat_logits;
+            entry.downbeat_logits = downbeat_logits;
         }
+        cache->insert(*cache_key, std::move(entry));
+        cache_key.reset();
+    }
 
-        size_t num_frames = audio_data.size() / channels;
-        std::vector<float> mono_buffer(num_frames);
-        
-        for (size_t i = 0; i < num_frames; ++i) {
-            float sum = 0.0f;
-            for (int ch = 0; ch < channels; ++ch) {
-                sum += audio_data[i * channels + ch];
-            }
-            mono_buffer[i] = sum / channels;
+    // Packs the logits (and, if requested, the spectrogram) of the current call
+    BeatLogits make_logits(std::vector<float> beat_logits, std::vector<float> downbeat_logits) const {
+        BeatLogits logits;
+        logits.fps = model_fps;
+        logits.beat = std::move(beat_logits);
+        logits.downbeat = std::move(downbeat_logits);
+        if (config.return_spectrogram) {
+            logits.num_bins = static_cast<int>(spectrogram.num_bins());
+            logits.spectrogram.assign(spectrogram.data(), spectrogram.data() + spectrogram.size());
         }
-        
-        return mono_buffer;
+        return logits;
+    }
+
+    // Stops the pipeline of a failed call and reports the error to the observer
+    void fail_call(const std::exception& error) {
+        pipeline.reset();
+        cache_key.reset();
+        if (!profiling || !observer) {
+            return;
+        }
+        finish_timings();
+        observer->on_error(timings, error);
+    }
+};
+
+BeatThis::BeatThis(const std::string& onnx_model_path, int max_batch_size) 
+    : BeatThis(onnx_model_path, [max_batch_size] {
+          BeatThisConfig config;
+          config.max_batch_size = max_batch_size;
+          return config;
+      }()) {
+}
+
+BeatThis::BeatThis(const std::string& onnx_model_path, const BeatThisConfig& config)
+    : pImpl(std::make_unique<Impl>(onnx_model_path, config)) {
+}
+
+BeatThis::BeatThis(std::shared_ptr<const ModelData> model_data, const BeatThisConfig& config)
+    : pImpl(std::make_unique<Impl>(std::move(model_data), config)) {
+}
+
+BeatThis::BeatThis(std::unique_ptr<Impl> impl) : pImpl(std::move(impl)) {
+}
+
+BeatThis::~BeatThis() = default;
+BeatThis::BeatThis(BeatThis&&) noexcept = default;
+BeatThis& BeatThis::operator=(BeatThis&&) noexcept = default;
+
+BeatThis BeatThis::share_session() const {
+    auto impl = std::make_unique<Impl>(pImpl->model, pImpl->config);
+    impl->observer = pImpl->observer;
+    impl->cache = pImpl->cache;
+    return BeatThis(std::move(impl));
+}
+
+void BeatThis::set_observer(std::shared_ptr<BeatThisObserver> observer) {
+    pImpl->observer = std::move(observer);
+}
+
+void BeatThis::set_cache(std::shared_ptr<ResultCache> cache) {
+    pImpl->cache = std::move(cache);
+}
+
+const BeatThisConfig& BeatThis::get_config() const {
+    return pImpl->config;
+}
+
+std::unique_ptr<InferenceProcessor> BeatThis::create_inference_processor(int max_batch_size) const {
+    return std::make_unique<InferenceProcessor>(*pImpl->model->session, pImpl->model->env, max_batch_size);
+}
+
+namespace {
+    // Uninitializes a miniaudio decoder when it goes out of scope
+    struct DecoderGuard {
+        ma_decoder* decoder;
+        ~DecoderGuard() { ma_decoder_uninit(decoder); }
+    };
+
+    // Frames per block in process_stream(), process_file() and pipelined process_audio()
+    constexpr size_t stream_block_frames = 1 << 16;
+}
+
+// Runs inference and postprocessing on pImpl->spectrogram
+BeatResult BeatThis::analyze_spectrogram() {
+    // Run Inference
+    pImpl->infer();
+    pImpl->lap(Stage::Inference);
+
+    // Post-process to get beat and downbeat times and beat counts
+    auto beats = pImpl->postprocessor.process(pImpl->beat_logits, pImpl->downbeat_logits);
+    pImpl->lap(Stage::Postprocess);
+
+    BeatResult result;
+    result.beats = std::move(beats.beats);
+    result.downbeats = std::move(beats.downbeats);
+    result.beat_counts = std::move(beats.beat_counts);
+    pImpl->store_cached(result, pImpl->beat_logits, pImpl->downbeat_logits);
+    if (pImpl->config.return_logits) {
+        result.logits = pImpl->make_logits(std::move(pImpl->beat_logits), std::move(pImpl->downbeat_logits));
     }
+    pImpl->end_call(result);
+    return result;
 }
 
 BeatResult BeatThis::process_audio(const std::vector<float>& audio_data, 
                                   int samplerate, int channels) {
+    return process_audio(audio_data.data(), audio_data.size(), samplerate, channels);
+}
+
+template <typename Sample>
+BeatResult BeatThis::process_samples(const Sample* audio_data, size_t num_samples, int samplerate, int channels) {
+    pImpl->begin_call();
+    try {
+        if (samplerate <= 0 || channels < 1) {
+            throw std::runtime_error("Invalid audio format: " + std::to_string(samplerate) + " Hz, " +
+                                     std::to_string(channels) + " channels");
+        }
+        size_t num_frames = num_samples / channels;
+        pImpl->timings.input_frames = num_frames;
+
+        if (pImpl->cache) {
+            constexpr uint64_t format_id = std::is_same_v<Sample, float> ? 0 : sizeof(Sample);
+            if (auto entry = pImpl->find_cached(audio_data, sizeof(Sample), format_id, num_samples, samplerate, channels)) {
+                pImpl->timings.cache_hit = true;
+                if (pImpl->config.return_logits) {
+                    entry->result.logits = pImpl->make_logits(std::move(entry->beat_logits), std::move(entry->downbeat_logits));
+                }
+                pImpl->end_call(entry->result);
+                return std::move(entry->result);
+            }
+        }
+
+        if (pImpl->config.pipelined) {
+            // Convert and compute frames block by block so inference can start early
+            bool convert = !std::is_same_v<Sample, float> || channels != 1 || samplerate != target_samplerate;
+            Resampler* resampler = convert ? &pImpl->get_resampler(samplerate, channels) : nullptr;
+            std::vector<float>& converted = pImpl->resampled_buffer;
+            pImpl->begin_frames();
+            for (size_t first = 0; first < num_frames; first += stream_block_frames) {
+                size_t count = std::min(stream_block_frames, num_frames - first);
+                const Sample* block = audio_data + first * channels;
+                if constexpr (std::is_same_v<Sample, float>) {
+                    if (!resampler) {
+                        pImpl->push_frames(block, count);
+                        pImpl->lap(Stage::Spectrogram, false);
+                        continue;
+                    }
+                }
+                converted.clear();
+                resampler->process(block, count, converted);
+                pImpl->lap(Stage::Resample, false);
+                pImpl->push_frames(converted.data(), converted.size());
+                pImpl->lap(Stage::Spectrogram, false);
+            }
+            if (resampler) {
+                converted.clear();
+                resampler->flush(converted);
+                pImpl->lap(Stage::Resample);
+                pImpl->push_frames(converted.data(), converted.size());
+            }
+            pImpl->end_frames();
+            pImpl->lap(Stage::Spectrogram);
+            return analyze_spectrogram();
+        }
+
+        pImpl->compute_spectrogram(audio_data, num_frames, samplerate, channels);
+        return analyze_spectrogram();
+
+    } catch (const Ort::Exception& e) {
+        pImpl->fail_call(e);
+        std::cerr << "ONNX Runtime error: " << e.what() << std::endl;
+        std::cerr << "Error code: " << e.GetOrtErrorCode() << std::endl;
+        throw std::runtime_error("ONNX Runtime error: " + std::string(e.what()));
+    } catch (const std::exception& e) {
+        pImpl->fail_call(e);
+        std::cerr << "Processing error: " << e.what() << std::endl;
+        throw std::runtime_error("Processing error: " + std::string(e.what()));
+    }
+}
+
+BeatResult BeatThis::process_audio(const float* audio_data, size_t num_samples, 
+                                  int samplerate, int channels) {
+    return process_samples(audio_data, num_samples, samplerate, channels);
+}
+
+BeatResult BeatThis::process_audio(std::span<const float> audio, int samplerate, int channels) {
+    return process_samples(audio.data(), audio.size(), samplerate, channels);
+}
+
+BeatResult BeatThis::process_audio(std::span<const int16_t> audio, int samplerate, int channels) {
+    return process_samples(audio.data(), audio.size(), samplerate, channels);
+}
+
+BeatResult BeatThis::process_audio(std::span<const int32_t> audio, int samplerate, int channels) {
+    return process_samples(audio.data(), audio.size(), samplerate, channels);
+}
+
+BeatResult BeatThis::analyze_for_editing(const float* audio_data, size_t num_frames, int samplerate, int channels,
+                                         EditableAnalysis& state) {
+    pImpl->compute_spectrogram(audio_data, num_frames, samplerate, channels);
+    pImpl->inference_processor->begin_spectrogram();
+    pImpl->inference_processor->finish_spectrogram(pImpl->spectrogram, pImpl->beat_logits, pImpl->downbeat_logits);
+    pImpl->lap(Stage::Inference);
+
+    // The logits storage stays with the pipeline, so the state keeps copies
+    BeatLogits& logits = state.logits_;
+    logits.fps = model_fps;
+    logits.beat = pImpl->beat_logits;
+    logits.downbeat = pImpl->downbeat_logits;
+    logits.num_bins = static_cast<int>(pImpl->spectrogram.num_bins());
+    logits.spectrogram.assign(pImpl->spectrogram.data(), pImpl->spectrogram.data() + pImpl->spectrogram.size());
+    pImpl->postprocessor.pick_peaks(logits.beat, logits.downbeat, state.beat_peaks_, state.downbeat_peaks_);
+    state.has_peaks_ = true;
+    return finish_editable(state);
+}
+
+BeatResult BeatThis::finish_editable(EditableAnalysis& state) {
+    auto beats = pImpl->postprocessor.make_result(state.beat_peaks_, state.downbeat_peaks_);
+    pImpl->lap(Stage::Postprocess);
+
+    BeatResult result;
+    result.beats = std::move(beats.beats);
+    result.downbeats = std::move(beats.downbeats);
+    result.beat_counts = std::move(beats.beat_counts);
+    if (pImpl->config.return_logits) {
+        const BeatLogits& logits = state.logits_;
+        result.logits.emplace();
+        result.logits->fps = logits.fps;
+        result.logits->beat = logits.beat;
+        result.logits->downbeat = logits.downbeat;
+        if (pImpl->config.return_spectrogram) {
+            result.logits->num_bins = logits.num_bins;
+            result.logits->spectrogram = logits.spectrogram;
+        }
+    }
+    pImpl->end_call(result);
+    return result;
+}
+
+BeatResult BeatThis::analyze_editable(std::span<const float> audio, int samplerate, int channels,
+                                      EditableAnalysis& state) {
+    pImpl->begin_call();
+    try {
+        if (samplerate <= 0 || channels < 1) {
+            throw std::runtime_error("Invalid audio format: " + std::to_string(samplerate) + " Hz, " +
+                                     std::to_string(channels) + " channels");
+        }
+        size_t num_frames = audio.size() / channels;
+        pImpl->timings.input_frames = num_frames;
+        return analyze_for_editing(audio.data(), num_frames, samplerate, channels, state);
+
+    } catch (const Ort::Exception& e) {
+        pImpl->fail_call(e);
+        std::cerr << "ONNX Runtime error: " << e.what() << std::endl;
+        std::cerr << "Error code: " << e.GetOrtErrorCode() << std::endl;
+        throw std::runtime_error("ONNX Runtime error: " + std::string(e.what()));
+    } catch (const std::exception& e) {
+        pImpl->fail_call(e);
+        std::cerr << "Processing error: " << e.what() << std::endl;
+        throw std::runtime_error("Processing error: " + std::string(e.what()));
+    }
+}
+
+BeatResult BeatThis::reanalyze(std::span<const float> audio, int samplerate, int channels,
+                               size_t first_frame, size_t last_frame, EditableAnalysis& state) {
+    pImpl->begin_call();
     try {
-        // Convert to mono
-        auto mono_audio = convert_to_mono(audio_data, channels);
-        
-        // Resample if necessary
-        std::vector<float> resampled_buffer;
-        constexpr int target_samplerate = 22050;
-        
+        if (samplerate <= 0 || channels < 1) {
+            throw std::runtime_error("Invalid audio format: " + std::to_string(samplerate) + " Hz, " +
+                                     std::to_string(channels) + " channels");
+        }
+        size_t num_frames = audio.size() / channels;
+        pImpl->timings.input_frames = num_frames;
+        if (first_frame > last_frame || last_frame > num_frames) {
+            throw std::runtime_error("Edited frames [" + std::to_string(first_frame) + ", " + std::to_string(last_frame) +
+                                     ") are outside the audio (" + std::to_string(num_frames) + " frames)");
+        }
+
+        Impl& impl = *pImpl;
+        BeatLogits& logits = state.logits_;
+        size_t num_bins = static_cast<size_t>(impl.mel_spectrogram.get_n_mels());
+        bool complete = logits.fps == model_fps && logits.num_bins == static_cast<int>(num_bins) &&
+                        logits.downbeat.size() == logits.beat.size() &&
+                        logits.spectrogram.size() == logits.beat.size() * num_bins;
+
+        // Edited samples of the 22050 Hz signal the spectrogram is computed from
+        Resampler* resampler = nullptr;
+        size_t signal_length = num_frames;
+        std::pair<int64_t, int64_t> edited{static_cast<int64_t>(first_frame), static_cast<int64_t>(last_frame)};
         if (samplerate != target_samplerate) {
-            if (!resample_audio(mono_audio, samplerate, resampled_buffer, target_samplerate)) {
-                throw std::runtime_error("Failed to resample audio");
+            resampler = &impl.get_resampler(samplerate, channels);
+            edited = resampler->affected_outputs(edited.first, edited.second);
+            int64_t length = resampler->output_length(static_cast<int64_t>(num_frames));
+            if (length < 0) {
+                // The linear resampler's filter is recursive: resample everything, reuse the edited part
+                impl.resampled_buffer.clear();
+                resampler->process(audio.data(), num_frames, impl.resampled_buffer);
+                resampler->flush(impl.resampled_buffer);
+                length = static_cast<int64_t>(impl.resampled_buffer.size());
+            }
+            signal_length = static_cast<size_t>(length);
+        }
+        int num_mel_frames = impl.mel_spectrogram.num_frames(signal_length);
+        if (!complete || static_cast<size_t>(num_mel_frames) != logits.beat.size()) {
+            return analyze_for_editing(audio.data(), num_frames, samplerate, channels, state);
+        }
+        edited.second = std::min<int64_t>(edited.second, static_cast<int64_t>(signal_length));
+        edited.first = std::min(edited.first, edited.second);
+
+        auto [first_mel, last_mel] = impl.mel_spectrogram.changed_frames(
+            static_cast<size_t>(edited.first), static_cast<size_t>(edited.second), signal_length);
+        InferenceProcessor::ChunkSpan span = impl.inference_processor->chunks_reading(num_mel_frames, first_mel, last_mel);
+        if (span.last_chunk > span.first_chunk) {
+            // Signal read by the changed frames
+            auto [first_sample, last_sample] = impl.mel_spectrogram.frame_samples(first_mel, last_mel, signal_length);
+            size_t window_length = last_sample - first_sample;
+            const float* window = nullptr;
+            if (!resampler) {
+                if (channels == 1) {
+                    window = audio.data() + first_sample;
+                } else {
+                    impl.block_buffer.resize(window_length);
+                    downmix_interleaved(audio.data() + first_sample * channels, window_length, channels,
+                                        impl.block_buffer.data());
+                    window = impl.block_buffer.data();
+                }
+            } else if (resampler->get_quality() == Resampler::Quality::Sinc) {
+                resampler->process_range(audio.data(), num_frames, static_cast<int64_t>(first_sample),
+                                         static_cast<int64_t>(last_sample), impl.block_buffer);
+                window = impl.block_buffer.data();
+            } else {
+                window = impl.resampled_buffer.data() + first_sample;
+            }
+            impl.lap(Stage::Resample);
+
+            impl.mel_spectrogram.compute_frames(window, signal_length, first_mel, last_mel, impl.edited_frames);
+            std::copy(impl.edited_frames.data(), impl.edited_frames.data() + impl.edited_frames.size(),
+                      logits.spectrogram.begin() + static_cast<size_t>(first_mel) * num_bins);
+            impl.lap(Stage::Spectrogram);
+
+            // The chunks also read unchanged frames around the edit
+            impl.spectrogram.resize(static_cast<size_t>(span.last_frame - span.first_frame), num_bins);
+            std::copy(logits.spectrogram.begin() + static_cast<size_t>(span.first_frame) * num_bins,
+                      logits.spectrogram.begin() + static_cast<size_t>(span.last_frame) * num_bins,
+                      impl.spectrogram.data());
+            auto [first_logit, last_logit] = impl.inference_processor->rerun_chunks(
+                impl.spectrogram, span, num_mel_frames, logits.beat, logits.downbeat);
+            impl.lap(Stage::Inference);
+
+            if (state.has_peaks_) {
+                impl.postprocessor.update_peaks(logits.beat, logits.downbeat, first_logit, last_logit,
+                                                state.beat_peaks_, state.downbeat_peaks_);
             }
         } else {
-            resampled_buffer = std::move(mono_audio);
+            // Nothing the model reads has changed
+            impl.inference_processor->begin_spectrogram();
+            impl.spectrogram.clear();
+        }
+        if (!state.has_peaks_) {
+            impl.postprocessor.pick_peaks(logits.beat, logits.downbeat, state.beat_peaks_, state.downbeat_peaks_);
+            state.has_peaks_ = true;
         }
+        return finish_editable(state);
+
+    } catch (const Ort::Exception& e) {
+        pImpl->fail_call(e);
+        std::cerr << "ONNX Runtime error: " << e.what() << std::endl;
+        std::cerr << "Error code: " << e.GetOrtErrorCode() << std::endl;
+        throw std::runtime_error("ONNX Runtime error: " + std::string(e.what()));
+    } catch (const std::exception& e) {
+        pImpl->fail_call(e);
+        std::cerr << "Processing error: " << e.what() << std::endl;
+        throw std::runtime_error("Processing error: " + std::string(e.what()));
+    }
+}
+
+BeatResult BeatThis::process_stream(const AudioReader& read_block) {
+    pImpl->begin_call();
+    try {
+        std::vector<float>& block = pImpl->block_buffer;
+        block.resize(stream_block_frames);
+
+        // Mel frames are computed as blocks arrive, so the audio itself is never held
+        pImpl->begin_frames();
+        for (;;) {
+            size_t frames_read = std::min(read_block(block.data(), block.size()), block.size());
+            pImpl->lap(Stage::Decode, false);
+            if (frames_read == 0) {
+                break;
+            }
+            pImpl->timings.input_frames += frames_read;
+            pImpl->push_frames(block.data(), frames_read);
+            pImpl->lap(Stage::Spectrogram, false);
+        }
+        pImpl->end_frames();
+        pImpl->report(Stage::Decode);
+        pImpl->lap(Stage::Spectrogram);
+
+        return analyze_spectrogram();
+
+    } catch (const Ort::Exception& e) {
+        pImpl->fail_call(e);
+        std::cerr << "ONNX Runtime error: " << e.what() << std::endl;
+        std::cerr << "Error code: " << e.GetOrtErrorCode() << std::endl;
+        throw std::runtime_error("ONNX Runtime error: " + std::string(e.what()));
+    } catch (const std::exception& e) {
+        pImpl->fail_call(e);
+        std::cerr << "Processing error: " << e.what() << std::endl;
+        throw std::runtime_error("Processing error: " + std::string(e.what()));
+    }
+}
 
-        // Compute Mel Spectrogram
-        MelSpectrogram spect_computer;
-        auto spectrogram = spect_computer.compute(resampled_buffer);
+BeatResult BeatThis::process_file(const std::string& audio_path) {
+    pImpl->begin_call();
 
-        // Run Inference
-        InferenceProcessor processor(*(pImpl->session), pImpl->env);
-        auto beat_downbeat_logits = processor.process_spectrogram(spectrogram);
+    // Decode in the file's native format; the cached resampler downmixes and converts the rate
+    ma_decoder decoder;
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
 
-        // Post-process to get beat and downbeat times
-        Postprocessor postprocessor;
-        auto beat_downbeat_times = postprocessor.process(
-            beat_downbeat_logits.first, beat_downbeat_logits.second);
+    ma_result result = ma_decoder_init_file(audio_path.c_str(), &config, &decoder);
+    if (result != MA_SUCCESS) {
+        std::runtime_error error("Could not open audio file '" + audio_path + "': " + ma_result_description(result));
+        pImpl->fail_call(error);
+        throw error;
+    }
+    DecoderGuard decoder_guard{&decoder};
 
-        // Calculate beat counts
-        std::vector<int> beat_counts = calculate_beat_counts(
-            beat_downbeat_times.first, beat_downbeat_times.second);
+    try {
+        int channels = static_cast<int>(decoder.outputChannels);
+        Resampler& resampler = pImpl->get_resampler(static_cast<int>(decoder.outputSampleRate), channels);
+        std::vector<float>& block = pImpl->block_buffer;
+        std::vector<float>& converted = pImpl->resampled_buffer;
+        block.resize(stream_block_frames * channels);
 
-        return BeatResult{
-            std::move(beat_downbeat_times.first),
-            std::move(beat_downbeat_times.second),
-            std::move(beat_counts)
-        };
+        // Mel frames are computed as blocks arrive, so the audio itself is never held
+        pImpl->begin_frames();
+        for (;;) {
+            ma_uint64 frames_read = 0;
+            result = ma_decoder_read_pcm_frames(&decoder, block.data(), stream_block_frames, &frames_read);
+            if (result != MA_SUCCESS && result != MA_AT_END) {
+                throw std::runtime_error("Could not decode audio file '" + audio_path + "': " + ma_result_description(result));
+            }
+            pImpl->timings.input_frames += static_cast<size_t>(frames_read);
+            pImpl->lap(Stage::Decode, false);
+            converted.clear();
+            if (frames_read == 0) {
+                resampler.flush(converted);
+            } else {
+                resampler.process(block.data(), static_cast<size_t>(frames_read), converted);
+            }
+            pImpl->lap(Stage::Resample, false);
+            pImpl->push_frames(converted.data(), converted.size());
+            pImpl->lap(Stage::Spectrogram, false);
+            if (frames_read == 0) {
+                break;
+            }
+        }
+        pImpl->end_frames();
+        pImpl->report(Stage::Decode);
+        pImpl->report(Stage::Resample);
+        pImpl->lap(Stage::Spectrogram);
+
+        return analyze_spectrogram();
 
     } catch (const Ort::Exception& e) {
+        pImpl->fail_call(e);
         std::cerr << "ONNX Runtime error: " << e.what() << std::endl;
         std::cerr << "Error code: " << e.GetOrtErrorCode() << std::endl;
         throw std::runtime_error("ONNX Runtime error: " + std::string(e.what()));
     } catch (const std::exception& e) {
+        pImpl->fail_call(e);
         std::cerr << "Processing error: " << e.what() << std::endl;
         throw std::runtime_error("Processing error: " + std::string(e.what()));
     }
 }
 
-BeatResult BeatThis::process_audio(const float* audio_data, size_t num_samples, 
-                                  int samplerate, int channels) {
-    std::vector<float> audio_vector(audio_data, audio_data + num_samples);
-    return process_audio(audio_vector, samplerate, channels);
+BeatResult postprocess_logits(const BeatLogits& logits, const PostprocessOptions& options) {
+    if (logits.beat.size() != logits.downbeat.size()) {
+        throw std::runtime_error("Beat and downbeat logits differ in length: " + std::to_string(logits.beat.size()) +
+                                 " vs " + std::to_string(logits.downbeat.size()));
+    }
+    if (!(logits.fps > 0.0f)) {
+        throw std::runtime_error("Invalid logits frame rate: " + std::to_string(logits.fps));
+    }
+    Postprocessor postprocessor = make_postprocessor(options, logits.fps);
+    auto beats = postprocessor.process(logits.beat, logits.downbeat);
+
+    BeatResult result;
+    result.beats = std::move(beats.beats);
+    result.downbeats = std::move(beats.downbeats);
+    result.beat_counts = std::move(beats.beat_counts);
+    return result;
+}
+
+double calculate_bpm(const BeatResult& result) {
+    if (result.beats.size() < 2) {
+        return 0.0; // Need at least 2 beats to calculate intervals
+    }
+
+    std::vector<double> intervals;
+    intervals.reserve(result.beats.size() - 1);
+
+    // Calculate inter-beat intervals
+    for (size_t i = 1; i < result.beats.size(); ++i) {
+        double interval = result.beats[i] - result.beats[i-1];
+        if (interval > 0.1 && interval < 3.0) { // Filter out unrealistic intervals (less than 20 BPM or more than 600 BPM)
+            intervals.push_back(interval);
+        }
+    }
+
+    if (intervals.empty()) {
+        return 0.0;
+    }
+
+    // Use median interval to avoid outliers affecting the result
+    std::sort(intervals.begin(), intervals.end());
+    double median_interval;
+    size_t n = intervals.size();
+    if (n % 2 == 0) {
+        median_interval = (intervals[n/2 - 1] + intervals[n/2]) / 2.0;
+    } else {
+        median_interval = intervals[n/2];
+    }
+
+    // Convert interval to BPM: 60 seconds per minute / interval in seconds
+    return 60.0 / median_interval;
+}
+
+namespace {
+    // Logits file layout (native byte order): magic, version, fps, frame count and
+    // bins per spectrogram frame, then the beat logits, the downbeat logits and
+    // the spectrogram (absent when num_bins is 0), all float32
+    constexpr char logits_magic[4] = {'B', 'T', 'L', 'G'};
+    constexpr uint32_t logits_version = 1;
+
+    struct LogitsHeader {
+        char magic[4];
+        uint32_t version;
+        float fps;
+        uint32_t num_bins;
+        uint64_t num_frames;
+    };
+    static_assert(sizeof(LogitsHeader) == 24, "LogitsHeader must not be padded");
 }
 
+void save_logits(const BeatLogits& logits, const std::string& path) {
+    if (logits.beat.size() != logits.downbeat.size() || logits.num_bins < 0 ||
+        logits.spectrogram.size() != logits.beat.size() * static_cast<size_t>(logits.num_bins)) {
+        throw std::runtime_error("Inconsistent logits, not saving " + path);
+    }
+
+    LogitsHeader header;
+    std::memcpy(header.magic, logits_magic, sizeof(header.magic));
+    header.version = logits_version;
+    header.fps = logits.fps;
+    header.num_bins = static_cast<uint32_t>(logits.num_bins);
+    header.num_frames = logits.beat.size();
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open logits file for writing: " + path);
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto* values : {&logits.beat, &logits.downbeat, &logits.spectrogram}) {
+        file.write(reinterpret_cast<const char*>(values->data()), static_cast<std::streamsize>(values->size() * sizeof(float)));
+    }
+    if (!file) {
+        throw std::runtime_error("Could not write logits file: " + path);
+    }
+}
+
+BeatLogits load_logits(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open logits file: " + path);
+    }
+
+    LogitsHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, logits_magic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Not a logits file: " + path);
+    }
+    if (header.version != logits_version) {
+        throw std::runtime_error("Unsupported logits file version " + std::to_string(header.version) + ": " + path);
+    }
+
+    // Check the sizes against the file before allocating anything
+    std::error_code ec;
+    uint64_t payload = std::filesystem::file_size(path, ec) - sizeof(header);
+    uint64_t values_per_frame = 2 + static_cast<uint64_t>(header.num_bins);
+    if (ec || !(header.fps > 0.0f) || header.num_bins > 4096 ||
+        header.num_frames > payload / sizeof(float) / values_per_frame) {
+        throw std::runtime_error("Truncated or corrupt logits file: " + path);
+    }
+
+    BeatLogits logits;
+    logits.fps = header.fps;
+    logits.num_bins = static_cast<int>(header.num_bins);
+    logits.beat.resize(static_cast<size_t>(header.num_frames));
+    logits.downbeat.resize(logits.beat.size());
+    logits.spectrogram.resize(logits.beat.size() * header.num_bins);
+    for (auto* values : {&logits.beat, &logits.downbeat, &logits.spectrogram}) {
+        file.read(reinterpret_cast<char*>(values->data()), static_cast<std::streamsize>(values->size() * sizeof(float)));
+    }
+    if (!file) {
+        throw std::runtime_error("Truncated or corrupt logits file: " + path);
+    }
+    return logits;
+}
 
-} // namespace BeatThis
\ No newline at end of file
+} // namespace BeatThis
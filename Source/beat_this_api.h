@@ -4,23 +4,219 @@
 #include <string>
 #include <memory>
 #include <utility>
+#include <functional>
+#include <optional>
+#include <exception>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+class InferenceProcessor;
 
 namespace BeatThis {
 
+class BeatTracker;
+class AsyncAnalyzer;
+class ResultCache;
+class ModelData;
+
+// ONNX Runtime execution provider used for inference. Providers other than CPU
+// require an ONNX Runtime build that includes them; session creation fails otherwise.
+enum class ExecutionProvider {
+    CPU,
+    CUDA,
+    CoreML,
+    DirectML,
+    OpenVINO
+};
+
+// Maps to ONNX Runtime's GraphOptimizationLevel
+enum class GraphOptimization {
+    Disabled,
+    Basic,
+    Extended,
+    All
+};
+
+// Sample rate conversion used when the input is not 22050 Hz
+enum class ResampleQuality {
+    Linear,  // miniaudio linear resampler (default, matches earlier releases)
+    Sinc     // Polyphase windowed-sinc filter, band-limited like the Python reference
+};
+
+// Peak picking applied to the model's logits. Changing these does not require
+// re-running inference: keep the logits (BeatThisConfig::return_logits) and pass
+// them to postprocess_logits().
+struct PostprocessOptions {
+    float threshold = 0.0f;  // Minimum logit for a frame to count as a peak
+    int kernel_size = 7;     // Width of the peak picking max filter (odd, in frames)
+    int dedup_width = 1;     // Peaks at most this many frames apart are merged
+};
+
+struct BeatThisConfig {
+    int max_batch_size = 4;             // Chunks stacked into one inference run (dynamic-batch models only)
+    int intra_op_threads = 0;           // Threads used inside one operator (0 = ONNX Runtime default: all cores)
+    int inter_op_threads = 0;           // Threads running independent operators (0 = default; parallel execution only)
+    bool parallel_execution = false;    // Use ORT_PARALLEL execution mode instead of ORT_SEQUENTIAL
+    GraphOptimization graph_optimization = GraphOptimization::All;
+    ExecutionProvider execution_provider = ExecutionProvider::CPU;
+    int device_id = 0;                  // GPU/device index for CUDA and DirectML
+    // If set, the optimized graph is saved here on first load and loaded from here
+    // (with optimization disabled) on later runs, as long as it is newer than the
+    // source model. Optimized graphs are specific to the execution provider and
+    // hardware they were created on.
+    std::string optimized_model_path;
+    // Share prepacked weights (ONNX Runtime's repacked CPU kernel layouts) with
+    // every other session in the process that sets this, instead of keeping one
+    // copy per instance. Only instances that load the model separately gain;
+    // share_session() analyzers already share everything.
+    bool share_prepacked_weights = false;
+    int frontend_threads = 1;           // Worker threads for the Mel spectrogram frontend
+    bool fast_log = false;              // Vectorized approximate log1p in the Mel frontend (~1 ulp error)
+    ResampleQuality resample_quality = ResampleQuality::Linear;
+    bool collect_timings = false;       // Fill BeatResult::timings with a per-stage profile of each call
+    // Overlap the frontend with inference: each 1500-frame chunk runs on a worker
+    // thread as soon as its frames are computed, while later audio is still being
+    // decoded and analyzed. Results are identical; it pays off for inputs longer
+    // than one chunk (30 s), where it hides most of the frontend time. In the
+    // timings, inference_seconds then only covers inference left after the frontend.
+    bool pipelined = false;
+    PostprocessOptions postprocess;
+    bool return_logits = false;         // Fill BeatResult::logits with the raw model output
+    bool return_spectrogram = false;    // Also include the Mel spectrogram in BeatResult::logits
+};
+
+// Pipeline stages reported in StageTimings and to a BeatThisObserver
+enum class Stage {
+    Decode,       // Reading and decoding input (process_file, process_stream's reader)
+    Resample,     // Downmix and sample rate conversion
+    Spectrogram,  // Mel spectrogram frontend
+    Inference,    // ONNX Runtime session runs
+    Postprocess   // Peak picking and downbeat snapping
+};
+
+// Profile of one process_* call. Stages that did not run stay at zero. In
+// process_file() and process_stream() the frontend stages are interleaved
+// block by block, so their times are sums over all blocks.
+struct StageTimings {
+    double decode_seconds = 0.0;
+    double resample_seconds = 0.0;
+    double spectrogram_seconds = 0.0;
+    double inference_seconds = 0.0;
+    double postprocess_seconds = 0.0;
+    double total_seconds = 0.0;     // Whole call, including anything between stages
+    size_t input_frames = 0;        // Sample frames received, at the input rate
+    size_t spectrogram_frames = 0;  // Mel frames fed to the model
+    size_t inference_chunks = 0;    // Model chunks of up to 1500 frames
+    size_t inference_runs = 0;      // Session runs (several chunks per run when batching)
+    size_t bytes_allocated = 0;     // New memory: growth of the reusable buffers plus per-call outputs
+    size_t buffer_bytes = 0;        // Memory held by the reusable pipeline buffers after the call
+    bool cache_hit = false;         // Result came from the ResultCache; only total_seconds and input_frames are set
+
+    double seconds(Stage stage) const {
+        switch (stage) {
+            case Stage::Decode:      return decode_seconds;
+            case Stage::Resample:    return resample_seconds;
+            case Stage::Spectrogram: return spectrogram_seconds;
+            case Stage::Inference:   return inference_seconds;
+            case Stage::Postprocess: return postprocess_seconds;
+        }
+        return 0.0;
+    }
+};
+
+// Raw model output of one analysis, enough to re-run postprocessing without inference
+struct BeatLogits {
+    float fps = 50.0f;                // Frames per second of the logits
+    std::vector<float> beat;          // One logit per spectrogram frame
+    std::vector<float> downbeat;
+    int num_bins = 0;                 // Mel bins per spectrogram frame (0 = no spectrogram)
+    std::vector<float> spectrogram;   // Frame-major Mel spectrogram, beat.size() * num_bins values
+};
+
 struct BeatResult {
     std::vector<float> beats;
     std::vector<float> downbeats;
     std::vector<int> beat_counts; // Beat numbers for each beat (1 = downbeat, 2,3,4... = other beats)
+    std::optional<StageTimings> timings; // Set when BeatThisConfig::collect_timings is enabled
+    std::optional<BeatLogits> logits;    // Set when BeatThisConfig::return_logits is enabled
+};
+
+// What BeatThis::reanalyze() needs to update an analysis after an edit: the
+// Mel spectrogram, the logits and the peaks picked from them. Filled by
+// BeatThis::analyze_editable(), or created from the logits of an earlier call
+// made with return_logits and return_spectrogram (the peaks are then picked
+// on the first reanalyze()). Peaks belong to the postprocessing options of the
+// analyzer that picked them; use one state with analyzers of one configuration.
+class EditableAnalysis {
+public:
+    EditableAnalysis() = default;
+    explicit EditableAnalysis(BeatLogits logits) : logits_(std::move(logits)) {}
+
+    // Logits and spectrogram of the audio as last analyzed
+    const BeatLogits& logits() const { return logits_; }
+    bool empty() const { return logits_.beat.empty(); }
+
+private:
+    friend class BeatThis;
+
+    BeatLogits logits_;
+    std::vector<int> beat_peaks_;      // Deduplicated peak frames of the logits
+    std::vector<int> downbeat_peaks_;
+    bool has_peaks_ = false;
+};
+
+// Picks beats from stored logits with the given options. No model is needed,
+// so a catalog can be re-thresholded without running inference again.
+BeatResult postprocess_logits(const BeatLogits& logits, const PostprocessOptions& options = PostprocessOptions());
+
+// Tempo in BPM from the median inter-beat interval, ignoring intervals outside
+// 0.1-3 s (600-20 BPM). Returns 0 if fewer than two beats are usable.
+double calculate_bpm(const BeatResult& result);
+
+// Compact binary logits files: a small header followed by the float32 beat and
+// downbeat logits (400 bytes per second of audio) and, if present, the
+// spectrogram. Both throw std::runtime_error on I/O or format errors.
+void save_logits(const BeatLogits& logits, const std::string& path);
+BeatLogits load_logits(const std::string& path);
+
+// Receives profiling events from a BeatThis instance, e.g. to feed a metrics
+// pipeline. Callbacks run synchronously on the thread calling process_*; an
+// observer shared between analyzers must be thread-safe. Exceptions thrown
+// from a callback propagate to the caller.
+class BeatThisObserver {
+public:
+    virtual ~BeatThisObserver() = default;
+
+    // A stage has finished for the current call
+    virtual void on_stage(Stage stage, double seconds) {}
+
+    // A call finished successfully
+    virtual void on_complete(const StageTimings& timings) {}
+
+    // A call failed; timings cover the stages that ran before the error
+    virtual void on_error(const StageTimings& timings, const std::exception& error) {}
 };
 
 class BeatThis {
 public:
-    explicit BeatThis(const std::string& onnx_model_path);
+    // max_batch_size: number of 1500-frame chunks stacked into one inference run.
+    // Larger values improve throughput at the cost of memory. Only honored if the
+    // model was exported with a dynamic batch axis; otherwise chunks run one by one.
+    explicit BeatThis(const std::string& onnx_model_path, int max_batch_size = 4);
+
+    // Full control over the ONNX Runtime session and pipeline threading
+    BeatThis(const std::string& onnx_model_path, const BeatThisConfig& config);
+
+    // Create the session from model bytes already in memory, e.g. a file mapped
+    // once with ModelData::map_file() and shared by several instances. External
+    // data files are not resolved for buffers; use a self-contained model.
+    explicit BeatThis(std::shared_ptr<const ModelData> model_data, const BeatThisConfig& config = BeatThisConfig());
     ~BeatThis();
 
     // Move semantics
-    BeatThis(BeatThis&&) = default;
-    BeatThis& operator=(BeatThis&&) = default;
+    BeatThis(BeatThis&&) noexcept;
+    BeatThis& operator=(BeatThis&&) noexcept;
 
     // Delete copy semantics
     BeatThis(const BeatThis&) = delete;
@@ -41,10 +237,87 @@ public:
         int channels = 1
     );
 
+    // Interleaved audio [frames][channels] read in place, without a copy of the
+    // buffer: the resampler downmixes it, or the Mel framing when it is already
+    // at 22050 Hz. Integer PCM is scaled by its full-scale value (2^15 or 2^31).
+    BeatResult process_audio(std::span<const float> audio, int samplerate, int channels = 1);
+    BeatResult process_audio(std::span<const int16_t> audio, int samplerate, int channels = 1);
+    BeatResult process_audio(std::span<const int32_t> audio, int samplerate, int channels = 1);
+
+    // process_audio() that also keeps the spectrogram, logits and peaks in
+    // state for reanalyze(). Runs without the pipeline and the result cache.
+    BeatResult analyze_editable(std::span<const float> audio, int samplerate, int channels, EditableAnalysis& state);
+
+    // Updates state after input frames [first_frame, last_frame) of audio were
+    // edited, and returns the result for the whole edited audio. Only the Mel
+    // frames whose windows reach the edit are recomputed, only the model chunks
+    // reading those frames are run again, and only the peaks near the logits
+    // they rewrite are picked again, so the cost follows the edit size rather
+    // than the track length. Results equal analyze_editable() on the edited
+    // audio, except with the Linear resampler, whose recursive filter is only
+    // followed for a few hundred samples past the edit. Edits that change the
+    // number of Mel frames, or a state without a spectrogram of this length,
+    // fall back to a full analysis.
+    BeatResult reanalyze(std::span<const float> audio, int samplerate, int channels,
+                         size_t first_frame, size_t last_frame, EditableAnalysis& state);
+
+    // Block reader for process_stream(): writes up to max_frames mono samples at
+    // 22050 Hz into buffer and returns the number written (0 = end of stream)
+    using AudioReader = std::function<size_t(float* buffer, size_t max_frames)>;
+
+    // Process audio delivered block by block. The Mel spectrogram is computed as
+    // blocks arrive, so memory use does not grow with the length of the audio.
+    BeatResult process_stream(const AudioReader& read_block);
+
+    // Decode a file (WAV, MP3, FLAC) in blocks at its native format; the blocks are
+    // downmixed and resampled like process_audio() input (resample_quality applies).
+    // Throws std::runtime_error if it cannot be decoded.
+    BeatResult process_file(const std::string& audio_path);
+
+    // Create an analyzer that shares this instance's ONNX session (no model reload)
+    // but has its own buffers. process_audio() is not thread-safe on one instance;
+    // give each worker thread its own shared analyzer instead.
+    BeatThis share_session() const;
+
+    // Attach a profiling observer (nullptr detaches it). Without an observer and
+    // with collect_timings off, no clocks are read. Analyzers created by
+    // share_session() afterwards inherit the observer.
+    void set_observer(std::shared_ptr<BeatThisObserver> observer);
+
+    // Attach a result cache (nullptr detaches it). process_audio() then hashes
+    // the input first and returns a cached result for audio analyzed before with
+    // the same model and settings. process_stream() and process_file() never
+    // hold the whole signal and bypass the cache. Analyzers created by
+    // share_session() afterwards use the same cache.
+    void set_cache(std::shared_ptr<ResultCache> cache);
 
 private:
+    friend class BeatTracker;   // Shares the ONNX session for streaming analysis
+    friend class AsyncAnalyzer; // Shares the ONNX session across its worker threads
+
+    // Runs inference and postprocessing on the current spectrogram
+    BeatResult analyze_spectrogram();
+
+    // process_audio() for every sample format
+    template <typename Sample>
+    BeatResult process_samples(const Sample* audio_data, size_t num_samples, int samplerate, int channels);
+
+    // Full analysis of analyze_editable() (and of reanalyze() after length changes)
+    BeatResult analyze_for_editing(const float* audio_data, size_t num_frames, int samplerate, int channels,
+                                   EditableAnalysis& state);
+
+    // Result of the peaks in state; completes the call
+    BeatResult finish_editable(EditableAnalysis& state);
+
+    const BeatThisConfig& get_config() const;
+
+    // Creates an inference processor on this instance's session (unbatched by default)
+    std::unique_ptr<InferenceProcessor> create_inference_processor(int max_batch_size = 1) const;
+
     class Impl;
     std::unique_ptr<Impl> pImpl;
+
+    explicit BeatThis(std::unique_ptr<Impl> impl);
 };
 
 } // namespace BeatThis
\ No newline at end of file
@@ -0,0 +1,655 @@
+// beat_this_bench: times each stage of the analysis pipeline and prints JSON
+//
+// Runs the same stages as BeatThis::process_audio (downmix, resample,
+// MelSpectrogram::compute, InferenceProcessor::process_spectrogram and
+// Postprocessor::process) one by one on synthetic and/or decoded inputs, and
+// reports wall time, real-time factor and peak RSS for each, followed by the
+// end-to-end process_audio() call. Each input also gets a "mel_parity" entry
+// comparing the selected Mel kernel with the double-precision reference path.
+// With --verify, the linear-time peak picking, downbeat snapping and beat
+// counting of the Postprocessor are checked against brute-force references on
+// tie-heavy random logits and on the logits of every input.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <numeric>
+#include <numbers>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <memory>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "miniaudio.h"
+#include "onnxruntime_cxx_api.h"
+
+#include "beat_this_api.h"
+#include "MelSpectrogram.h"
+#include "InferenceProcessor.h"
+#include "Postprocessor.h"
+#include "Resampler.h"
+#include "PipelineOptions.h"
+
+namespace {
+    using BeatThis::model_fps;
+    using BeatThis::target_samplerate;
+
+    struct BenchOptions {
+        std::string model_path;
+        std::vector<std::string> audio_files;  // Real inputs (decoded at their native format)
+        std::vector<double> seconds = {30.0};  // Synthetic input lengths; also trims/loops real inputs if given
+        bool seconds_given = false;
+        bool synthetic = true;
+        int samplerate = 44100;                // Format of the synthetic input
+        int channels = 2;
+        int repeat = 5;                        // Timed iterations per input
+        int warmup = 1;                        // Untimed iterations per input
+        bool reference_kernel = false;
+        bool verify = false;                   // Check postprocessing against brute-force references
+        std::string output_path;               // Empty = stdout
+        BeatThis::BeatThisConfig config;
+    };
+
+    struct BenchInput {
+        std::string name;
+        std::vector<float> samples;  // Interleaved
+        int samplerate = 0;
+        int channels = 0;
+
+        double duration() const {
+            return static_cast<double>(samples.size()) / channels / samplerate;
+        }
+    };
+
+    // Samples of one stage over all timed iterations
+    struct StageStats {
+        std::string name;
+        std::vector<double> seconds;
+        size_t peak_rss = 0;
+    };
+
+    // Selected Mel kernel against the double-precision reference on one input
+    struct MelParity {
+        double kernel_seconds = 0.0;
+        double reference_seconds = 0.0;
+        double max_abs_error = 0.0;
+        double mean_abs_error = 0.0;
+    };
+
+    // Peak resident set size in bytes (0 if unknown)
+    size_t peak_rss_bytes() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            return counters.PeakWorkingSetSize;
+        }
+        return 0;
+#elif defined(__linux__)
+        // VmHWM can be reset through clear_refs, ru_maxrss cannot
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.rfind("VmHWM:", 0) == 0) {
+                return static_cast<size_t>(std::strtoull(line.c_str() + 6, nullptr, 10)) * 1024;
+            }
+        }
+        return 0;
+#else
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return static_cast<size_t>(usage.ru_maxrss); // Bytes on macOS
+#endif
+    }
+
+    // Resets the peak RSS to the current RSS so it can be measured per stage.
+    // Only possible on Linux; elsewhere the value is the process-wide peak.
+    bool reset_peak_rss() {
+#ifdef __linux__
+        std::ofstream clear_refs("/proc/self/clear_refs");
+        clear_refs << "5";
+        return static_cast<bool>(clear_refs);
+#else
+        return false;
+#endif
+    }
+
+    // Click track with decaying noise bursts at 120 BPM, accented every 4 beats
+    BenchInput make_synthetic_input(double seconds, int samplerate, int channels) {
+        BenchInput input;
+        input.name = "synthetic_" + std::to_string(static_cast<int>(seconds)) + "s";
+        input.samplerate = samplerate;
+        input.channels = channels;
+
+        size_t num_frames = static_cast<size_t>(seconds * samplerate);
+        input.samples.resize(num_frames * channels);
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+
+        size_t beat_period = static_cast<size_t>(0.5 * samplerate);
+        for (size_t i = 0; i < num_frames; ++i) {
+            size_t beat = i / beat_period;
+            double t = static_cast<double>(i % beat_period) / samplerate;
+            double gain = (beat % 4 == 0 ? 0.8 : 0.4) * std::exp(-t * 40.0);
+            float tone = static_cast<float>(std::sin(2.0 * std::numbers::pi * 220.0 * i / samplerate));
+            float sample = static_cast<float>(gain) * noise(rng) + 0.05f * tone;
+            for (int ch = 0; ch < channels; ++ch) {
+                input.samples[i * channels + ch] = sample;
+            }
+        }
+        return input;
+    }
+
+    // Runs verifying Postprocessors on random logits drawn from a few levels, so
+    // plateaus, ties within the kernel window and downbeats halfway between two
+    // beats are common. Throws on the first difference to the references;
+    // returns the number of inputs checked.
+    int verify_postprocessor_random() {
+        // The count warnings of the random inputs are not of interest
+        struct CerrSilencer {
+            std::streambuf* saved = std::cerr.rdbuf(nullptr);
+            ~CerrSilencer() { std::cerr.rdbuf(saved); }
+        } silencer;
+
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> length(0, 400);
+        std::uniform_int_distribution<int> level(-2, 2);
+        std::bernoulli_distribution downbeat_frame(0.25);
+        int trials = 0;
+        for (int kernel_size : {1, 3, 7, 11}) {
+            for (int dedup_width : {0, 1, 3}) {
+                Postprocessor postprocessor(model_fps, kernel_size, 0.0f, dedup_width, true);
+                for (int i = 0; i < 500; ++i, ++trials) {
+                    std::vector<float> beat(length(rng));
+                    std::vector<float> downbeat(beat.size(), -1.0f);
+                    for (size_t j = 0; j < beat.size(); ++j) {
+                        beat[j] = static_cast<float>(level(rng));
+                        if (downbeat_frame(rng)) {
+                            downbeat[j] = static_cast<float>(level(rng));
+                        }
+                    }
+                    postprocessor.process(beat, downbeat);
+                    std::vector<int> beat_peaks;
+                    std::vector<int> downbeat_peaks;
+                    postprocessor.pick_peaks(beat, downbeat, beat_peaks, downbeat_peaks);
+                    postprocessor.make_result(beat_peaks, downbeat_peaks);
+                }
+            }
+        }
+        return trials;
+    }
+
+    bool load_input(const std::string& path, BenchInput& input) {
+        ma_decoder decoder;
+        ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
+        ma_result result = ma_decoder_init_file(path.c_str(), &config, &decoder);
+        if (result != MA_SUCCESS) {
+            std::cerr << "Error: could not open audio file '" << path << "': " << ma_result_description(result) << std::endl;
+            return false;
+        }
+
+        input.name = std::filesystem::path(path).filename().string();
+        input.samplerate = static_cast<int>(decoder.outputSampleRate);
+        input.channels = static_cast<int>(decoder.outputChannels);
+
+        std::vector<float> block(static_cast<size_t>(1 << 16) * input.channels);
+        for (;;) {
+            ma_uint64 frames_read = 0;
+            result = ma_decoder_read_pcm_frames(&decoder, block.data(), 1 << 16, &frames_read);
+            input.samples.insert(input.samples.end(), block.begin(), block.begin() + frames_read * input.channels);
+            if (result != MA_SUCCESS || frames_read == 0) {
+                break;
+            }
+        }
+        ma_decoder_uninit(&decoder);
+
+        if (input.samples.empty()) {
+            std::cerr << "Error: no audio decoded from '" << path << "'" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Trims or loops a decoded input to the requested length
+    BenchInput fit_to_length(const BenchInput& source, double seconds) {
+        BenchInput input = source;
+        input.name = source.name + "_" + std::to_string(static_cast<int>(seconds)) + "s";
+        size_t length = static_cast<size_t>(seconds * source.samplerate) * source.channels;
+        input.samples.resize(length);
+        for (size_t i = source.samples.size(); i < length; ++i) {
+            input.samples[i] = source.samples[i % source.samples.size()];
+        }
+        return input;
+    }
+
+    std::string json_escape(const std::string& text) {
+        std::ostringstream out;
+        for (unsigned char c : text) {
+            switch (c) {
+                case '"':  out << "\\\""; break;
+                case '\\': out << "\\\\"; break;
+                case '\n': out << "\\n"; break;
+                case '\t': out << "\\t"; break;
+                default:
+                    if (c < 0x20) {
+                        out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+                    } else {
+                        out << c;
+                    }
+            }
+        }
+        return out.str();
+    }
+
+    double median(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        size_t mid = values.size() / 2;
+        return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2.0;
+    }
+
+    void write_stage(std::ostream& out, const StageStats& stage, double audio_seconds, const char* indent) {
+        double best = *std::min_element(stage.seconds.begin(), stage.seconds.end());
+        double mean = std::accumulate(stage.seconds.begin(), stage.seconds.end(), 0.0) / stage.seconds.size();
+        double mid = median(stage.seconds);
+        out << indent << "\"" << stage.name << "\": {"
+            << "\"min_s\": " << best << ", "
+            << "\"median_s\": " << mid << ", "
+            << "\"mean_s\": " << mean << ", "
+            << "\"rtf\": " << mid / audio_seconds << ", "
+            << "\"peak_rss_bytes\": " << stage.peak_rss << "}";
+    }
+
+    class StageRunner {
+    public:
+        // Stages are built from the analyzer's config so they match its end_to_end pipeline
+        StageRunner(const BeatThis::BeatThis& analyzer, const BenchOptions& options)
+            : StageRunner(analyzer, analyzer.get_config(), options) {}
+
+        // Runs every stage once; records timings if stats is non-null
+        void run(const BenchInput& input, std::vector<StageStats>* stats,
+                 std::vector<std::vector<InferenceProcessor::RunTiming>>* chunk_runs,
+                 BeatThis::BeatThis& analyzer, bool measure_rss) {
+            size_t num_frames = input.samples.size() / input.channels;
+
+            // Filter tables are built outside the timed region, like the API's resampler cache
+            Resampler downmixer(input.samplerate, input.samplerate, input.channels);
+            Resampler resampler(input.samplerate, target_samplerate, 1, quality);
+
+            std::vector<float> mono;
+            std::vector<float> resampled;
+            Spectrogram spectrogram;
+            std::pair<std::vector<float>, std::vector<float>> logits;
+            Postprocessor::Result postprocessed;
+            BeatThis::BeatResult result;
+
+            size_t stage = 0;
+            auto timed = [&](const char* name, const std::function<void()>& body) {
+                if (stats && stats->size() <= stage) {
+                    stats->push_back({name, {}, 0});
+                }
+                if (measure_rss) {
+                    reset_peak_rss();
+                }
+                auto start = std::chrono::steady_clock::now();
+                body();
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                if (stats) {
+                    (*stats)[stage].seconds.push_back(elapsed.count());
+                    if (measure_rss) {
+                        (*stats)[stage].peak_rss = std::max((*stats)[stage].peak_rss, peak_rss_bytes());
+                    }
+                }
+                ++stage;
+            };
+
+            timed("downmix", [&] {
+                mono.reserve(num_frames);
+                downmixer.process(input.samples.data(), num_frames, mono);
+            });
+            timed("resample", [&] {
+                resampler.process(mono.data(), mono.size(), resampled);
+                resampler.flush(resampled);
+            });
+            timed("mel_spectrogram", [&] {
+                spectrogram = mel_spectrogram.compute(resampled);
+            });
+            timed("inference", [&] {
+                logits = inference_processor->process_spectrogram(spectrogram);
+            });
+            if (chunk_runs) {
+                chunk_runs->push_back(inference_processor->get_last_run_timings());
+            }
+            timed("postprocess", [&] {
+                postprocessed = postprocessor.process(logits.first, logits.second);
+            });
+            if (verify) {
+                // Untimed; throws if the fast paths disagree with the references
+                verifying_postprocessor.process(logits.first, logits.second);
+            }
+            timed("end_to_end", [&] {
+                result = analyzer.process_audio(input.samples, input.samplerate, input.channels);
+            });
+
+            last_spectrogram_frames = spectrogram.num_frames();
+            last_num_beats = result.beats.size();
+        }
+
+        // Times the selected Mel kernel and the reference path once each on the
+        // input's 22050 Hz signal and compares their outputs
+        MelParity mel_parity(const BenchInput& input) {
+            size_t num_frames = input.samples.size() / input.channels;
+            Resampler downmixer(input.samplerate, input.samplerate, input.channels);
+            Resampler resampler(input.samplerate, target_samplerate, 1, quality);
+            std::vector<float> mono;
+            std::vector<float> resampled;
+            downmixer.process(input.samples.data(), num_frames, mono);
+            resampler.process(mono.data(), mono.size(), resampled);
+            resampler.flush(resampled);
+
+            MelParity parity;
+            Spectrogram kernel_output;
+            Spectrogram reference_output;
+            auto start = std::chrono::steady_clock::now();
+            mel_spectrogram.compute(resampled, kernel_output);
+            auto middle = std::chrono::steady_clock::now();
+            reference_mel.compute(resampled, reference_output);
+            auto end = std::chrono::steady_clock::now();
+            parity.kernel_seconds = std::chrono::duration<double>(middle - start).count();
+            parity.reference_seconds = std::chrono::duration<double>(end - middle).count();
+
+            for (size_t i = 0; i < kernel_output.size(); ++i) {
+                double error = std::abs(static_cast<double>(kernel_output.data()[i]) - reference_output.data()[i]);
+                parity.max_abs_error = std::max(parity.max_abs_error, error);
+                parity.mean_abs_error += error;
+            }
+            if (kernel_output.size() > 0) {
+                parity.mean_abs_error /= static_cast<double>(kernel_output.size());
+            }
+            return parity;
+        }
+
+        size_t last_spectrogram_frames = 0;
+        size_t last_num_beats = 0;
+
+    private:
+        StageRunner(const BeatThis::BeatThis& analyzer, const BeatThis::BeatThisConfig& config,
+                    const BenchOptions& options)
+            : inference_processor(analyzer.create_inference_processor(config.max_batch_size)),
+              mel_spectrogram([&] {
+                  MelSpectrogram::Options mel_options = BeatThis::make_mel_options(config);
+                  mel_options.use_reference_kernel = options.reference_kernel;
+                  return mel_options;
+              }()),
+              reference_mel([&] {
+                  MelSpectrogram::Options mel_options = BeatThis::make_mel_options(config);
+                  mel_options.use_reference_kernel = true;
+                  mel_options.fast_log = false;
+                  return mel_options;
+              }()),
+              postprocessor(model_fps, config.postprocess.kernel_size, config.postprocess.threshold,
+                            config.postprocess.dedup_width),
+              quality(BeatThis::to_resampler_quality(config.resample_quality)),
+              verifying_postprocessor(model_fps, config.postprocess.kernel_size, config.postprocess.threshold,
+                                      config.postprocess.dedup_width, true),
+              verify(options.verify) {}
+
+        std::unique_ptr<InferenceProcessor> inference_processor;
+        MelSpectrogram mel_spectrogram;
+        MelSpectrogram reference_mel;
+        Postprocessor postprocessor;
+        Resampler::Quality quality;
+        Postprocessor verifying_postprocessor;
+        bool verify;
+    };
+
+    void print_usage(const char* program) {
+        std::cerr << "Usage: " << program << " <onnx_model_path> [options]\n"
+                  << "  --audio <file>            Benchmark a decoded audio file (repeatable)\n"
+                  << "  --seconds <s>[,<s>...]    Input lengths (default 30); real inputs are trimmed or looped\n"
+                  << "  --no-synthetic            Skip the synthetic input\n"
+                  << "  --samplerate <hz>         Sample rate of the synthetic input (default 44100)\n"
+                  << "  --channels <n>            Channel count of the synthetic input (default 2)\n"
+                  << "  --repeat <n>              Timed iterations per input (default 5)\n"
+                  << "  --warmup <n>              Untimed iterations per input (default 1)\n"
+                  << "  --batch-size <n>          Chunks per inference run\n"
+                  << "  --intra-threads <n>       ONNX Runtime intra-op threads\n"
+                  << "  --inter-threads <n>       ONNX Runtime inter-op threads\n"
+                  << "  --frontend-threads <n>    Mel spectrogram worker threads\n"
+                  << "  --resampler <linear|sinc> Resampling algorithm\n"
+                  << "  --reference-kernel        Use the double-precision mel filterbank\n"
+                  << "  --fast-log                Use the vectorized approximate log1p in the mel frontend\n"
+                  << "  --verify                  Check postprocessing against brute-force references\n"
+                  << "  --output <file>           Write JSON here instead of stdout" << std::endl;
+    }
+
+    bool parse_seconds(const std::string& value, std::vector<double>& seconds) {
+        seconds.clear();
+        std::stringstream stream(value);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            double length = std::atof(item.c_str());
+            if (length <= 0.0) {
+                std::cerr << "Invalid --seconds value: " << value << std::endl;
+                return false;
+            }
+            seconds.push_back(length);
+        }
+        return !seconds.empty();
+    }
+
+    bool parse_options(int argc, char* argv[], BenchOptions& options) {
+        if (argc < 2) {
+            return false;
+        }
+        options.model_path = argv[1];
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--no-synthetic") {
+                options.synthetic = false;
+            } else if (arg == "--reference-kernel") {
+                options.reference_kernel = true;
+            } else if (arg == "--fast-log") {
+                options.config.fast_log = true;
+            } else if (arg == "--verify") {
+                options.verify = true;
+            } else if (!has_value) {
+                std::cerr << "Unknown argument or missing value: " << arg << std::endl;
+                return false;
+            } else if (arg == "--audio") {
+                options.audio_files.push_back(argv[++i]);
+            } else if (arg == "--seconds") {
+                if (!parse_seconds(argv[++i], options.seconds)) {
+                    return false;
+                }
+                options.seconds_given = true;
+            } else if (arg == "--samplerate") {
+                options.samplerate = std::max(1, std::atoi(argv[++i]));
+            } else if (arg == "--channels") {
+                options.channels = std::max(1, std::atoi(argv[++i]));
+            } else if (arg == "--repeat") {
+                options.repeat = std::max(1, std::atoi(argv[++i]));
+            } else if (arg == "--warmup") {
+                options.warmup = std::max(0, std::atoi(argv[++i]));
+            } else if (arg == "--batch-size") {
+                options.config.max_batch_size = std::max(1, std::atoi(argv[++i]));
+            } else if (arg == "--intra-threads") {
+                options.config.intra_op_threads = std::atoi(argv[++i]);
+            } else if (arg == "--inter-threads") {
+                options.config.inter_op_threads = std::atoi(argv[++i]);
+            } else if (arg == "--frontend-threads") {
+                options.config.frontend_threads = std::max(1, std::atoi(argv[++i]));
+            } else if (arg == "--resampler") {
+                std::string value = argv[++i];
+                if (value == "linear") options.config.resample_quality = BeatThis::ResampleQuality::Linear;
+                else if (value == "sinc") options.config.resample_quality = BeatThis::ResampleQuality::Sinc;
+                else {
+                    std::cerr << "Invalid --resampler value: " << value << std::endl;
+                    return false;
+                }
+            } else if (arg == "--output") {
+                options.output_path = argv[++i];
+            } else {
+                std::cerr << "Unknown argument: " << arg << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<BenchInput> inputs;
+    if (options.synthetic) {
+        for (double seconds : options.seconds) {
+            inputs.push_back(make_synthetic_input(seconds, options.samplerate, options.channels));
+        }
+    }
+    for (const auto& path : options.audio_files) {
+        BenchInput decoded;
+        if (!load_input(path, decoded)) {
+            return 1;
+        }
+        if (options.seconds_given) {
+            for (double seconds : options.seconds) {
+                inputs.push_back(fit_to_length(decoded, seconds));
+            }
+        } else {
+            inputs.push_back(std::move(decoded));
+        }
+    }
+    if (inputs.empty()) {
+        std::cerr << "Error: nothing to benchmark" << std::endl;
+        return 1;
+    }
+
+    std::ofstream output_file;
+    if (!options.output_path.empty()) {
+        output_file.open(options.output_path);
+        if (!output_file.is_open()) {
+            std::cerr << "Error: could not open output file: " << options.output_path << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = options.output_path.empty() ? std::cout : output_file;
+
+    try {
+        std::string model_path = std::filesystem::absolute(options.model_path).string();
+
+        // End-to-end analyzer; the stage runner shares its session, so both measure the same configuration
+        BeatThis::BeatThis analyzer(model_path, options.config);
+
+        StageRunner runner(analyzer, options);
+        if (options.verify) {
+            int trials = verify_postprocessor_random();
+            std::cerr << "Verified postprocessing against the references on " << trials << " random inputs" << std::endl;
+        }
+        bool per_stage_rss = reset_peak_rss();
+
+        out << std::setprecision(6);
+        out << "{\n"
+            << "  \"config\": {"
+            << "\"repeat\": " << options.repeat << ", "
+            << "\"warmup\": " << options.warmup << ", "
+            << "\"max_batch_size\": " << options.config.max_batch_size << ", "
+            << "\"intra_op_threads\": " << options.config.intra_op_threads << ", "
+            << "\"inter_op_threads\": " << options.config.inter_op_threads << ", "
+            << "\"frontend_threads\": " << options.config.frontend_threads << ", "
+            << "\"resampler\": \"" << (options.config.resample_quality == BeatThis::ResampleQuality::Sinc ? "sinc" : "linear") << "\", "
+            << "\"reference_kernel\": " << (options.reference_kernel ? "true" : "false") << ", "
+            << "\"fast_log\": " << (options.config.fast_log ? "true" : "false") << ", "
+            << "\"verify\": " << (options.verify ? "true" : "false") << ", "
+            << "\"peak_rss_scope\": \"" << (per_stage_rss ? "stage" : "process") << "\"},\n"
+            << "  \"inputs\": [\n";
+
+        for (size_t n = 0; n < inputs.size(); ++n) {
+            const BenchInput& input = inputs[n];
+            std::cerr << "Benchmarking " << input.name << " (" << input.duration() << " s)" << std::endl;
+
+            for (int i = 0; i < options.warmup; ++i) {
+                runner.run(input, nullptr, nullptr, analyzer, false);
+            }
+            std::vector<StageStats> stats;
+            std::vector<std::vector<InferenceProcessor::RunTiming>> chunk_runs;
+            for (int i = 0; i < options.repeat; ++i) {
+                runner.run(input, &stats, &chunk_runs, analyzer, per_stage_rss);
+            }
+            if (!per_stage_rss) {
+                // Only the process-wide peak is available
+                for (auto& stage : stats) {
+                    stage.peak_rss = peak_rss_bytes();
+                }
+            }
+
+            double audio_seconds = input.duration();
+            out << "    {\n"
+                << "      \"name\": \"" << json_escape(input.name) << "\",\n"
+                << "      \"duration_s\": " << audio_seconds << ",\n"
+                << "      \"samplerate\": " << input.samplerate << ",\n"
+                << "      \"channels\": " << input.channels << ",\n"
+                << "      \"frames\": " << runner.last_spectrogram_frames << ",\n"
+                << "      \"beats\": " << runner.last_num_beats << ",\n"
+                << "      \"stages\": {\n";
+            for (size_t s = 0; s < stats.size(); ++s) {
+                write_stage(out, stats[s], audio_seconds, "        ");
+                out << (s + 1 < stats.size() ? ",\n" : "\n");
+            }
+            out << "      },\n";
+
+            MelParity parity = runner.mel_parity(input);
+            out << "      \"mel_parity\": {"
+                << "\"kernel_s\": " << parity.kernel_seconds << ", "
+                << "\"reference_s\": " << parity.reference_seconds << ", "
+                << "\"max_abs_error\": " << parity.max_abs_error << ", "
+                << "\"mean_abs_error\": " << parity.mean_abs_error << "},\n";
+
+            // Session runs of the inference stage (one per batch of equal-length chunks),
+            // median over the timed iterations
+            out << "      \"inference_runs\": [\n";
+            const auto& runs = chunk_runs.front();
+            for (size_t r = 0; r < runs.size(); ++r) {
+                std::vector<double> seconds;
+                for (const auto& iteration : chunk_runs) {
+                    seconds.push_back(iteration[r].seconds);
+                }
+                out << "        {\"first_chunk\": " << runs[r].first_chunk
+                    << ", \"chunks\": " << runs[r].chunks
+                    << ", \"frames\": " << runs[r].frames
+                    << ", \"median_s\": " << median(seconds) << "}"
+                    << (r + 1 < runs.size() ? ",\n" : "\n");
+            }
+            out << "      ]\n"
+                << "    }" << (n + 1 < inputs.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}" << std::endl;
+    } catch (const Ort::Exception& e) {
+        std::cerr << "ONNX Runtime error: " << e.what() << std::endl;
+        return 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
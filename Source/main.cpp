@@ -6,13 +6,22 @@
 #include <set>
 #include <algorithm>
 #include <cmath>
-#include <numbers>
+#include <cctype>
+#include <cstdlib>
 #include <filesystem> // For absolute path conversion
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <memory>
 
 #include "miniaudio.h"
 
 
 #include "beat_this_api.h"
+#include "AudioLoader.h"
+#include "BeatArchive.h"
+#include "ClickRenderer.h"
 
 // Function to load audio from file
 bool load_audio_for_example(const std::string& path, std::vector<float>& audio_buffer, int& samplerate, int& channels) {
@@ -67,231 +76,510 @@ bool save_beats_to_file(const BeatThis::BeatResult& result, const std::string& o
     return true;
 }
 
-// Audio generation parameters
+// Function to save beat information as text or in the binary format (see BeatArchive.h)
+bool write_beats(const BeatThis::BeatResult& result, const std::string& output_filepath, bool binary) {
+    if (!binary) {
+        return save_beats_to_file(result, output_filepath);
+    }
+    try {
+        BeatThis::save_beats(result, output_filepath);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Sample rate of the --output-audio click track
 const int SAMPLE_RATE = 44100; // Hz
-const double DURATION_PER_BEAT = 0.1; // seconds
-const double ATTACK_TIME = 0.01; // seconds
-const double DECAY_TIME = 0.05; // seconds
-
-// Function to generate a sine wave with ADSR-like envelope
-std::vector<float> generate_sine_wave(
-    double frequency, 
-    double duration, 
-    double attack_time, 
-    double decay_time,
-    int sample_rate
-) {
-    int num_samples = static_cast<int>(duration * sample_rate);
-    std::vector<float> waveform(num_samples);
-
-    int attack_samples = static_cast<int>(attack_time * sample_rate);
-    int decay_samples = static_cast<int>(decay_time * sample_rate);
-
-    for (int i = 0; i < num_samples; ++i) {
-        double t = static_cast<double>(i) / sample_rate;
-        double amplitude = 1.0;
-
-        // Attack phase
-        if (i < attack_samples) {
-            amplitude = static_cast<double>(i) / attack_samples;
+
+// Function to generate audio from beats
+bool generate_beats_audio(const BeatThis::BeatResult& result, const std::string& output_wav_file) {
+    return ClickRenderer(SAMPLE_RATE, 1).write_wav(result, output_wav_file);
+}
+
+// Function to generate mixed audio (original + beats): the music at 70% and the
+// clicks at 30% on every channel, in the original sample rate and channel layout
+bool generate_mixed_audio(const BeatThis::BeatResult& result,
+                         const std::vector<float>& original_audio,
+                         int original_samplerate,
+                         int original_channels,
+                         const std::string& output_wav_file) {
+    ClickRenderer renderer(original_samplerate, original_channels, 0.3f);
+    return renderer.write_wav(result, output_wav_file, original_audio.data(),
+                              original_audio.size() / static_cast<size_t>(original_channels), 0.7f);
+}
+
+// Function to parse the model/runtime options shared by single-file and batch mode.
+// Returns the number of arguments consumed (the option and its value), 0 if arg
+// is not a config option, or -1 if its value is missing or invalid.
+int parse_config_option(const std::string& arg, int i, int argc, char* argv[], BeatThis::BeatThisConfig& config) {
+    static const std::vector<std::string> value_options = {
+        "--intra-threads", "--inter-threads", "--graph-opt", "--provider", "--device-id",
+        "--optimized-model", "--batch-size", "--frontend-threads", "--resampler",
+        "--threshold", "--kernel-size", "--dedup-width"};
+    if (arg == "--parallel-exec") {
+        config.parallel_execution = true;
+        return 1;
+    }
+    if (arg == "--pipelined") {
+        config.pipelined = true;
+        return 1;
+    }
+    if (arg == "--fast-log") {
+        config.fast_log = true;
+        return 1;
+    }
+    if (std::find(value_options.begin(), value_options.end(), arg) == value_options.end()) {
+        return 0;
+    }
+    if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << arg << std::endl;
+        return -1;
+    }
+    std::string value = argv[i + 1];
+
+    if (arg == "--intra-threads") {
+        config.intra_op_threads = std::atoi(value.c_str());
+    } else if (arg == "--inter-threads") {
+        config.inter_op_threads = std::atoi(value.c_str());
+    } else if (arg == "--device-id") {
+        config.device_id = std::atoi(value.c_str());
+    } else if (arg == "--batch-size") {
+        config.max_batch_size = std::max(1, std::atoi(value.c_str()));
+    } else if (arg == "--frontend-threads") {
+        config.frontend_threads = std::max(1, std::atoi(value.c_str()));
+    } else if (arg == "--threshold") {
+        config.postprocess.threshold = static_cast<float>(std::atof(value.c_str()));
+    } else if (arg == "--kernel-size") {
+        config.postprocess.kernel_size = std::atoi(value.c_str());
+    } else if (arg == "--dedup-width") {
+        config.postprocess.dedup_width = std::max(0, std::atoi(value.c_str()));
+    } else if (arg == "--optimized-model") {
+        config.optimized_model_path = std::filesystem::absolute(value).string();
+    } else if (arg == "--graph-opt") {
+        if (value == "disabled") config.graph_optimization = BeatThis::GraphOptimization::Disabled;
+        else if (value == "basic") config.graph_optimization = BeatThis::GraphOptimization::Basic;
+        else if (value == "extended") config.graph_optimization = BeatThis::GraphOptimization::Extended;
+        else if (value == "all") config.graph_optimization = BeatThis::GraphOptimization::All;
+        else {
+            std::cerr << "Invalid --graph-opt value: " << value << std::endl;
+            return -1;
+        }
+    } else if (arg == "--resampler") {
+        if (value == "linear") config.resample_quality = BeatThis::ResampleQuality::Linear;
+        else if (value == "sinc") config.resample_quality = BeatThis::ResampleQuality::Sinc;
+        else {
+            std::cerr << "Invalid --resampler value: " << value << std::endl;
+            return -1;
         }
-        // Decay phase
-        else if (i > num_samples - decay_samples) {
-            amplitude = static_cast<double>(num_samples - i) / decay_samples;
+    } else if (arg == "--provider") {
+        if (value == "cpu") config.execution_provider = BeatThis::ExecutionProvider::CPU;
+        else if (value == "cuda") config.execution_provider = BeatThis::ExecutionProvider::CUDA;
+        else if (value == "coreml") config.execution_provider = BeatThis::ExecutionProvider::CoreML;
+        else if (value == "directml") config.execution_provider = BeatThis::ExecutionProvider::DirectML;
+        else if (value == "openvino") config.execution_provider = BeatThis::ExecutionProvider::OpenVINO;
+        else {
+            std::cerr << "Invalid --provider value: " << value << std::endl;
+            return -1;
         }
+    }
+    return 2;
+}
 
-        waveform[i] = static_cast<float>(amplitude * std::sin(2.0 * std::numbers::pi * frequency * t));
+// Function to parse --beats-format: text (default) or binary
+bool parse_beats_format(const std::string& value, bool& binary) {
+    if (value == "text" || value == "binary") {
+        binary = value == "binary";
+        return true;
     }
-    return waveform;
+    std::cerr << "Invalid --beats-format value: " << value << std::endl;
+    return false;
 }
 
-// Function to write WAV file
-bool write_wav_file(const std::string& filepath, const std::vector<float>& audio_data, int sample_rate, int channels = 1) {
-    ma_result result;
-    ma_encoder encoder;
-    ma_encoder_config config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_f32, (ma_uint32)channels, (ma_uint32)sample_rate);
+// Options for --batch mode
+struct BatchOptions {
+    std::string source;      // Directory to scan or text file with one audio path per line
+    std::string output_dir;  // Where .beats files go (empty = next to each audio file)
+    int jobs = 0;            // Worker threads (0 = hardware concurrency)
+    bool binary_beats = false; // Write .btb files instead of text .beats files
+    std::string archive;     // If set, all results go into this beat archive instead of one file each
+    int prefetch = 0;        // Files decoded ahead on loader threads (0 = each worker decodes its own file)
+    int decode_threads = 2;  // Loader threads with prefetch
+    size_t prefetch_mb = 512; // Decoded audio held ahead of the workers, in MiB
+};
+
+// Formats miniaudio can decode
+const std::set<std::string> AUDIO_EXTENSIONS = {".wav", ".mp3", ".flac"};
+
+// Function to collect the input files of a batch run (directories are scanned for `extensions`)
+bool collect_batch_inputs(const std::filesystem::path& source,
+                          const std::set<std::string>& extensions,
+                          std::vector<std::filesystem::path>& files,
+                          std::filesystem::path& root) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+
+    if (fs::is_directory(source, ec)) {
+        root = source;
+        for (fs::recursive_directory_iterator it(source, ec), end; !ec && it != end; it.increment(ec)) {
+            if (!it->is_regular_file(ec)) {
+                continue;
+            }
+            std::string ext = it->path().extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+            if (extensions.count(ext)) {
+                files.push_back(it->path());
+            }
+        }
+        if (ec) {
+            std::cerr << "Error: could not scan directory '" << source.string() << "': " << ec.message() << std::endl;
+            return false;
+        }
+        std::sort(files.begin(), files.end());
+        return true;
+    }
 
-    result = ma_encoder_init_file(filepath.c_str(), &config, &encoder);
-    if (result != MA_SUCCESS) {
-        std::cerr << "Error: Could not open WAV file for writing: " << ma_result_description(result) << std::endl;
+    std::ifstream list(source);
+    if (!list.is_open()) {
+        std::cerr << "Error: batch source is neither a directory nor a readable file list: " << source.string() << std::endl;
         return false;
     }
+    std::string line;
+    while (std::getline(list, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            files.push_back(fs::absolute(line));
+        }
+    }
+    root.clear();
+    return true;
+}
 
-    ma_uint64 frames_written = 0;
-    result = ma_encoder_write_pcm_frames(&encoder, audio_data.data(), audio_data.size() / channels, &frames_written);
-    if (result != MA_SUCCESS || frames_written != audio_data.size() / channels) {
-        std::cerr << "Error: Could not write all audio frames: " << ma_result_description(result) << std::endl;
-        ma_encoder_uninit(&encoder);
-        return false;
+// Function to place the output of a batch input: next to it, or mirrored into output_dir
+std::filesystem::path batch_output_path(const std::filesystem::path& input_path, const std::filesystem::path& root,
+                                        const BatchOptions& options, const std::string& extension) {
+    namespace fs = std::filesystem;
+    fs::path output_path;
+    if (options.output_dir.empty()) {
+        output_path = input_path;
+    } else if (!root.empty()) {
+        output_path = fs::path(options.output_dir) / fs::relative(input_path, root);
+    } else {
+        output_path = fs::path(options.output_dir) / input_path.filename();
     }
+    output_path.replace_extension(extension);
+    return output_path;
+}
 
-    ma_encoder_uninit(&encoder);
-    return true;
+// Function to name a batch input inside a beat archive: its path relative to the
+// batch directory (absolute for file lists), without the extension, so the audio
+// and the .logits files of one track get the same ID
+std::string batch_track_id(const std::filesystem::path& input_path, const std::filesystem::path& root) {
+    std::filesystem::path id = root.empty() ? input_path : std::filesystem::relative(input_path, root);
+    return id.replace_extension().generic_string();
 }
 
-// Function to generate audio from beats
-bool generate_beats_audio(const BeatThis::BeatResult& result, const std::string& output_wav_file) {
-    if (result.beats.empty()) {
-        std::cerr << "Error: No beats to generate audio from." << std::endl;
-        return false;
+// Function to open the beat archive a batch run writes all results to, if options.archive is set
+std::unique_ptr<BeatThis::BeatArchiveWriter> open_batch_archive(const BatchOptions& options) {
+    if (options.archive.empty()) {
+        return nullptr;
     }
+    std::filesystem::path archive_path = std::filesystem::absolute(options.archive);
+    std::error_code ec;
+    std::filesystem::create_directories(archive_path.parent_path(), ec);
+    return std::make_unique<BeatThis::BeatArchiveWriter>(archive_path.string());
+}
 
-    // Determine total duration of the audio to be generated
-    double total_duration = result.beats.back() + DURATION_PER_BEAT + DECAY_TIME;
-    int total_samples = static_cast<int>(total_duration * SAMPLE_RATE);
-    std::vector<float> final_audio(total_samples, 0.0f);
+// Function to process many files with one shared model and a pool of workers.
+// Each worker runs the whole decode -> mel -> inference -> write pipeline for one
+// file at a time, so the stages of different files overlap across workers. With
+// options.prefetch, an AudioLoader decodes the next files on its own threads
+// instead, so workers only analyze and never wait for storage or the decoder.
+int run_batch(const std::filesystem::path& onnx_path, const BeatThis::BeatThisConfig& config,
+              const BatchOptions& options) {
+    namespace fs = std::filesystem;
+
+    std::vector<fs::path> files;
+    fs::path root;
+    if (!collect_batch_inputs(fs::absolute(options.source), AUDIO_EXTENSIONS, files, root)) {
+        return 1;
+    }
+    if (files.empty()) {
+        std::cerr << "Error: no audio files found in " << options.source << std::endl;
+        return 1;
+    }
 
-    for (size_t i = 0; i < result.beats.size(); ++i) {
-        double frequency;
-        if (result.beat_counts[i] == 1) { // Downbeat
-            frequency = 880.0; // Hz
-        } else {
-            frequency = 440.0; // Hz
-        }
+    int jobs = options.jobs > 0 ? options.jobs : static_cast<int>(std::thread::hardware_concurrency());
+    jobs = std::max(1, std::min(jobs, static_cast<int>(files.size())));
 
-        std::vector<float> beat_waveform = generate_sine_wave(
-            frequency, DURATION_PER_BEAT, ATTACK_TIME, DECAY_TIME, SAMPLE_RATE
-        );
+    // The model is loaded once; every worker gets its own pipeline on the shared session
+    BeatThis::BeatThis beat_analyzer(onnx_path.string(), config);
 
-        // Mix the generated waveform into the final audio buffer
-        int start_sample = static_cast<int>(result.beats[i] * SAMPLE_RATE);
-        for (size_t j = 0; j < beat_waveform.size(); ++j) {
-            if (start_sample + j < total_samples) {
-                final_audio[start_sample + j] += beat_waveform[j];
-            }
+    std::cout << "Processing " << files.size() << " files with " << jobs << " jobs" << std::endl;
+
+    std::atomic<size_t> next_file{0};
+    std::atomic<size_t> failed{0};
+    std::mutex log_mutex;
+
+    // With an archive, the logits of --save-logits are stored in it as well
+    std::unique_ptr<BeatThis::BeatArchiveWriter> archive = open_batch_archive(options);
+
+    auto write_outputs = [&](const fs::path& audio_path, const BeatThis::BeatResult& result) {
+        if (archive) {
+            archive->add(batch_track_id(audio_path, root), result);
+            return;
+        }
+        fs::path output_path = batch_output_path(audio_path, root, options, options.binary_beats ? ".btb" : ".beats");
+        std::error_code ec;
+        fs::create_directories(output_path.parent_path(), ec);
+        if (!write_beats(result, output_path.string(), options.binary_beats)) {
+            throw std::runtime_error("could not write " + output_path.string());
         }
+        if (result.logits) {
+            BeatThis::save_logits(*result.logits, batch_output_path(audio_path, root, options, ".logits").string());
+        }
+    };
+    auto report_failure = [&](const fs::path& audio_path, const std::string& message) {
+        ++failed;
+        std::lock_guard<std::mutex> lock(log_mutex);
+        std::cerr << "Failed: " << audio_path.string() << ": " << message << std::endl;
+    };
+
+    std::unique_ptr<BeatThis::AudioLoader> loader;
+    if (options.prefetch > 0) {
+        BeatThis::LoaderConfig loader_config;
+        loader_config.num_threads = std::max(1, options.decode_threads);
+        loader_config.max_queued_files = static_cast<size_t>(options.prefetch);
+        loader_config.max_queued_bytes = options.prefetch_mb << 20;
+        std::vector<std::string> paths;
+        paths.reserve(files.size());
+        for (const auto& file : files) {
+            paths.push_back(file.string());
+        }
+        loader = std::make_unique<BeatThis::AudioLoader>(std::move(paths), loader_config);
     }
 
-    // Normalize audio to prevent clipping
-    float max_val = 0.0f;
-    for (float sample : final_audio) {
-        max_val = std::max(max_val, std::abs(sample));
-    }
-    if (max_val > 1.0f) {
-        for (float& sample : final_audio) {
-            sample /= max_val;
+    auto worker = [&](BeatThis::BeatThis analyzer) {
+        if (loader) {
+            BeatThis::LoadedAudio audio;
+            while (loader->next(audio)) {
+                const fs::path& audio_path = files[audio.index];
+                if (!audio.ok()) {
+                    report_failure(audio_path, audio.error);
+                    continue;
+                }
+                try {
+                    write_outputs(audio_path, analyzer.process_audio(audio.samples, audio.samplerate, audio.channels));
+                } catch (const std::exception& e) {
+                    report_failure(audio_path, e.what());
+                }
+            }
+            return;
         }
+        for (size_t i = next_file++; i < files.size(); i = next_file++) {
+            const fs::path& audio_path = files[i];
+            try {
+                // Decoded and analyzed block by block; memory does not grow with file length
+                write_outputs(audio_path, analyzer.process_file(audio_path.string()));
+            } catch (const std::exception& e) {
+                report_failure(audio_path, e.what());
+            }
+        }
+    };
+
+    auto start_time = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    threads.reserve(jobs);
+    for (int j = 0; j < jobs; ++j) {
+        threads.emplace_back(worker, beat_analyzer.share_session());
+    }
+    for (auto& thread : threads) {
+        thread.join();
     }
+    if (archive) {
+        archive->close();
+        std::cout << "Beats archived to: " << options.archive << std::endl;
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    size_t succeeded = files.size() - failed;
+    std::cout << "Processed " << succeeded << " of " << files.size() << " files in "
+              << std::fixed << std::setprecision(2) << elapsed << " s ("
+              << std::setprecision(2) << (elapsed > 0.0 ? files.size() / elapsed : 0.0) << " files/sec)" << std::endl;
 
-    return write_wav_file(output_wav_file, final_audio, SAMPLE_RATE);
+    return failed == 0 ? 0 : 1;
 }
 
-// Function to generate mixed audio (original + beats)
-bool generate_mixed_audio(const BeatThis::BeatResult& result, 
-                         const std::vector<float>& original_audio, 
-                         int original_samplerate,
-                         int original_channels,
-                         const std::string& output_wav_file) {
-    if (result.beats.empty()) {
-        std::cerr << "Error: No beats to generate audio from." << std::endl;
-        return false;
+// Function to re-run peak picking on the .logits files of a batch run without
+// loading the model, writing a .beats file for each
+int run_postprocess_batch(const BeatThis::PostprocessOptions& postprocess, const BatchOptions& options) {
+    namespace fs = std::filesystem;
+
+    std::vector<fs::path> files;
+    fs::path root;
+    if (!collect_batch_inputs(fs::absolute(options.source), {".logits"}, files, root)) {
+        return 1;
+    }
+    if (files.empty()) {
+        std::cerr << "Error: no .logits files found in " << options.source << std::endl;
+        return 1;
     }
 
-    // Preserve original audio characteristics
-    int output_samplerate = original_samplerate;
-    int output_channels = original_channels;
-    
-    // Calculate total duration
-    double last_beat_time = result.beats.back() + DURATION_PER_BEAT + DECAY_TIME;
-    double original_duration = static_cast<double>(original_audio.size()) / (output_samplerate * output_channels);
-    double total_duration = std::max(last_beat_time, original_duration);
-    
-    int total_samples = static_cast<int>(total_duration * output_samplerate * output_channels);
-    std::vector<float> final_audio(total_samples, 0.0f);
+    int jobs = options.jobs > 0 ? options.jobs : static_cast<int>(std::thread::hardware_concurrency());
+    jobs = std::max(1, std::min(jobs, static_cast<int>(files.size())));
 
-    // Copy original audio with reduced volume
-    size_t copied_samples = std::min(original_audio.size(), static_cast<size_t>(total_samples));
-    for (size_t i = 0; i < copied_samples; ++i) {
-        final_audio[i] = original_audio[i] * 0.7f;
-    }
+    std::cout << "Postprocessing " << files.size() << " files with " << jobs << " jobs" << std::endl;
 
-    // Add click track
-    for (size_t i = 0; i < result.beats.size(); ++i) {
-        double frequency = (result.beat_counts[i] == 1) ? 880.0 : 440.0; // Downbeat : Other beats
-        
-        std::vector<float> beat_waveform = generate_sine_wave(
-            frequency, DURATION_PER_BEAT, ATTACK_TIME, DECAY_TIME, output_samplerate
-        );
-
-        int start_frame = static_cast<int>(result.beats[i] * output_samplerate);
-        
-        for (size_t j = 0; j < beat_waveform.size(); ++j) {
-            int frame_pos = start_frame + j;
-            if (output_channels == 2) {
-                // Stereo: add click to both channels
-                int left_sample = frame_pos * 2;
-                int right_sample = frame_pos * 2 + 1;
-                if (left_sample < total_samples && right_sample < total_samples) {
-                    final_audio[left_sample] += beat_waveform[j] * 0.3f;
-                    final_audio[right_sample] += beat_waveform[j] * 0.3f;
+    std::unique_ptr<BeatThis::BeatArchiveWriter> archive = open_batch_archive(options);
+
+    std::atomic<size_t> next_file{0};
+    std::atomic<size_t> failed{0};
+    std::mutex log_mutex;
+
+    auto worker = [&] {
+        for (size_t i = next_file++; i < files.size(); i = next_file++) {
+            const fs::path& logits_path = files[i];
+            fs::path output_path = batch_output_path(logits_path, root, options, options.binary_beats ? ".btb" : ".beats");
+            try {
+                auto result = BeatThis::postprocess_logits(BeatThis::load_logits(logits_path.string()), postprocess);
+                if (archive) {
+                    archive->add(batch_track_id(logits_path, root), result);
+                    continue;
                 }
-            } else {
-                // Mono: add click directly
-                if (frame_pos < total_samples) {
-                    final_audio[frame_pos] += beat_waveform[j] * 0.3f;
+
+                std::error_code ec;
+                fs::create_directories(output_path.parent_path(), ec);
+                if (!write_beats(result, output_path.string(), options.binary_beats)) {
+                    throw std::runtime_error("could not write " + output_path.string());
                 }
+            } catch (const std::exception& e) {
+                ++failed;
+                std::lock_guard<std::mutex> lock(log_mutex);
+                std::cerr << "Failed: " << logits_path.string() << ": " << e.what() << std::endl;
             }
         }
-    }
+    };
 
-    // Normalize audio to prevent clipping
-    float max_val = 0.0f;
-    for (float sample : final_audio) {
-        max_val = std::max(max_val, std::abs(sample));
+    auto start_time = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    threads.reserve(jobs);
+    for (int j = 0; j < jobs; ++j) {
+        threads.emplace_back(worker);
     }
-    
-    if (max_val > 1.0f) {
-        for (float& sample : final_audio) {
-            sample /= max_val;
-        }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (archive) {
+        archive->close();
+        std::cout << "Beats archived to: " << options.archive << std::endl;
     }
 
-    return write_wav_file(output_wav_file, final_audio, output_samplerate, output_channels);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    size_t succeeded = files.size() - failed;
+    std::cout << "Postprocessed " << succeeded << " of " << files.size() << " files in "
+              << std::fixed << std::setprecision(2) << elapsed << " s ("
+              << std::setprecision(2) << (elapsed > 0.0 ? files.size() / elapsed : 0.0) << " files/sec)" << std::endl;
+
+    return failed == 0 ? 0 : 1;
 }
 
-// Function to calculate BPM from beat timestamps
-double calculate_bpm(const BeatThis::BeatResult& result) {
-    if (result.beats.size() < 2) {
-        return 0.0; // Need at least 2 beats to calculate intervals
-    }
+// Function to print the BPM and write the beat file and click track, as requested
+bool write_result_outputs(const BeatThis::BeatResult& result, const std::string& output_beats_file,
+                          const std::string& output_wav_file, bool calc_bpm, bool binary_beats) {
+    std::cout << "Found " << result.beats.size() << " beats and " << result.downbeats.size() << " downbeats" << std::endl;
 
-    std::vector<double> intervals;
-    intervals.reserve(result.beats.size() - 1);
-    
-    // Calculate inter-beat intervals
-    for (size_t i = 1; i < result.beats.size(); ++i) {
-        double interval = result.beats[i] - result.beats[i-1];
-        if (interval > 0.1 && interval < 3.0) { // Filter out unrealistic intervals (less than 20 BPM or more than 600 BPM)
-            intervals.push_back(interval);
+    // Calculate and display BPM if requested
+    if (calc_bpm) {
+        double bpm = BeatThis::calculate_bpm(result);
+        if (bpm > 0.0) {
+            std::cout << "Estimated BPM: " << std::fixed << std::setprecision(1) << bpm << std::endl;
+        } else {
+            std::cout << "Could not calculate BPM (insufficient or invalid beat data)" << std::endl;
         }
     }
-    
-    if (intervals.empty()) {
-        return 0.0;
+
+    // Save results to .beats file if requested
+    if (!output_beats_file.empty()) {
+        if (write_beats(result, output_beats_file, binary_beats)) {
+            std::cout << "Beats saved to: " << output_beats_file << std::endl;
+        } else {
+            std::cerr << "Failed to save beats to file." << std::endl;
+            return false;
+        }
     }
-    
-    // Use median interval to avoid outliers affecting the result
-    std::sort(intervals.begin(), intervals.end());
-    double median_interval;
-    size_t n = intervals.size();
-    if (n % 2 == 0) {
-        median_interval = (intervals[n/2 - 1] + intervals[n/2]) / 2.0;
-    } else {
-        median_interval = intervals[n/2];
+
+    // Generate audio if requested
+    if (!output_wav_file.empty()) {
+        if (generate_beats_audio(result, output_wav_file)) {
+            std::cout << "Beat audio generated: " << output_wav_file << std::endl;
+        } else {
+            std::cerr << "Failed to generate beat audio." << std::endl;
+            return false;
+        }
     }
-    
-    // Convert interval to BPM: 60 seconds per minute / interval in seconds
-    return 60.0 / median_interval;
+    return true;
 }
 
 void print_usage(const char* program_name) {
     std::cerr << "Usage: " << program_name << " <onnx_model_path> <audio_file_path> [options]" << std::endl;
+    std::cerr << "       " << program_name << " <onnx_model_path> --batch <dir|list_file> [--jobs N] [--output-dir <dir>] [options]" << std::endl;
+    std::cerr << "       " << program_name << " --postprocess <logits_file|dir|list_file> [options]" << std::endl;
     std::cerr << std::endl;
     std::cerr << "Options:" << std::endl;
     std::cerr << "  --output-beats <file>    Save beat information to .beats file" << std::endl;
+    std::cerr << "  --beats-format <format>  Beats file format: text (default) or binary (.btb, about 2 bytes" << std::endl;
+    std::cerr << "                           per beat, read with BeatThis::load_beats)" << std::endl;
     std::cerr << "  --output-audio <file>    Generate audio file with beats as click track" << std::endl;
     std::cerr << "  --output-mixed <file>    Generate audio file with original music + click track" << std::endl;
     std::cerr << "  --calc-bpm               Calculate and display BPM from detected beats" << std::endl;
+    std::cerr << "  --output-logits <file>   Save the raw model logits for later re-thresholding" << std::endl;
+    std::cerr << "  --with-spectrogram       Include the Mel spectrogram in the logits file" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Peak picking options:" << std::endl;
+    std::cerr << "  --threshold <x>          Minimum logit for a beat (default: 0)" << std::endl;
+    std::cerr << "  --kernel-size <N>        Peak picking window in frames, odd (default: 7)" << std::endl;
+    std::cerr << "  --dedup-width <N>        Merge peaks at most N frames apart (default: 1)" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Runtime options:" << std::endl;
+    std::cerr << "  --intra-threads <N>      ONNX Runtime threads per operator (default: all cores)" << std::endl;
+    std::cerr << "  --inter-threads <N>      ONNX Runtime threads across operators (with --parallel-exec)" << std::endl;
+    std::cerr << "  --parallel-exec          Run independent graph nodes in parallel" << std::endl;
+    std::cerr << "  --graph-opt <level>      Graph optimization: disabled, basic, extended, all (default)" << std::endl;
+    std::cerr << "  --provider <name>        Execution provider: cpu (default), cuda, coreml, directml, openvino" << std::endl;
+    std::cerr << "  --device-id <N>          Device index for cuda/directml (default: 0)" << std::endl;
+    std::cerr << "  --optimized-model <file> Save the optimized graph here and reuse it on later runs" << std::endl;
+    std::cerr << "  --batch-size <N>         Chunks per inference run for dynamic-batch models (default: 4)" << std::endl;
+    std::cerr << "  --frontend-threads <N>   Threads for the Mel spectrogram frontend (default: 1)" << std::endl;
+    std::cerr << "  --resampler <type>       Sample rate conversion: linear (default) or sinc" << std::endl;
+    std::cerr << "  --fast-log               Vectorized approximate log in the Mel frontend (~1 ulp error)" << std::endl;
+    std::cerr << "  --pipelined              Run inference on a worker thread while the audio is still decoded" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Batch options:" << std::endl;
+    std::cerr << "  --batch <dir|list_file>  Analyze every audio file in a directory (recursive) or listed" << std::endl;
+    std::cerr << "                           one per line in a text file, writing a .beats file for each" << std::endl;
+    std::cerr << "  --jobs <N>               Number of worker threads (default: all cores)" << std::endl;
+    std::cerr << "  --output-dir <dir>       Directory for the .beats files (default: next to each input)" << std::endl;
+    std::cerr << "  --prefetch <N>           Decode up to N files ahead on loader threads (default: 0, each" << std::endl;
+    std::cerr << "                           job decodes its own file while analyzing it)" << std::endl;
+    std::cerr << "  --decode-threads <N>     Loader threads with --prefetch (default: 2)" << std::endl;
+    std::cerr << "  --prefetch-mb <MB>       Decoded audio held ahead of the jobs (default: 512)" << std::endl;
+    std::cerr << "  --save-logits            Also write a .logits file next to each .beats file" << std::endl;
+    std::cerr << "                           (--with-spectrogram adds the Mel spectrogram and implies it)" << std::endl;
+    std::cerr << "  --archive <file>         Store all results in one indexed beat archive instead of a file" << std::endl;
+    std::cerr << "                           per input (appends to an existing archive; includes the logits" << std::endl;
+    std::cerr << "                           with --save-logits). Track IDs are the input paths relative to" << std::endl;
+    std::cerr << "                           the batch directory, without extension" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Postprocess mode (no model needed):" << std::endl;
+    std::cerr << "  --postprocess <source>   Re-run peak picking on saved logits. A single .logits file takes" << std::endl;
+    std::cerr << "                           --output-beats, --output-audio and --calc-bpm; a directory or list" << std::endl;
+    std::cerr << "                           writes a .beats file per input (with --jobs, --output-dir," << std::endl;
+    std::cerr << "                           --beats-format and --archive)" << std::endl;
     std::cerr << std::endl;
     std::cerr << "Examples:" << std::endl;
     std::cerr << "  " << program_name << " model.onnx input.wav --output-beats output.beats" << std::endl;
@@ -299,6 +587,12 @@ void print_usage(const char* program_name) {
     std::cerr << "  " << program_name << " model.onnx input.wav --output-mixed mixed.wav" << std::endl;
     std::cerr << "  " << program_name << " model.onnx input.wav --calc-bpm" << std::endl;
     std::cerr << "  " << program_name << " model.onnx input.wav --output-beats output.beats --calc-bpm" << std::endl;
+    std::cerr << "  " << program_name << " model.onnx --batch music/ --jobs 8 --output-dir beats/" << std::endl;
+    std::cerr << "  " << program_name << " model.onnx --batch music/ --jobs 4 --intra-threads 2 --optimized-model model.opt.onnx" << std::endl;
+    std::cerr << "  " << program_name << " model.onnx --batch music/ --save-logits --output-dir beats/" << std::endl;
+    std::cerr << "  " << program_name << " model.onnx --batch /mnt/nas/music --jobs 4 --prefetch 8 --decode-threads 4" << std::endl;
+    std::cerr << "  " << program_name << " model.onnx --batch music/ --jobs 8 --archive catalog.btba" << std::endl;
+    std::cerr << "  " << program_name << " --postprocess beats/ --threshold 0.5 --dedup-width 2" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
@@ -307,7 +601,120 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    BeatThis::BeatThisConfig config;
+
+    if (std::string(argv[1]) == "--postprocess") {
+        BatchOptions batch_options;
+        std::string output_beats_file;
+        std::string output_wav_file;
+        bool calc_bpm = false;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--postprocess" && i + 1 < argc) {
+                batch_options.source = argv[++i];
+            } else if (arg == "--jobs" && i + 1 < argc) {
+                batch_options.jobs = std::atoi(argv[++i]);
+            } else if (arg == "--output-dir" && i + 1 < argc) {
+                batch_options.output_dir = argv[++i];
+            } else if (arg == "--archive" && i + 1 < argc) {
+                batch_options.archive = argv[++i];
+            } else if (arg == "--beats-format" && i + 1 < argc) {
+                if (!parse_beats_format(argv[++i], batch_options.binary_beats)) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+            } else if (arg == "--output-beats" && i + 1 < argc) {
+                output_beats_file = argv[++i];
+            } else if (arg == "--output-audio" && i + 1 < argc) {
+                output_wav_file = argv[++i];
+            } else if (arg == "--calc-bpm") {
+                calc_bpm = true;
+            } else if (int consumed = parse_config_option(arg, i, argc, argv, config); consumed != 0) {
+                if (consumed < 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                i += consumed - 1;
+            } else {
+                std::cerr << "Unknown argument: " << arg << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        if (batch_options.source.empty()) {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        try {
+            std::filesystem::path source = std::filesystem::absolute(batch_options.source);
+            if (source.extension() != ".logits") {
+                return run_postprocess_batch(config.postprocess, batch_options);
+            }
+            auto result = BeatThis::postprocess_logits(BeatThis::load_logits(source.string()), config.postprocess);
+            return write_result_outputs(result, output_beats_file, output_wav_file, calc_bpm, batch_options.binary_beats) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
     const std::string onnx_model_path = argv[1];
+
+    if (std::string(argv[2]) == "--batch") {
+        BatchOptions batch_options;
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--batch" && i + 1 < argc) {
+                batch_options.source = argv[++i];
+            } else if (arg == "--jobs" && i + 1 < argc) {
+                batch_options.jobs = std::atoi(argv[++i]);
+            } else if (arg == "--output-dir" && i + 1 < argc) {
+                batch_options.output_dir = argv[++i];
+            } else if (arg == "--archive" && i + 1 < argc) {
+                batch_options.archive = argv[++i];
+            } else if (arg == "--beats-format" && i + 1 < argc) {
+                if (!parse_beats_format(argv[++i], batch_options.binary_beats)) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+            } else if (arg == "--prefetch" && i + 1 < argc) {
+                batch_options.prefetch = std::max(0, std::atoi(argv[++i]));
+            } else if (arg == "--decode-threads" && i + 1 < argc) {
+                batch_options.decode_threads = std::max(1, std::atoi(argv[++i]));
+            } else if (arg == "--prefetch-mb" && i + 1 < argc) {
+                batch_options.prefetch_mb = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+            } else if (arg == "--save-logits") {
+                config.return_logits = true;
+            } else if (arg == "--with-spectrogram") {
+                // The spectrogram only ends up in the .logits files, so this implies --save-logits
+                config.return_logits = true;
+                config.return_spectrogram = true;
+            } else if (int consumed = parse_config_option(arg, i, argc, argv, config); consumed != 0) {
+                if (consumed < 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                i += consumed - 1;
+            } else {
+                std::cerr << "Unknown argument: " << arg << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        if (batch_options.source.empty()) {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        try {
+            return run_batch(std::filesystem::absolute(onnx_model_path), config, batch_options);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
     const std::string audio_file_path = argv[2];
     
     // Convert to absolute paths
@@ -317,7 +724,9 @@ int main(int argc, char* argv[]) {
     std::string output_beats_file;
     std::string output_wav_file;
     std::string output_mixed_file;
+    std::string output_logits_file;
     bool calc_bpm = false;
+    bool binary_beats = false;
 
     // Parse command line arguments
     for (int i = 3; i < argc; i++) {
@@ -330,6 +739,22 @@ int main(int argc, char* argv[]) {
             output_mixed_file = argv[++i];
         } else if (arg == "--calc-bpm") {
             calc_bpm = true;
+        } else if (arg == "--beats-format" && i + 1 < argc) {
+            if (!parse_beats_format(argv[++i], binary_beats)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--output-logits" && i + 1 < argc) {
+            output_logits_file = argv[++i];
+            config.return_logits = true;
+        } else if (arg == "--with-spectrogram") {
+            config.return_spectrogram = true;
+        } else if (int consumed = parse_config_option(arg, i, argc, argv, config); consumed != 0) {
+            if (consumed < 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            i += consumed - 1;
         } else {
             std::cerr << "Unknown argument: " << arg << std::endl;
             print_usage(argv[0]);
@@ -338,59 +763,43 @@ int main(int argc, char* argv[]) {
     }
 
     // Check if at least one output is specified
-    if (output_beats_file.empty() && output_wav_file.empty() && output_mixed_file.empty() && !calc_bpm) {
-        std::cerr << "Error: At least one output option must be specified (--output-beats, --output-audio, --output-mixed, or --calc-bpm)" << std::endl;
+    if (output_beats_file.empty() && output_wav_file.empty() && output_mixed_file.empty() &&
+        output_logits_file.empty() && !calc_bpm) {
+        std::cerr << "Error: At least one output option must be specified (--output-beats, --output-audio, --output-mixed, --output-logits, or --calc-bpm)" << std::endl;
         print_usage(argv[0]);
         return 1;
     }
 
     try {
         // Initialize the BeatThis API
-        BeatThis::BeatThis beat_analyzer(onnx_path.string());
+        BeatThis::BeatThis beat_analyzer(onnx_path.string(), config);
 
-        // Load audio for example
+        // The original audio is only needed in memory for the mixed output;
+        // otherwise the file is decoded and analyzed block by block
         std::vector<float> audio_buffer;
-        int samplerate;
-        int channels;
-        if (!load_audio_for_example(audio_path.string(), audio_buffer, samplerate, channels)) {
-            return 1;
-        }
-
-        std::cout << "Loaded audio: " << audio_buffer.size() << " samples, " << samplerate << " Hz, " << channels << " channels" << std::endl;
-
-        // Process audio
-        auto result = beat_analyzer.process_audio(audio_buffer, samplerate, channels);
+        int samplerate = 0;
+        int channels = 0;
+        BeatThis::BeatResult result;
+        if (!output_mixed_file.empty()) {
+            if (!load_audio_for_example(audio_path.string(), audio_buffer, samplerate, channels)) {
+                return 1;
+            }
 
-        std::cout << "Found " << result.beats.size() << " beats and " << result.downbeats.size() << " downbeats" << std::endl;
+            std::cout << "Loaded audio: " << audio_buffer.size() << " samples, " << samplerate << " Hz, " << channels << " channels" << std::endl;
 
-        // Calculate and display BPM if requested
-        if (calc_bpm) {
-            double bpm = calculate_bpm(result);
-            if (bpm > 0.0) {
-                std::cout << "Estimated BPM: " << std::fixed << std::setprecision(1) << bpm << std::endl;
-            } else {
-                std::cout << "Could not calculate BPM (insufficient or invalid beat data)" << std::endl;
-            }
+            result = beat_analyzer.process_audio(audio_buffer, samplerate, channels);
+        } else {
+            result = beat_analyzer.process_file(audio_path.string());
         }
 
-        // Save results to .beats file if requested
-        if (!output_beats_file.empty()) {
-            if (save_beats_to_file(result, output_beats_file)) {
-                std::cout << "Beats saved to: " << output_beats_file << std::endl;
-            } else {
-                std::cerr << "Failed to save beats to file." << std::endl;
-                return 1;
-            }
+        if (!write_result_outputs(result, output_beats_file, output_wav_file, calc_bpm, binary_beats)) {
+            return 1;
         }
 
-        // Generate audio if requested
-        if (!output_wav_file.empty()) {
-            if (generate_beats_audio(result, output_wav_file)) {
-                std::cout << "Beat audio generated: " << output_wav_file << std::endl;
-            } else {
-                std::cerr << "Failed to generate beat audio." << std::endl;
-                return 1;
-            }
+        // Save the raw logits if requested
+        if (!output_logits_file.empty()) {
+            BeatThis::save_logits(*result.logits, output_logits_file);
+            std::cout << "Logits saved to: " << output_logits_file << std::endl;
         }
 
         // Generate mixed audio if requested
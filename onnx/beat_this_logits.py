@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""
+Helpers shared by the precision tools: reading .logits files written by
+beat_this_cpp, chunked inference matching InferenceProcessor, and the peak
+picking of Postprocessor
+"""
+import os
+import struct
+import numpy as np
+
+LOGITS_MAGIC = b'BTLG'
+LOGITS_VERSION = 1
+LOGITS_HEADER = struct.Struct('<4sIfIQ')  # magic, version, fps, num_bins, num_frames
+
+# Chunking parameters of InferenceProcessor
+CHUNK_SIZE = 1500
+BORDER_SIZE = 6
+
+
+def read_logits(path):
+    """
+    Read a .logits file (see save_logits() in beat_this_api.h)
+
+    Returns:
+        dict with 'fps', 'beat', 'downbeat' and 'spectrogram' ([frames, bins],
+        or None if the file was written without --with-spectrogram)
+    """
+    with open(path, 'rb') as f:
+        header = f.read(LOGITS_HEADER.size)
+        if len(header) != LOGITS_HEADER.size:
+            raise ValueError(f"Not a logits file: {path}")
+        magic, version, fps, num_bins, num_frames = LOGITS_HEADER.unpack(header)
+        if magic != LOGITS_MAGIC:
+            raise ValueError(f"Not a logits file: {path}")
+        if version != LOGITS_VERSION:
+            raise ValueError(f"Unsupported logits file version {version}: {path}")
+        beat = np.fromfile(f, dtype='<f4', count=num_frames)
+        downbeat = np.fromfile(f, dtype='<f4', count=num_frames)
+        spectrogram = None
+        if num_bins > 0:
+            spectrogram = np.fromfile(f, dtype='<f4', count=num_frames * num_bins)
+            if spectrogram.size != num_frames * num_bins:
+                raise ValueError(f"Truncated logits file: {path}")
+            spectrogram = spectrogram.reshape(num_frames, num_bins)
+        if beat.size != num_frames or downbeat.size != num_frames:
+            raise ValueError(f"Truncated logits file: {path}")
+    return {'fps': fps, 'beat': beat, 'downbeat': downbeat, 'spectrogram': spectrogram}
+
+
+def collect_logits_files(sources):
+    """Expand directories (recursively) and list files into .logits paths"""
+    files = []
+    for source in sources:
+        if os.path.isdir(source):
+            for root, _, names in os.walk(source):
+                files.extend(os.path.join(root, n) for n in sorted(names) if n.endswith('.logits'))
+        elif source.endswith('.logits'):
+            files.append(source)
+        else:
+            with open(source) as f:
+                files.extend(line.strip() for line in f if line.strip())
+    return files
+
+
+def split_piece(num_frames):
+    """Chunk starts and lengths, as InferenceProcessor::split_piece"""
+    step = CHUNK_SIZE - 2 * BORDER_SIZE
+    starts = list(range(-BORDER_SIZE, num_frames - BORDER_SIZE, step))
+    if num_frames > step:
+        starts[-1] = num_frames - (CHUNK_SIZE - BORDER_SIZE)
+    chunks = []
+    for start in starts:
+        actual = max(0, min(start + CHUNK_SIZE, num_frames) - max(0, start))
+        left_pad = max(0, -start)
+        right_pad = max(0, min(BORDER_SIZE, start + CHUNK_SIZE - num_frames))
+        chunks.append((start, actual + left_pad + right_pad))
+    return chunks
+
+
+def chunk_input(spectrogram, start, length):
+    """Frames [start, start + length) with zeros outside the spectrogram"""
+    num_frames, num_bins = spectrogram.shape
+    chunk = np.zeros((length, num_bins), dtype=np.float32)
+    first, last = max(0, start), min(num_frames, start + length)
+    if last > first:
+        chunk[first - start:last - start] = spectrogram[first:last]
+    return chunk
+
+
+def iter_chunks(spectrogram):
+    """Yields the [1, frames, bins] model inputs of one spectrogram"""
+    for start, length in split_piece(spectrogram.shape[0]):
+        yield chunk_input(spectrogram, start, length)[np.newaxis]
+
+
+def run_model(session, spectrogram):
+    """
+    Full-piece logits with the chunking and keep-first aggregation of
+    InferenceProcessor, converting float16 models' I/O as needed
+
+    Returns:
+        (beat, downbeat) float32 arrays of spectrogram.shape[0] frames
+    """
+    num_frames = spectrogram.shape[0]
+    input_type = np.float16 if session.get_inputs()[0].type == 'tensor(float16)' else np.float32
+    beat = np.full(num_frames, -1000.0, dtype=np.float32)
+    downbeat = np.full(num_frames, -1000.0, dtype=np.float32)
+    chunks = split_piece(num_frames)
+    predictions = []
+    for start, length in chunks:
+        chunk = chunk_input(spectrogram, start, length)[np.newaxis].astype(input_type)
+        outputs = session.run(['beat', 'downbeat'], {'input_spectrogram': chunk})
+        predictions.append((outputs[0][0].astype(np.float32), outputs[1][0].astype(np.float32)))
+    # "keep_first": later chunks are written first and overwritten by earlier ones
+    for (start, _), (b, d) in reversed(list(zip(chunks, predictions))):
+        lo, hi = (BORDER_SIZE, len(b) - BORDER_SIZE) if len(b) >= 2 * BORDER_SIZE else (0, len(b))
+        lo, hi = max(lo, -start), min(hi, num_frames - start)
+        if hi > lo:
+            beat[start + lo:start + hi] = b[lo:hi]
+            downbeat[start + lo:start + hi] = d[lo:hi]
+    return beat, downbeat
+
+
+def pick_peaks(logits, kernel_size=7, threshold=0.0, dedup_width=1):
+    """Peak frames as Postprocessor: max filter, threshold, then deduplication"""
+    half = kernel_size // 2
+    padded = np.pad(logits, half, constant_values=-np.inf)
+    windows = np.lib.stride_tricks.sliding_window_view(padded, kernel_size)
+    peaks = np.flatnonzero((logits == windows.max(axis=1)) & (logits > threshold))
+    result = []
+    for p in peaks:
+        if result and p - result[-1][0] <= dedup_width:
+            mean, count = result[-1]
+            count += 1
+            result[-1] = (mean + (p - mean) / count, count)
+        else:
+            result.append((float(p), 1))
+    # Halves round up like std::round (np.round would round them to even)
+    return np.array([int(np.floor(mean + 0.5)) for mean, _ in result], dtype=np.int64)
+
+
+def beats_from_logits(beat, downbeat, fps=50.0, **options):
+    """Beat and downbeat times in seconds, downbeats moved onto the nearest beat"""
+    beat_times = pick_peaks(beat, **options) / fps
+    downbeat_times = pick_peaks(downbeat, **options) / fps
+    if beat_times.size and downbeat_times.size:
+        nearest = np.abs(downbeat_times[:, None] - beat_times[None, :]).argmin(axis=1)
+        downbeat_times = beat_times[np.unique(nearest)]
+    return beat_times, downbeat_times
+
+
+def f_measure(reference, estimate, tolerance=0.07):
+    """Beat F-measure with a +-tolerance window and greedy one-to-one matching in time order"""
+    if reference.size == 0 and estimate.size == 0:
+        return 1.0
+    if reference.size == 0 or estimate.size == 0:
+        return 0.0
+    matched = 0
+    i = j = 0
+    while i < reference.size and j < estimate.size:
+        delta = estimate[j] - reference[i]
+        if abs(delta) <= tolerance:
+            matched += 1
+            i += 1
+            j += 1
+        elif delta < 0:
+            j += 1
+        else:
+            i += 1
+    precision = matched / estimate.size
+    recall = matched / reference.size
+    return 0.0 if matched == 0 else 2 * precision * recall / (precision + recall)
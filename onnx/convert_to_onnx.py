@@ -135,7 +135,7 @@ def convert_checkpoint_to_onnx(checkpoint_path, output_path, verbose=False):
             print(f"  - ONNX opset version: 14")
             print(f"  - Input names: ['input_spectrogram']")
             print(f"  - Output names: ['beat', 'downbeat']")
-            print(f"  - Dynamic axes: time dimension")
+            print(f"  - Dynamic axes: batch and time dimensions")
         else:
             print("Starting ONNX export...")
             
@@ -147,9 +147,9 @@ def convert_checkpoint_to_onnx(checkpoint_path, output_path, verbose=False):
             output_names=['beat', 'downbeat'],
             opset_version=14,  # Required for scaled_dot_product_attention
             dynamic_axes={
-                'input_spectrogram': {1: 'time'},  # Variable time dimension
-                'beat': {1: 'time'},
-                'downbeat': {1: 'time'}
+                'input_spectrogram': {0: 'batch', 1: 'time'},  # Variable batch and time dimensions
+                'beat': {0: 'batch', 1: 'time'},
+                'downbeat': {0: 'batch', 1: 'time'}
             },
             verbose=False  # Control verbose output separately
         )
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""
+Accuracy report for reduced-precision Beat This! models
+
+Runs the FP32 reference and each candidate model on saved spectrograms, picks
+beats like the C++ postprocessor and reports the beat and downbeat F-measure
+of each candidate against the FP32 beats, plus the logit error and speed.
+
+Spectrograms come from .logits files written with --with-spectrogram:
+  beat_this_cpp model.onnx --batch eval_music/ --save-logits --with-spectrogram --output-dir eval/
+"""
+import sys
+import os
+import json
+import time
+import numpy as np
+import onnxruntime as ort
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from beat_this_logits import read_logits, collect_logits_files, run_model, beats_from_logits, f_measure
+
+
+def create_session(model_path, threads):
+    options = ort.SessionOptions()
+    if threads > 0:
+        options.intra_op_num_threads = threads
+    return ort.InferenceSession(model_path, options, providers=['CPUExecutionProvider'])
+
+
+def main():
+    import argparse
+
+    parser = argparse.ArgumentParser(description='Compare FP16/INT8 Beat This! models against FP32')
+    parser.add_argument('reference_model', help='FP32 ONNX model')
+    parser.add_argument('candidate_models', nargs='+', help='Reduced-precision models to evaluate')
+    parser.add_argument('--data', nargs='+', required=True,
+                        help='.logits files, directories or file lists saved with --with-spectrogram')
+    parser.add_argument('--tolerance', type=float, default=0.07, help='Beat matching window in seconds (default: 0.07)')
+    parser.add_argument('--threads', type=int, default=0, help='ONNX Runtime intra-op threads (default: all cores)')
+    parser.add_argument('--max-files', type=int, default=0, help='Evaluate at most this many files (0 = all)')
+    parser.add_argument('--json', help='Also write the report to this JSON file')
+
+    args = parser.parse_args()
+
+    files = collect_logits_files(args.data)
+    if args.max_files > 0:
+        files = files[:args.max_files]
+    spectrograms = []
+    for path in files:
+        logits = read_logits(path)
+        if logits['spectrogram'] is None:
+            print(f"Skipping {path}: saved without --with-spectrogram")
+            continue
+        spectrograms.append((path, logits['fps'], logits['spectrogram']))
+    if not spectrograms:
+        print("Error: no spectrograms to evaluate")
+        sys.exit(1)
+    total_seconds = sum(s.shape[0] / fps for _, fps, s in spectrograms)
+    print(f"Evaluating on {len(spectrograms)} files ({total_seconds / 60:.1f} min of audio)")
+
+    def evaluate(model_path):
+        session = create_session(model_path, args.threads)
+        run_model(session, spectrograms[0][2][:1500])  # Warm-up
+        outputs = []
+        start = time.perf_counter()
+        for _, _, spectrogram in spectrograms:
+            outputs.append(run_model(session, spectrogram))
+        return outputs, time.perf_counter() - start
+
+    reference_outputs, reference_time = evaluate(args.reference_model)
+    reference_beats = [beats_from_logits(b, d, fps) for (b, d), (_, fps, _) in zip(reference_outputs, spectrograms)]
+
+    report = {
+        'reference': {'model': args.reference_model, 'seconds': reference_time,
+                      'size_mb': os.path.getsize(args.reference_model) / (1024 * 1024)},
+        'files': len(spectrograms),
+        'audio_seconds': total_seconds,
+        'tolerance': args.tolerance,
+        'candidates': [],
+    }
+
+    print()
+    print(f"{'model':<40} {'beat F':>8} {'min':>8} {'downb F':>8} {'min':>8} {'max |dlogit|':>13} {'speedup':>8}")
+    print(f"{os.path.basename(args.reference_model):<40} {1.0:>8.4f} {1.0:>8.4f} {1.0:>8.4f} {1.0:>8.4f} "
+          f"{0.0:>13.4f} {1.0:>7.2f}x")
+
+    for model_path in args.candidate_models:
+        outputs, seconds = evaluate(model_path)
+        beat_f, downbeat_f, max_error = [], [], 0.0
+        for (b, d), (ref_b, ref_d), (ref_beats, ref_downbeats), (_, fps, _) in zip(
+                outputs, reference_outputs, reference_beats, spectrograms):
+            beats, downbeats = beats_from_logits(b, d, fps)
+            beat_f.append(f_measure(ref_beats, beats, args.tolerance))
+            downbeat_f.append(f_measure(ref_downbeats, downbeats, args.tolerance))
+            max_error = max(max_error, float(np.abs(b - ref_b).max(initial=0.0)), float(np.abs(d - ref_d).max(initial=0.0)))
+
+        worst = int(np.argmin(beat_f))
+        candidate = {
+            'model': model_path,
+            'size_mb': os.path.getsize(model_path) / (1024 * 1024),
+            'seconds': seconds,
+            'speedup': reference_time / seconds if seconds > 0 else 0.0,
+            'beat_f_mean': float(np.mean(beat_f)),
+            'beat_f_min': float(np.min(beat_f)),
+            'downbeat_f_mean': float(np.mean(downbeat_f)),
+            'downbeat_f_min': float(np.min(downbeat_f)),
+            'max_logit_error': max_error,
+            'worst_file': spectrograms[worst][0],
+        }
+        report['candidates'].append(candidate)
+        print(f"{os.path.basename(model_path):<40} {candidate['beat_f_mean']:>8.4f} {candidate['beat_f_min']:>8.4f} "
+              f"{candidate['downbeat_f_mean']:>8.4f} {candidate['downbeat_f_min']:>8.4f} "
+              f"{max_error:>13.4f} {candidate['speedup']:>7.2f}x")
+
+    print()
+    print("F-measures compare each model's beats with the FP32 beats, not with annotations.")
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(report, f, indent=2)
+        print(f"Report saved to: {args.json}")
+
+
+if __name__ == "__main__":
+    main()
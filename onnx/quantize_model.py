@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""
+Create reduced-precision variants of the Beat This! ONNX model
+
+  fp16          float16 weights and activations
+  int8-dynamic  int8 MatMul weights, activations quantized on the fly (no calibration)
+  int8-static   int8 weights and activations (QDQ), calibrated on our own spectrograms
+
+Calibration data are .logits files written with the spectrogram included:
+  beat_this_cpp model.onnx --batch music/ --save-logits --with-spectrogram --output-dir calib/
+"""
+import sys
+import os
+import random
+import numpy as np
+import onnx
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from beat_this_logits import read_logits, collect_logits_files, iter_chunks, CHUNK_SIZE
+
+
+def convert_fp16(input_path, output_path, keep_io_types):
+    """
+    Convert weights and activations to float16
+
+    Args:
+        keep_io_types: Keep the float32 input and outputs (casts are inserted at
+            the graph boundary). Without it the model takes and returns float16,
+            which the C++ InferenceProcessor converts as well.
+    """
+    try:
+        from onnxconverter_common import float16
+    except ImportError:
+        print("❌ onnxconverter-common is required for FP16: pip install onnxconverter-common")
+        return False
+
+    model = onnx.load(input_path)
+    model_fp16 = float16.convert_float_to_float16(model, keep_io_types=keep_io_types)
+    onnx.save(model_fp16, output_path)
+    return True
+
+
+def quantize_dynamic_int8(input_path, output_path, per_channel):
+    from onnxruntime.quantization import quantize_dynamic, QuantType
+
+    quantize_dynamic(
+        input_path,
+        output_path,
+        weight_type=QuantType.QInt8,
+        per_channel=per_channel,
+        op_types_to_quantize=['MatMul', 'Gemm'],
+    )
+    return True
+
+
+class SpectrogramCalibrationReader:
+    """Feeds 1500-frame chunks of saved spectrograms to the calibrator"""
+
+    def __init__(self, files, max_chunks, seed=0):
+        chunks = []
+        for path in files:
+            logits = read_logits(path)
+            if logits['spectrogram'] is None:
+                print(f"Skipping {path}: saved without --with-spectrogram")
+                continue
+            # Full-length chunks only; the final short chunk adds little information
+            chunks.extend(c for c in iter_chunks(logits['spectrogram']) if c.shape[1] == CHUNK_SIZE)
+        random.Random(seed).shuffle(chunks)
+        self.chunks = chunks[:max_chunks]
+        self.position = 0
+
+    def get_next(self):
+        if self.position >= len(self.chunks):
+            return None
+        chunk = self.chunks[self.position]
+        self.position += 1
+        return {'input_spectrogram': chunk.astype(np.float32)}
+
+    def rewind(self):
+        self.position = 0
+
+
+def quantize_static_int8(input_path, output_path, calibration_sources, max_chunks, per_channel, method):
+    from onnxruntime.quantization import (quantize_static, QuantType, QuantFormat, CalibrationMethod)
+    from onnxruntime.quantization.shape_inference import quant_pre_process
+
+    files = collect_logits_files(calibration_sources)
+    if not files:
+        print("❌ No .logits files found for calibration")
+        return False
+    reader = SpectrogramCalibrationReader(files, max_chunks)
+    if not reader.chunks:
+        print("❌ No calibration chunks: save logits with --with-spectrogram")
+        return False
+    print(f"Calibrating on {len(reader.chunks)} chunks from {len(files)} files")
+
+    # Shape inference and graph cleanup make quantization cover more nodes
+    preprocessed_path = output_path + '.pre.onnx'
+    quant_pre_process(input_path, preprocessed_path)
+    try:
+        quantize_static(
+            preprocessed_path,
+            output_path,
+            reader,
+            quant_format=QuantFormat.QDQ,
+            activation_type=QuantType.QInt8,
+            weight_type=QuantType.QInt8,
+            per_channel=per_channel,
+            op_types_to_quantize=['MatMul', 'Gemm'],
+            calibrate_method={'minmax': CalibrationMethod.MinMax,
+                              'entropy': CalibrationMethod.Entropy,
+                              'percentile': CalibrationMethod.Percentile}[method],
+            extra_options={'ActivationSymmetric': True, 'WeightSymmetric': True},
+        )
+    finally:
+        os.remove(preprocessed_path)
+    return True
+
+
+def main():
+    import argparse
+
+    parser = argparse.ArgumentParser(description='Create FP16 or INT8 variants of the Beat This! ONNX model')
+    parser.add_argument('input_path', help='FP32 ONNX model (from convert_to_onnx.py)')
+    parser.add_argument('output_path', help='Output path for the reduced-precision model')
+    parser.add_argument('--mode', choices=['fp16', 'int8-dynamic', 'int8-static'], required=True)
+    parser.add_argument('--fp16-io', action='store_true',
+                        help='FP16: use float16 input and outputs instead of keeping float32 I/O')
+    parser.add_argument('--calibration', nargs='+', default=[],
+                        help='INT8 static: .logits files, directories or file lists with spectrograms')
+    parser.add_argument('--max-chunks', type=int, default=256,
+                        help='INT8 static: maximum number of 1500-frame calibration chunks (default: 256)')
+    parser.add_argument('--calibrate-method', choices=['minmax', 'entropy', 'percentile'], default='percentile',
+                        help='INT8 static: activation range estimation (default: percentile)')
+    parser.add_argument('--per-channel', action='store_true', help='INT8: per-channel weight scales')
+
+    args = parser.parse_args()
+
+    if not os.path.exists(args.input_path):
+        print(f"Error: Model file not found: {args.input_path}")
+        sys.exit(1)
+
+    print(f"Creating {args.mode} model from {args.input_path}")
+    if args.mode == 'fp16':
+        success = convert_fp16(args.input_path, args.output_path, keep_io_types=not args.fp16_io)
+    elif args.mode == 'int8-dynamic':
+        success = quantize_dynamic_int8(args.input_path, args.output_path, args.per_channel)
+    else:
+        if not args.calibration:
+            print("Error: --calibration is required for int8-static")
+            sys.exit(1)
+        success = quantize_static_int8(args.input_path, args.output_path, args.calibration,
+                                       args.max_chunks, args.per_channel, args.calibrate_method)
+    if not success:
+        print("\n❌ Conversion failed!")
+        sys.exit(1)
+
+    onnx.checker.check_model(args.output_path)
+    input_size = os.path.getsize(args.input_path) / (1024 * 1024)
+    output_size = os.path.getsize(args.output_path) / (1024 * 1024)
+    print(f"✅ Saved {args.output_path} ({output_size:.1f} MB, FP32 model: {input_size:.1f} MB)")
+    print("Check the accuracy with: python evaluate_precision.py "
+          f"{args.input_path} {args.output_path} --data <logits dir>")
+
+
+if __name__ == "__main__":
+    main()